@@ -0,0 +1,288 @@
+#include "AppConfig.h"
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+	uint32_t parseUnsigned(const std::string& option, const char* value)
+	{
+		try
+		{
+			// stoul takes "-1" (and leading blanks) and negates, and unsigned long may be wider than 32 bits.
+			if (!std::isdigit(static_cast<unsigned char>(value[0])))
+			{
+				throw std::invalid_argument(value);
+			}
+			size_t consumed = 0;
+			unsigned long long parsed = std::stoull(value, &consumed);
+			if (consumed != std::string(value).size() or parsed > std::numeric_limits<uint32_t>::max())
+			{
+				throw std::invalid_argument(value);
+			}
+			return static_cast<uint32_t>(parsed);
+		}
+		catch (const std::logic_error&)
+		{
+			throw std::invalid_argument("invalid value '" + std::string(value) + "' for " + option);
+		}
+	}
+
+	// Returns the value following an option, e.g. the "100" of "--frames 100".
+	const char* requireValue(int& i, int argc, char** argv)
+	{
+		if (i + 1 >= argc)
+		{
+			throw std::invalid_argument(std::string("missing value for ") + argv[i]);
+		}
+		return argv[++i];
+	}
+}
+
+AppConfig parseCommandLine(int argc, char** argv)
+{
+	AppConfig config;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+
+		if (option == "--headless")
+		{
+			config.headless = true;
+		}
+		else if (option == "--frames")
+		{
+			config.frameCount = parseUnsigned(option, requireValue(i, argc, argv));
+		}
+		else if (option == "--bench")
+		{
+			config.benchFrames = parseUnsigned(option, requireValue(i, argc, argv));
+		}
+		else if (option == "--warmup")
+		{
+			config.warmupFrames = parseUnsigned(option, requireValue(i, argc, argv));
+		}
+		else if (option == "--bench-out")
+		{
+			config.benchOutput = requireValue(i, argc, argv);
+		}
+		else if (option == "--pipeline-cache")
+		{
+			config.pipelineCachePath = requireValue(i, argc, argv);
+		}
+		else if (option == "--no-pipeline-cache")
+		{
+			config.pipelineCachePath.clear();
+		}
+		else if (option == "--no-command-cache")
+		{
+			config.commandBufferCache = false;
+		}
+		else if (option == "--threads")
+		{
+			config.threadCount = parseUnsigned(option, requireValue(i, argc, argv));
+		}
+		else if (option == "--draws")
+		{
+			config.drawCount = std::max(1u, parseUnsigned(option, requireValue(i, argc, argv)));
+		}
+		else if (option == "--record-bench")
+		{
+			config.recordBenchmark = true;
+		}
+		else if (option == "--stream-mb")
+		{
+			config.streamMegabytes = parseUnsigned(option, requireValue(i, argc, argv));
+		}
+		else if (option == "--instances")
+		{
+			config.instanceCount = std::max(1u, parseUnsigned(option, requireValue(i, argc, argv)));
+		}
+		else if (option == "--instance-sweep")
+		{
+			config.instanceSweep = true;
+		}
+		else if (option == "--gpu-driven")
+		{
+			config.gpuDriven = true;
+		}
+		else if (option == "--frames-in-flight")
+		{
+			config.framesInFlight = parseUnsigned(option, requireValue(i, argc, argv));
+			if (config.framesInFlight < 1 or config.framesInFlight > 4)
+			{
+				throw std::invalid_argument("--frames-in-flight must be between 1 and 4");
+			}
+		}
+		else if (option == "--pacing-sweep")
+		{
+			config.pacingSweep = true;
+		}
+		else if (option == "--present-policy")
+		{
+			std::string policy = requireValue(i, argc, argv);
+			if (policy == "low-latency")
+			{
+				config.presentPolicy = PresentPolicy::LowLatency;
+			}
+			else if (policy == "throughput")
+			{
+				config.presentPolicy = PresentPolicy::Throughput;
+			}
+			else if (policy == "power-saver")
+			{
+				config.presentPolicy = PresentPolicy::PowerSaver;
+			}
+			else if (policy == "fixed-fps")
+			{
+				config.presentPolicy = PresentPolicy::FixedFps;
+			}
+			else
+			{
+				throw std::invalid_argument("unknown present policy " + policy);
+			}
+		}
+		else if (option == "--fps")
+		{
+			config.targetFps = parseUnsigned(option, requireValue(i, argc, argv));
+		}
+		else if (option == "--shader-dir")
+		{
+			config.shaderDirectory = requireValue(i, argc, argv);
+		}
+		else if (option == "--trace")
+		{
+			config.traceOutput = requireValue(i, argc, argv);
+		}
+		else if (option == "--serial-init")
+		{
+			config.serialInit = true;
+		}
+		else if (option == "--host-allocator")
+		{
+			std::string mode = requireValue(i, argc, argv);
+			if (mode == "system")
+			{
+				config.hostAllocation = HostAllocationMode::System;
+			}
+			else if (mode == "tracking")
+			{
+				config.hostAllocation = HostAllocationMode::Tracking;
+			}
+			else if (mode == "pooled")
+			{
+				config.hostAllocation = HostAllocationMode::Pooled;
+			}
+			else
+			{
+				throw std::invalid_argument("unknown host allocator " + mode);
+			}
+		}
+		else if (option == "--render-pass")
+		{
+			config.dynamicRendering = false;
+		}
+		else if (option == "--msaa")
+		{
+			config.msaaSamples = parseUnsigned(option, requireValue(i, argc, argv));
+			if (config.msaaSamples != 1 and config.msaaSamples != 2 and config.msaaSamples != 4 and config.msaaSamples != 8)
+			{
+				throw std::invalid_argument("--msaa must be 1, 2, 4 or 8");
+			}
+		}
+		else if (option == "--no-depth-sort")
+		{
+			config.depthSort = false;
+		}
+		else if (option == "--overlap")
+		{
+			config.instanceOverlap = std::max(1u, parseUnsigned(option, requireValue(i, argc, argv)));
+		}
+		else if (option == "--overdraw")
+		{
+			config.overdrawQueries = true;
+		}
+		else if (option == "--cycle-variants")
+		{
+			config.cycleVariants = true;
+		}
+		else if (option == "--watch-shaders")
+		{
+			config.shaderSourceDirectory = requireValue(i, argc, argv);
+		}
+		else if (option == "--glslc")
+		{
+			config.glslcPath = requireValue(i, argc, argv);
+		}
+		else if (option == "--binding-bench")
+		{
+			config.bindingBenchmark = true;
+		}
+		else if (option == "--textures")
+		{
+			config.textureCount = parseUnsigned(option, requireValue(i, argc, argv));
+		}
+		else if (option == "--texture-size")
+		{
+			config.textureSize = parseUnsigned(option, requireValue(i, argc, argv));
+			if (config.textureSize == 0 or config.textureSize > 2048 or (config.textureSize & (config.textureSize - 1)) != 0)
+			{
+				throw std::invalid_argument("--texture-size must be a power of two up to 2048");
+			}
+		}
+		else if (option == "--texture-budget")
+		{
+			config.textureBudgetMegabytes = parseUnsigned(option, requireValue(i, argc, argv));
+		}
+		else
+		{
+			throw std::invalid_argument("unknown option " + option);
+		}
+	}
+
+	return config;
+}
+
+void printUsage(const char* program)
+{
+	std::cout << "usage: " << program << " [options]\n"
+		<< "  --headless             render offscreen without a window, surface or swap chain\n"
+		<< "  --frames N             number of frames to render in headless mode (default 1000)\n"
+		<< "  --bench N              measure N frames and print per-phase p50/p95/p99/max timings\n"
+		<< "  --warmup M             frames to render before measuring starts (default 60)\n"
+		<< "  --bench-out FILE       write per-frame samples and summary, JSON if FILE ends with .json, CSV otherwise\n"
+		<< "  --pipeline-cache FILE  pipeline cache file (default pipeline_cache.bin)\n"
+		<< "  --no-pipeline-cache    compile pipelines without loading or saving a cache\n"
+		<< "  --no-command-cache     re-record the frame's command buffers every frame\n"
+		<< "  --threads N            threads recording command buffers, 0 = one per hardware thread (default)\n"
+		<< "  --draws N              number of draws in the scene (default 1)\n"
+		<< "  --record-bench         time command recording against the thread count and exit\n"
+		<< "  --stream-mb N          stream an N MiB buffer to the GPU on the transfer queue while rendering\n"
+		<< "  --instances N          instances per draw (default 1)\n"
+		<< "  --instance-sweep       time frames with 1 to 10M instances (as many as memory allows) and exit\n"
+		<< "  --gpu-driven           animate and frustum cull instances in a compute shader, draw the visible ones indirectly\n"
+		<< "  --frames-in-flight N   frames queued ahead of the GPU, 1 to 4 (default 2)\n"
+		<< "  --pacing-sweep         time frames with 1 to 4 frames in flight, print the CPU wait of each and exit\n"
+		<< "  --present-policy P     low-latency, throughput (default), power-saver or fixed-fps\n"
+		<< "  --fps N                frame limit, defaults to 60 for fixed-fps, 30 for power-saver and none otherwise\n"
+		<< "  --shader-dir DIR       load .spv files found in DIR instead of the embedded shaders\n"
+		<< "  --trace FILE           write init steps and frame phases as Chrome trace JSON (chrome://tracing, Perfetto)\n"
+		<< "  --serial-init          initialize step by step instead of in parallel on the job system\n"
+		<< "  --host-allocator M     driver host memory: system, tracking or pooled (default)\n"
+		<< "  --render-pass          use render pass and framebuffer objects even where dynamic rendering is supported\n"
+		<< "  --msaa N               MSAA with N samples (1, 2, 4 or 8), resolved into the swap chain image (default 1)\n"
+		<< "  --no-depth-sort        draw instances in grid order instead of sorting them front to back\n"
+		<< "  --overlap N            scale instances to N times their grid cell so they overlap (default 1)\n"
+		<< "  --overdraw             count fragment shader invocations per pixel with pipeline statistics queries\n"
+		<< "  --cycle-variants       switch pipeline variants every 2 s, compiled in the background while a fallback draws\n"
+		<< "  --watch-shaders DIR    recompile DIR/shader.vert and shader.frag when they change and swap them in while running\n"
+		<< "  --glslc PATH           glslc used by --watch-shaders (default glslc on the PATH)\n"
+		<< "  --binding-bench        time recording max(--draws, 10000) draws bindless and with a set bind per draw, then exit\n"
+		<< "  --textures N           stream N textures mip by mip, coarsest first, and texture the draws with them\n"
+		<< "  --texture-size N       mip 0 size of the streamed textures, a power of two up to 2048 (default 1024)\n"
+		<< "  --texture-budget MB    device memory the streamed textures may use (default 256)\n"
+		<< std::endl;
+}
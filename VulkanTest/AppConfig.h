@@ -0,0 +1,123 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Latency/throughput trade-off of the present path, see PresentPacer.
+enum class PresentPolicy {
+	LowLatency,		// tearing allowed, newest frame shown as soon as possible
+	Throughput,		// render flat out where MAILBOX allows it, vsync otherwise; never tears
+	PowerSaver,		// vsync and a 30 fps limit
+	FixedFps,		// a frame every 1/targetFps seconds
+};
+
+// Where the driver's host memory comes from, see HostAllocator.
+enum class HostAllocationMode {
+	System,			// no VkAllocationCallbacks, the driver's own allocator, nothing is counted
+	Tracking,		// malloc for every allocation, with statistics
+	Pooled,			// size-class pools per allocation scope, with statistics
+};
+
+/*
+* Runtime options of the application, filled from the command line in main().
+* Every field has a default so that running the executable without arguments
+* behaves like the plain windowed triangle.
+*/
+struct AppConfig {
+	// Render into device-local images owned by the app instead of a window + swap chain.
+	bool headless = false;
+
+	// Number of frames to render in headless mode before the main loop exits.
+	uint32_t frameCount = 1000;
+
+	// Frame benchmark: measure benchFrames frames after warmupFrames unmeasured ones, 0 disables it.
+	uint32_t benchFrames = 0;
+	uint32_t warmupFrames = 60;
+	// Report file for the benchmark samples and summary, ".json" selects JSON, anything else CSV.
+	std::string benchOutput;
+
+	// On-disk VkPipelineCache blob, loaded at startup and written back at shutdown. Empty disables it.
+	std::string pipelineCachePath = "pipeline_cache.bin";
+
+	// Replay pre-recorded command buffers per swap chain image instead of re-recording every frame.
+	bool commandBufferCache = true;
+
+	// Threads recording secondary command buffers (including the main thread), 0 = one per hardware thread.
+	uint32_t threadCount = 0;
+	// Number of draws in the scene, the triangle is simply drawn this many times.
+	uint32_t drawCount = 1;
+	// Time command recording for 1..threadCount threads and exit instead of running the main loop.
+	bool recordBenchmark = false;
+
+	// Size in MiB of a synthetic asset streamed to the GPU while rendering, 0 disables it.
+	uint32_t streamMegabytes = 0;
+
+	// Instances per draw, each one with its own transform and color updated every frame.
+	uint32_t instanceCount = 1;
+	// Render with 1, 10, ... 10M instances (fewer when the device lacks the memory) and print the frame time of each, then exit.
+	bool instanceSweep = false;
+
+	// Animate and cull instances in a compute pass and draw the survivors with one indirect draw, instead of writing and drawing every instance.
+	bool gpuDriven = false;
+
+	// Frames the CPU may queue ahead of the GPU, 1 to 4: fewer means lower latency, more means fewer CPU stalls.
+	uint32_t framesInFlight = 2;
+	// Render with 1 to 4 frames in flight and print the CPU wait of each, then exit.
+	bool pacingSweep = false;
+
+	// Present mode preference and frame limiting of the windowed main loop.
+	PresentPolicy presentPolicy = PresentPolicy::Throughput;
+	// Frame limit in frames per second, 0 = the policy's default (60 for fixed-fps, 30 for power-saver, else none).
+	uint32_t targetFps = 0;
+
+	// Directory whose .spv files replace the shaders embedded at build time, empty uses the embedded ones.
+	std::string shaderDirectory;
+
+	// Chrome trace_event JSON of the init steps and frame phases, empty disables tracing.
+	std::string traceOutput;
+
+	// Run the init steps one after another instead of as a task graph, to compare time-to-first-present.
+	bool serialInit = false;
+
+	// VkAllocationCallbacks passed to every vkCreate*/vkDestroy* call.
+	HostAllocationMode hostAllocation = HostAllocationMode::Pooled;
+
+	// Render without VkRenderPass/VkFramebuffer objects (VK_KHR_dynamic_rendering) when the device supports it.
+	bool dynamicRendering = true;
+
+	// MSAA samples per pixel, 1, 2, 4 or 8, lowered to what the device supports. 1 disables MSAA.
+	uint32_t msaaSamples = 1;
+
+	// Sort instances front to back every frame so the depth test rejects hidden fragments before shading (not with gpuDriven).
+	bool depthSort = true;
+	// Instance size relative to its grid cell, above 1 neighbours overlap and produce overdraw.
+	uint32_t instanceOverlap = 1;
+	// Count fragment shader invocations with a pipeline statistics query and report them per pixel.
+	bool overdrawQueries = false;
+
+	// Switch between a few pipeline variants every two seconds, each compiled in the background the first time.
+	bool cycleVariants = false;
+
+	// Directory of shader.vert/shader.frag to watch, edits are recompiled and swapped in while running. Empty disables it.
+	std::string shaderSourceDirectory;
+	// glslc used for those recompiles, a bare name is looked up on the PATH.
+	std::string glslcPath = "glslc";
+
+	// Time recording 10k+ draws with the bindless set against a descriptor set bind per draw, then exit.
+	bool bindingBenchmark = false;
+
+	// Streamed textures drawn by the draws in turn, 0 disables texturing. Their mip 0 size, a power of two up to 2048.
+	uint32_t textureCount = 0;
+	uint32_t textureSize = 1024;
+	// Device memory the streamed textures may use, lowered to what VK_EXT_memory_budget reports when it's available.
+	uint32_t textureBudgetMegabytes = 256;
+};
+
+/* Parse the command line into an AppConfig
+* @param argument count passed to main()
+* @param argument vector passed to main()
+* @return the parsed configuration, throws std::invalid_argument on unknown or malformed options
+*/
+AppConfig parseCommandLine(int argc, char** argv);
+
+// Print the supported options to stdout
+void printUsage(const char* program);
@@ -0,0 +1,216 @@
+#include "BindlessDescriptors.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+void DescriptorIndexAllocator::reset(uint32_t capacity)
+{
+	indexCapacity = capacity;
+	nextUnused = 0;
+	freeIndices.clear();
+	freeIndices.reserve(capacity);
+}
+
+bool DescriptorIndexAllocator::allocate(uint32_t& index)
+{
+	if (!freeIndices.empty())
+	{
+		index = freeIndices.back();
+		freeIndices.pop_back();
+		return true;
+	}
+
+	if (nextUnused == indexCapacity)
+	{
+		return false;
+	}
+	index = nextUnused++;
+	return true;
+}
+
+void DescriptorIndexAllocator::free(uint32_t index)
+{
+	freeIndices.push_back(index);
+}
+
+void BindlessDescriptors::init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks* hostAllocator,
+	FrameScheduler& frameScheduler, uint32_t textureCapacity, uint32_t bufferCapacity)
+{
+	this->device = device;
+	this->hostAllocator = hostAllocator;
+	this->frameScheduler = &frameScheduler;
+
+	/*
+	* Update-after-bind descriptors have limits of their own, far above the regular ones on desktop GPUs.
+	* The set is used by the vertex and fragment stage, so the per-stage limits apply as well as the per-set ones.
+	*/
+	VkPhysicalDeviceVulkan12Properties vulkan12Properties{};
+	vulkan12Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &vulkan12Properties;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+	textureCapacity = std::min({ textureCapacity,
+		vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages, vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		vulkan12Properties.maxDescriptorSetUpdateAfterBindSamplers, vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSamplers });
+	bufferCapacity = std::min({ bufferCapacity,
+		vulkan12Properties.maxDescriptorSetUpdateAfterBindStorageBuffers, vulkan12Properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+	// Both arrays count against the per-stage resource limit.
+	uint32_t resourceLimit = vulkan12Properties.maxPerStageUpdateAfterBindResources;
+	if (textureCapacity + bufferCapacity > resourceLimit)
+	{
+		textureCapacity = std::min(textureCapacity, resourceLimit / 2);
+		bufferCapacity = resourceLimit - textureCapacity;
+	}
+
+	VkDescriptorSetLayoutBinding bindings[2]{};
+	bindings[TEXTURE_BINDING].binding = TEXTURE_BINDING;
+	bindings[TEXTURE_BINDING].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[TEXTURE_BINDING].descriptorCount = textureCapacity;
+	bindings[TEXTURE_BINDING].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	bindings[BUFFER_BINDING].binding = BUFFER_BINDING;
+	bindings[BUFFER_BINDING].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[BUFFER_BINDING].descriptorCount = bufferCapacity;
+	bindings[BUFFER_BINDING].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	/*
+	* UPDATE_UNUSED_WHILE_PENDING: elements that pending command buffers don't use may be rewritten, which is what
+	* adding a resource while frames are in flight does. PARTIALLY_BOUND: the unwritten elements are never read.
+	*/
+	VkDescriptorBindingFlags bindingFlags[2] = {};
+	for (VkDescriptorBindingFlags& flags : bindingFlags)
+	{
+		flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT
+			| VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+	}
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+	bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsInfo.bindingCount = 2;
+	bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = &bindingFlagsInfo;
+	layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, hostAllocator, &setLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create bindless descriptor set layout.");
+	}
+
+	VkDescriptorPoolSize poolSizes[2] = {
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textureCapacity },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferCapacity },
+	};
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 2;
+	poolInfo.pPoolSizes = poolSizes;
+
+	if (vkCreateDescriptorPool(device, &poolInfo, hostAllocator, &pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create bindless descriptor pool.");
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = pool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &setLayout;
+
+	if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate bindless descriptor set.");
+	}
+
+	textures.reset(textureCapacity);
+	buffers.reset(bufferCapacity);
+}
+
+void BindlessDescriptors::destroy()
+{
+	// Destroying the pool frees the set.
+	vkDestroyDescriptorPool(device, pool, hostAllocator);
+	vkDestroyDescriptorSetLayout(device, setLayout, hostAllocator);
+	retiredIndices.clear();
+}
+
+uint32_t BindlessDescriptors::addTexture(VkImageView view, VkSampler sampler, VkImageLayout layout)
+{
+	uint32_t index = allocate(textures, "texture");
+
+	VkDescriptorImageInfo imageInfo{ sampler, view, layout };
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = descriptorSet;
+	write.dstBinding = TEXTURE_BINDING;
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+	return index;
+}
+
+uint32_t BindlessDescriptors::addStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	uint32_t index = allocate(buffers, "storage buffer");
+
+	VkDescriptorBufferInfo bufferInfo{ buffer, offset, range };
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = descriptorSet;
+	write.dstBinding = BUFFER_BINDING;
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.pBufferInfo = &bufferInfo;
+	vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+	return index;
+}
+
+void BindlessDescriptors::freeTexture(uint32_t index)
+{
+	retire(TEXTURE_BINDING, index);
+}
+
+void BindlessDescriptors::freeStorageBuffer(uint32_t index)
+{
+	retire(BUFFER_BINDING, index);
+}
+
+void BindlessDescriptors::collect()
+{
+	// Retired in frame order, stop at the first index a frame in flight may still read.
+	while (!retiredIndices.empty() and frameScheduler->isComplete(retiredIndices.front().retiredAtValue))
+	{
+		const RetiredIndex& retired = retiredIndices.front();
+		(retired.binding == TEXTURE_BINDING ? textures : buffers).free(retired.index);
+		retiredIndices.pop_front();
+	}
+}
+
+uint32_t BindlessDescriptors::allocate(DescriptorIndexAllocator& allocator, const char* arrayName)
+{
+	uint32_t index;
+	if (!allocator.allocate(index))
+	{
+		throw std::runtime_error(std::string("failed to allocate a bindless ") + arrayName + " descriptor, all "
+			+ std::to_string(allocator.capacity()) + " are in use.");
+	}
+	return index;
+}
+
+void BindlessDescriptors::retire(uint32_t binding, uint32_t index)
+{
+	retiredIndices.push_back({ binding, index, frameScheduler->lastSubmittedValue() });
+}
@@ -0,0 +1,98 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "FrameScheduler.h"
+
+/*
+* Hands out elements of a descriptor array. Freed indices go on a free list and are reused most recent first,
+* the list is reserved up front so allocate() and free() never allocate.
+*/
+class DescriptorIndexAllocator
+{
+public:
+	void reset(uint32_t capacity);
+
+	// false when every index is in use
+	bool allocate(uint32_t& index);
+	void free(uint32_t index);
+
+	uint32_t capacity() const { return indexCapacity; }
+	uint32_t liveCount() const { return nextUnused - static_cast<uint32_t>(freeIndices.size()); }
+
+private:
+	std::vector<uint32_t> freeIndices;
+	uint32_t nextUnused = 0;	// indices from here on were never handed out
+	uint32_t indexCapacity = 0;
+};
+
+/*
+* The bindless resource model: a single descriptor set with one large array per descriptor type, bound once per
+* command buffer. Draws pick their resources by array index (a push constant), not by binding a set of their own.
+* Everything is UPDATE_AFTER_BIND and PARTIALLY_BOUND (VK_EXT_descriptor_indexing, core in 1.2): descriptors are
+* written while command buffers using the set are pending, as long as those don't use the written elements,
+* and unwritten elements are fine as long as nothing reads them.
+* A freed index may still be read by frames in flight, it's only reused once the frames submitted before the free have completed.
+* Owned by the render thread, it is not thread safe.
+*/
+class BindlessDescriptors
+{
+public:
+	// Bindings of the set, shaders declare them as unsized arrays (see shader.frag)
+	static constexpr uint32_t TEXTURE_BINDING = 0;	// combined image samplers
+	static constexpr uint32_t BUFFER_BINDING = 1;	// storage buffers
+
+	/* Create the layout, the pool and the set
+	* @param capacities of the arrays, lowered to the device's update-after-bind limits
+	*/
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks* hostAllocator,
+		FrameScheduler& frameScheduler, uint32_t textureCapacity = 4096, uint32_t bufferCapacity = 16384);
+	// The device must be idle
+	void destroy();
+
+	VkDescriptorSetLayout layout() const { return setLayout; }
+	VkDescriptorSet set() const { return descriptorSet; }
+
+	/* Write a descriptor into a free element, throws std::runtime_error when the array is full
+	* @return the element's index, which shaders use to access it
+	*/
+	uint32_t addTexture(VkImageView view, VkSampler sampler, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	uint32_t addStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+
+	// Give an element back once the frames submitted so far have completed
+	void freeTexture(uint32_t index);
+	void freeStorageBuffer(uint32_t index);
+
+	// Reuse the elements freed before the completed frames, once per frame
+	void collect();
+
+	uint32_t textureCapacity() const { return textures.capacity(); }
+	uint32_t bufferCapacity() const { return buffers.capacity(); }
+	uint32_t liveTextures() const { return textures.liveCount(); }
+	uint32_t liveBuffers() const { return buffers.liveCount(); }
+
+private:
+	struct RetiredIndex {
+		uint32_t binding;
+		uint32_t index;
+		uint64_t retiredAtValue;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* hostAllocator = nullptr;
+	FrameScheduler* frameScheduler = nullptr;
+
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+	DescriptorIndexAllocator textures;
+	DescriptorIndexAllocator buffers;
+	std::deque<RetiredIndex> retiredIndices;	// in retirement order, which is frame order
+
+	uint32_t allocate(DescriptorIndexAllocator& allocator, const char* arrayName);
+	void retire(uint32_t binding, uint32_t index);
+};
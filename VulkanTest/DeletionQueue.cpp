@@ -0,0 +1,140 @@
+#include "DeletionQueue.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+	// The inverse of the cast in retire()
+	template <typename Handle>
+	Handle toHandle(uint64_t handle)
+	{
+		return (Handle)handle;
+	}
+}
+
+void DeletionQueue::init(VkDevice device, const VkAllocationCallbacks* hostAllocator, GpuAllocator& gpuAllocator,
+	FrameScheduler& frameScheduler, uint32_t capacity)
+{
+	this->device = device;
+	this->hostAllocator = hostAllocator;
+	this->gpuAllocator = &gpuAllocator;
+	this->frameScheduler = &frameScheduler;
+	entries.resize(std::max(capacity, 1u));
+}
+
+void DeletionQueue::retireImage(VkImage image, const GpuAllocation& allocation)
+{
+	push(VK_OBJECT_TYPE_IMAGE, (uint64_t)image, allocation);
+}
+
+void DeletionQueue::retireBuffer(VkBuffer buffer, const GpuAllocation& allocation)
+{
+	push(VK_OBJECT_TYPE_BUFFER, (uint64_t)buffer, allocation);
+}
+
+void DeletionQueue::push(VkObjectType type, uint64_t handle, const GpuAllocation& allocation)
+{
+	if (handle == 0)
+	{
+		return;
+	}
+
+	if (size() == entries.size())
+	{
+		// Rare, a recreation retires a few dozen handles. Waiting for the oldest frame beats allocating on a runtime path.
+		Entry& oldest = entries[head % entries.size()];
+		frameScheduler->wait(oldest.retiredAtValue);
+		collect();
+		stalls++;
+	}
+
+	Entry& entry = entries[tail % entries.size()];
+	entry.type = type;
+	entry.handle = handle;
+	entry.allocation = allocation;
+	entry.retiredAtValue = frameScheduler->lastSubmittedValue();
+	tail++;
+	maxSize = std::max(maxSize, size());
+}
+
+void DeletionQueue::collect()
+{
+	// Frames complete in submission order and the values were retired in order, stop at the first one still in flight.
+	while (head != tail)
+	{
+		Entry& entry = entries[head % entries.size()];
+		if (!frameScheduler->isComplete(entry.retiredAtValue))
+		{
+			break;
+		}
+		destroy(entry);
+		head++;
+	}
+}
+
+void DeletionQueue::flush()
+{
+	while (head != tail)
+	{
+		destroy(entries[head % entries.size()]);
+		head++;
+	}
+}
+
+void DeletionQueue::destroy(Entry& entry)
+{
+	switch (entry.type)
+	{
+	case VK_OBJECT_TYPE_PIPELINE:
+		vkDestroyPipeline(device, toHandle<VkPipeline>(entry.handle), hostAllocator);
+		break;
+	case VK_OBJECT_TYPE_PIPELINE_LAYOUT:
+		vkDestroyPipelineLayout(device, toHandle<VkPipelineLayout>(entry.handle), hostAllocator);
+		break;
+	case VK_OBJECT_TYPE_RENDER_PASS:
+		vkDestroyRenderPass(device, toHandle<VkRenderPass>(entry.handle), hostAllocator);
+		break;
+	case VK_OBJECT_TYPE_SHADER_MODULE:
+		vkDestroyShaderModule(device, toHandle<VkShaderModule>(entry.handle), hostAllocator);
+		break;
+	case VK_OBJECT_TYPE_FRAMEBUFFER:
+		vkDestroyFramebuffer(device, toHandle<VkFramebuffer>(entry.handle), hostAllocator);
+		break;
+	case VK_OBJECT_TYPE_IMAGE_VIEW:
+		vkDestroyImageView(device, toHandle<VkImageView>(entry.handle), hostAllocator);
+		break;
+	case VK_OBJECT_TYPE_IMAGE:
+		vkDestroyImage(device, toHandle<VkImage>(entry.handle), hostAllocator);
+		gpuAllocator->free(entry.allocation);
+		break;
+	case VK_OBJECT_TYPE_BUFFER:
+		gpuAllocator->destroyBuffer(toHandle<VkBuffer>(entry.handle), entry.allocation);
+		break;
+	case VK_OBJECT_TYPE_SWAPCHAIN_KHR:
+		vkDestroySwapchainKHR(device, toHandle<VkSwapchainKHR>(entry.handle), hostAllocator);
+		break;
+	case VK_OBJECT_TYPE_COMMAND_POOL:
+		// Destroying a pool frees the command buffers allocated from it.
+		vkDestroyCommandPool(device, toHandle<VkCommandPool>(entry.handle), hostAllocator);
+		break;
+	case VK_OBJECT_TYPE_DESCRIPTOR_POOL:
+		// Destroying a pool frees its descriptor sets.
+		vkDestroyDescriptorPool(device, toHandle<VkDescriptorPool>(entry.handle), hostAllocator);
+		break;
+	case VK_OBJECT_TYPE_QUERY_POOL:
+		vkDestroyQueryPool(device, toHandle<VkQueryPool>(entry.handle), hostAllocator);
+		break;
+	default:
+		throw std::runtime_error("failed to destroy a retired object of unsupported type " + std::to_string(entry.type));
+	}
+
+	entry.handle = 0;
+	destroyed++;
+}
+
+void DeletionQueue::printSummary(std::ostream& out) const
+{
+	out << "deferred deletion: " << destroyed << " objects destroyed after their frames, " << size() << " pending, "
+		<< maxSize << " of " << entries.size() << " ring entries at most, " << stalls << " waits for a full ring" << std::endl;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "FrameScheduler.h"
+#include "GpuAllocator.h"
+
+/*
+* Vulkan objects replaced while frames are in flight, destroyed once no frame can use them anymore.
+* Every retired handle is tagged with the frame timeline value of the last frame submitted so far and
+* collect() destroys it when the timeline has reached that value: replacing a resource never needs vkDeviceWaitIdle.
+* The entries live in a ring allocated once by init(), retiring and collecting never allocate. Values are
+* retired in nondecreasing order, so the oldest entry is always the first to become destroyable.
+* A full ring waits for its oldest entry instead of growing.
+* Owned by the render thread, it is not thread safe.
+*/
+class DeletionQueue
+{
+public:
+	void init(VkDevice device, const VkAllocationCallbacks* hostAllocator, GpuAllocator& gpuAllocator,
+		FrameScheduler& frameScheduler, uint32_t capacity = 1024);
+
+	/* Destroy a handle once the frames submitted so far have completed, null handles are ignored
+	* @param type of the handle: PIPELINE, PIPELINE_LAYOUT, RENDER_PASS, SHADER_MODULE, FRAMEBUFFER, IMAGE_VIEW,
+	*        SWAPCHAIN_KHR, COMMAND_POOL, DESCRIPTOR_POOL or QUERY_POOL. Images and buffers have their own calls.
+	*/
+	template <typename Handle>
+	void retire(VkObjectType type, Handle handle)
+	{
+		// A C cast, handles are pointers on 64 bit platforms and 64 bit integers (non-dispatchable) on 32 bit ones.
+		push(type, (uint64_t)handle, GpuAllocation{});
+	}
+	void retireImage(VkImage image, const GpuAllocation& allocation);
+	void retireBuffer(VkBuffer buffer, const GpuAllocation& allocation);
+
+	// Destroy what the completed frames left behind, once per frame
+	void collect();
+	// Destroy everything, the device must be idle
+	void flush();
+
+	uint32_t size() const { return static_cast<uint32_t>(tail - head); }
+	uint32_t highWaterMark() const { return maxSize; }
+	uint64_t destroyedCount() const { return destroyed; }
+	uint64_t stallCount() const { return stalls; }
+	void printSummary(std::ostream& out) const;
+
+private:
+	struct Entry {
+		VkObjectType type = VK_OBJECT_TYPE_UNKNOWN;
+		uint64_t handle = 0;
+		GpuAllocation allocation;	// images and buffers only
+		uint64_t retiredAtValue = 0;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* hostAllocator = nullptr;
+	GpuAllocator* gpuAllocator = nullptr;
+	FrameScheduler* frameScheduler = nullptr;
+
+	// The positions only ever grow, entry i is entries[i % capacity].
+	std::vector<Entry> entries;
+	uint64_t head = 0;
+	uint64_t tail = 0;
+
+	uint32_t maxSize = 0;
+	uint64_t destroyed = 0;
+	uint64_t stalls = 0;	// retirements that found the ring full and waited for the GPU
+
+	void push(VkObjectType type, uint64_t handle, const GpuAllocation& allocation);
+	void destroy(Entry& entry);
+};
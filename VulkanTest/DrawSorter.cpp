@@ -0,0 +1,69 @@
+#include "DrawSorter.h"
+#include <algorithm>
+
+uint64_t DrawSorter::makeKey(uint32_t layer, float depth, uint32_t drawIndex)
+{
+	uint64_t quantizedDepth = static_cast<uint64_t>(std::clamp(depth, 0.0f, 1.0f) * 0xFFFFFF);
+	return (static_cast<uint64_t>(layer & 0xFF) << 56) | (quantizedDepth << 32) | drawIndex;
+}
+
+void DrawSorter::sort(std::vector<uint64_t>& keys, uint32_t sortedLowBits)
+{
+	passCount = 0;
+	size_t count = keys.size();
+	if (count < 2)
+	{
+		return;
+	}
+
+	// One read of the keys builds the histograms of every digit at once.
+	const uint32_t firstDigit = sortedLowBits / 8;
+	uint32_t histograms[8][256] = {};
+	for (uint64_t key : keys)
+	{
+		for (uint32_t digit = firstDigit; digit < 8; digit++)
+		{
+			histograms[digit][(key >> (digit * 8)) & 0xFF]++;
+		}
+	}
+
+	scratch.resize(count);
+	uint64_t* source = keys.data();
+	uint64_t* destination = scratch.data();
+
+	for (uint32_t digit = firstDigit; digit < 8; digit++)
+	{
+		uint32_t* histogram = histograms[digit];
+		uint32_t shift = digit * 8;
+
+		// Every key has the same digit: the pass would copy the keys in the same order.
+		if (histogram[(source[0] >> shift) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		// Histogram to exclusive prefix sum, the start of each bucket in the destination.
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < 256; bucket++)
+		{
+			uint32_t bucketSize = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketSize;
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			uint64_t key = source[i];
+			destination[histogram[(key >> shift) & 0xFF]++] = key;
+		}
+
+		std::swap(source, destination);
+		passCount++;
+	}
+
+	// An odd number of passes leaves the result in the scratch buffer.
+	if (source != keys.data())
+	{
+		keys.swap(scratch);
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/*
+* Orders draws by a packed 64-bit key with an LSD radix sort: one 8-bit digit per pass, stable, and linear in the
+* number of draws whatever the keys are, which keeps it cheap at 100k+ draws where std::sort's comparisons add up.
+*
+* Key layout, most significant first:
+*   [63..56] layer, opaque draws are layer 0 and come first
+*   [55..32] depth quantized to 24 bits, 0 is the near plane: ascending order is front to back
+*   [31..0]  draw index
+* Passes whose digit is the same in every key are skipped, so the constant layer byte costs nothing.
+*/
+class DrawSorter
+{
+public:
+	static constexpr uint32_t OPAQUE_LAYER = 0;
+
+	// depth in [0, 1], clamped
+	static uint64_t makeKey(uint32_t layer, float depth, uint32_t drawIndex);
+	static uint32_t drawIndex(uint64_t key) { return static_cast<uint32_t>(key); }
+
+	/* Sort keys ascending
+	* @param keys to sort in place
+	* @param number of low key bits (a multiple of 8) that are already ascending in the input, e.g. 32 when the keys
+	*        were made in draw index order. The sort is stable, so those digits don't need a pass of their own.
+	*/
+	void sort(std::vector<uint64_t>& keys, uint32_t sortedLowBits = 0);
+
+	// Digit passes the last sort() made, at most 8
+	uint32_t lastPassCount() const { return passCount; }
+
+private:
+	std::vector<uint64_t> scratch;	// ping-pong buffer, kept to avoid an allocation per frame
+	uint32_t passCount = 0;
+};
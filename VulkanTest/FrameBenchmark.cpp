@@ -0,0 +1,271 @@
+#include "FrameBenchmark.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+FrameBenchmark::FrameBenchmark(uint32_t warmupFrames, uint32_t measuredFrames)
+	: warmupFrames(warmupFrames), measuredFrames(measuredFrames)
+{
+	samples.reserve(static_cast<size_t>(warmupFrames) + measuredFrames);
+}
+
+bool FrameBenchmark::isFinished() const
+{
+	return samples.size() >= totalFrames();
+}
+
+uint32_t FrameBenchmark::totalFrames() const
+{
+	return warmupFrames + measuredFrames;
+}
+
+uint64_t FrameBenchmark::beginFrame()
+{
+	FrameSample sample;
+	sample.frame = samples.size();
+	samples.push_back(sample);
+
+	frameStart = Clock::now();
+	return sample.frame;
+}
+
+void FrameBenchmark::endFrame()
+{
+	samples.back().cpuMs = millisecondsBetween(frameStart, Clock::now());
+}
+
+void FrameBenchmark::beginPhase(FramePhase phase)
+{
+	phaseStart[static_cast<size_t>(phase)] = Clock::now();
+}
+
+void FrameBenchmark::endPhase(FramePhase phase)
+{
+	size_t index = static_cast<size_t>(phase);
+	// A phase may run more than once per frame (e.g. a retried acquire), so accumulate.
+	samples.back().phaseMs[index] += millisecondsBetween(phaseStart[index], Clock::now());
+}
+
+void FrameBenchmark::setGpuTime(uint64_t frame, double milliseconds)
+{
+	if (frame < samples.size())
+	{
+		samples[frame].gpuMs = milliseconds;
+	}
+}
+
+template<typename Selector>
+FrameBenchmark::Statistics FrameBenchmark::summarize(Selector selector) const
+{
+	std::vector<double> values;
+	for (size_t i = warmupFrames; i < samples.size(); i++)
+	{
+		double value = selector(samples[i]);
+		if (value >= 0.0)
+		{
+			values.push_back(value);
+		}
+	}
+
+	Statistics stats;
+	stats.count = values.size();
+	if (values.empty())
+	{
+		return stats;
+	}
+
+	std::sort(values.begin(), values.end());
+
+	// nearest-rank percentile
+	auto percentile = [&values](double p) {
+		size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * values.size()));
+		return values[std::clamp<size_t>(rank, 1, values.size()) - 1];
+	};
+
+	double sum = 0.0;
+	for (double value : values)
+	{
+		sum += value;
+	}
+
+	stats.mean = sum / values.size();
+	stats.p50 = percentile(50.0);
+	stats.p95 = percentile(95.0);
+	stats.p99 = percentile(99.0);
+	stats.max = values.back();
+	return stats;
+}
+
+std::vector<std::pair<std::string, FrameBenchmark::Statistics>> FrameBenchmark::collectSummary() const
+{
+	std::vector<std::pair<std::string, Statistics>> summary;
+
+	for (size_t i = 0; i < static_cast<size_t>(FramePhase::Count); i++)
+	{
+		summary.emplace_back(phaseName(static_cast<FramePhase>(i)), summarize([i](const FrameSample& s) { return s.phaseMs[i]; }));
+	}
+	summary.emplace_back("cpu_frame", summarize([](const FrameSample& s) { return s.cpuMs; }));
+	summary.emplace_back("gpu_render_pass", summarize([](const FrameSample& s) { return s.gpuMs; }));
+
+	return summary;
+}
+
+void FrameBenchmark::printSummary(std::ostream& out) const
+{
+	out << "benchmark: " << measuredFrames << " frames after " << warmupFrames << " warmup frames (ms)" << std::endl;
+	out << std::fixed << std::setprecision(4);
+
+	for (const auto& [name, stats] : collectSummary())
+	{
+		if (stats.count == 0)
+		{
+			out << "  " << std::setw(16) << std::left << name << " n/a" << std::endl;
+			continue;
+		}
+
+		out << "  " << std::setw(16) << std::left << name << std::right
+			<< " mean " << stats.mean
+			<< "  p50 " << stats.p50
+			<< "  p95 " << stats.p95
+			<< "  p99 " << stats.p99
+			<< "  max " << stats.max << std::endl;
+	}
+
+	out << std::defaultfloat;
+}
+
+void FrameBenchmark::writeReport(const std::string& path) const
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("failed to open benchmark report " + path);
+	}
+
+	bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+	if (json)
+	{
+		writeJson(file);
+	}
+	else
+	{
+		writeCsv(file);
+	}
+}
+
+void FrameBenchmark::writeCsv(std::ostream& out) const
+{
+	out << "frame";
+	for (size_t i = 0; i < static_cast<size_t>(FramePhase::Count); i++)
+	{
+		out << "," << phaseName(static_cast<FramePhase>(i)) << "_ms";
+	}
+	out << ",cpu_frame_ms,gpu_render_pass_ms\n";
+
+	for (size_t i = warmupFrames; i < samples.size(); i++)
+	{
+		const FrameSample& sample = samples[i];
+		out << sample.frame;
+		for (double phase : sample.phaseMs)
+		{
+			out << "," << phase;
+		}
+		out << "," << sample.cpuMs << ",";
+		if (sample.gpuMs >= 0.0)
+		{
+			out << sample.gpuMs;
+		}
+		out << "\n";
+	}
+
+	// The summary follows the samples, one row per statistic with the same columns.
+	auto summary = collectSummary();
+	const std::pair<const char*, double Statistics::*> rows[] = {
+		{ "mean", &Statistics::mean },
+		{ "p50", &Statistics::p50 },
+		{ "p95", &Statistics::p95 },
+		{ "p99", &Statistics::p99 },
+		{ "max", &Statistics::max },
+	};
+
+	for (const auto& [rowName, member] : rows)
+	{
+		out << rowName;
+		for (const auto& entry : summary)
+		{
+			out << ",";
+			if (entry.second.count > 0)
+			{
+				out << entry.second.*member;
+			}
+		}
+		out << "\n";
+	}
+}
+
+void FrameBenchmark::writeJson(std::ostream& out) const
+{
+	out << "{\n  \"warmup_frames\": " << warmupFrames << ",\n  \"measured_frames\": " << measuredFrames << ",\n";
+
+	out << "  \"summary_ms\": {\n";
+	auto summary = collectSummary();
+	for (size_t i = 0; i < summary.size(); i++)
+	{
+		const Statistics& stats = summary[i].second;
+		out << "    \"" << summary[i].first << "\": ";
+		if (stats.count == 0)
+		{
+			out << "null";
+		}
+		else
+		{
+			out << "{ \"mean\": " << stats.mean << ", \"p50\": " << stats.p50 << ", \"p95\": " << stats.p95
+				<< ", \"p99\": " << stats.p99 << ", \"max\": " << stats.max << " }";
+		}
+		out << (i + 1 < summary.size() ? ",\n" : "\n");
+	}
+	out << "  },\n";
+
+	out << "  \"samples_ms\": [\n";
+	for (size_t i = warmupFrames; i < samples.size(); i++)
+	{
+		const FrameSample& sample = samples[i];
+		out << "    { \"frame\": " << sample.frame;
+		for (size_t p = 0; p < sample.phaseMs.size(); p++)
+		{
+			out << ", \"" << phaseName(static_cast<FramePhase>(p)) << "\": " << sample.phaseMs[p];
+		}
+		out << ", \"cpu_frame\": " << sample.cpuMs << ", \"gpu_render_pass\": ";
+		if (sample.gpuMs >= 0.0)
+		{
+			out << sample.gpuMs;
+		}
+		else
+		{
+			out << "null";
+		}
+		out << " }" << (i + 1 < samples.size() ? ",\n" : "\n");
+	}
+	out << "  ]\n}\n";
+}
+
+const char* FrameBenchmark::phaseName(FramePhase phase)
+{
+	switch (phase)
+	{
+	case FramePhase::WaitFrame: return "wait_frame";
+	case FramePhase::Acquire:	return "acquire";
+	case FramePhase::Record:	return "record";
+	case FramePhase::Update:	return "update";
+	case FramePhase::Submit:	return "submit";
+	case FramePhase::Present:	return "present";
+	default:					return "unknown";
+	}
+}
+
+double FrameBenchmark::millisecondsBetween(Clock::time_point begin, Clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - begin).count();
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "TraceProfiler.h"
+
+// CPU phases of drawFrame(), in the order they happen.
+enum class FramePhase : uint32_t {
+	WaitFrame,
+	Acquire,
+	Record,
+	Update,
+	Submit,
+	Present,
+	Count,
+};
+
+struct FrameSample {
+	uint64_t frame = 0;
+	std::array<double, static_cast<size_t>(FramePhase::Count)> phaseMs{};
+	double cpuMs = 0.0;		// whole drawFrame() call
+	double gpuMs = -1.0;	// render pass time from timestamp queries, negative when not (yet) available
+};
+
+/*
+* Collects per-frame CPU phase timings and GPU render pass timings.
+* The first warmupFrames frames are recorded but excluded from the summary and the report,
+* GPU times arrive a few frames late (once the frame's fence has signaled) and are matched by frame number.
+*/
+class FrameBenchmark
+{
+public:
+	FrameBenchmark(uint32_t warmupFrames, uint32_t measuredFrames);
+
+	bool isFinished() const;
+	uint32_t totalFrames() const;
+
+	// Returns the number of the frame that was started
+	uint64_t beginFrame();
+	void endFrame();
+
+	void beginPhase(FramePhase phase);
+	void endPhase(FramePhase phase);
+
+	// Attach the GPU time of an earlier frame once its timestamp queries are available
+	void setGpuTime(uint64_t frame, double milliseconds);
+
+	void printSummary(std::ostream& out) const;
+
+	static const char* phaseName(FramePhase phase);
+
+	// Writes the samples and the summary, as JSON when the path ends with ".json" and as CSV otherwise
+	void writeReport(const std::string& path) const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Statistics {
+		double mean = 0.0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+		size_t count = 0;
+	};
+
+	uint32_t warmupFrames;
+	uint32_t measuredFrames;
+
+	std::vector<FrameSample> samples;
+	Clock::time_point frameStart;
+	std::array<Clock::time_point, static_cast<size_t>(FramePhase::Count)> phaseStart;
+
+	// Statistics over the measured (non warmup) frames, the selector picks the value to summarize
+	template<typename Selector>
+	Statistics summarize(Selector selector) const;
+
+	std::vector<std::pair<std::string, Statistics>> collectSummary() const;
+	void writeCsv(std::ostream& out) const;
+	void writeJson(std::ostream& out) const;
+
+	static double millisecondsBetween(Clock::time_point begin, Clock::time_point end);
+};
+
+// Times one phase of the current frame for as long as it lives, in the benchmark and as a trace zone; either may be null
+class ScopedFramePhase
+{
+public:
+	ScopedFramePhase(FrameBenchmark* benchmark, FramePhase phase, TraceProfiler* tracer = nullptr)
+		: benchmark(benchmark), phase(phase), tracer(tracer)
+	{
+		if (benchmark != nullptr)
+		{
+			benchmark->beginPhase(phase);
+		}
+		if (tracer != nullptr)
+		{
+			begin = TraceProfiler::Clock::now();
+		}
+	}
+
+	~ScopedFramePhase()
+	{
+		if (benchmark != nullptr)
+		{
+			benchmark->endPhase(phase);
+		}
+		if (tracer != nullptr)
+		{
+			tracer->addZone(FrameBenchmark::phaseName(phase), "frame", begin, TraceProfiler::Clock::now());
+		}
+	}
+
+	ScopedFramePhase(const ScopedFramePhase&) = delete;
+	ScopedFramePhase& operator=(const ScopedFramePhase&) = delete;
+
+private:
+	FrameBenchmark* benchmark;
+	FramePhase phase;
+	TraceProfiler* tracer;
+	TraceProfiler::Clock::time_point begin;
+};
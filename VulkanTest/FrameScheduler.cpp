@@ -0,0 +1,102 @@
+#include "FrameScheduler.h"
+#include <algorithm>
+#include <stdexcept>
+
+void FrameScheduler::init(VkDevice device, uint32_t framesInFlight, const VkAllocationCallbacks* hostAllocator)
+{
+	this->device = device;
+	this->hostAllocator = hostAllocator;
+	setFramesInFlight(framesInFlight);
+
+	VkSemaphoreTypeCreateInfo typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+
+	if (vkCreateSemaphore(device, &semaphoreInfo, hostAllocator, &timeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create frame timeline semaphore.");
+	}
+
+	submittedValue = 0;
+	completedValue = 0;
+	resetStatistics();
+}
+
+void FrameScheduler::destroy()
+{
+	vkDestroySemaphore(device, timeline, hostAllocator);
+	timeline = VK_NULL_HANDLE;
+}
+
+void FrameScheduler::setFramesInFlight(uint32_t count)
+{
+	depth = std::clamp(count, 1u, MAX_FRAMES_IN_FLIGHT);
+}
+
+uint32_t FrameScheduler::beginFrame()
+{
+	uint64_t frame = frameValue();
+	frames++;
+
+	// Frame n may start once frame n - depth is done, the first depth frames never wait.
+	if (frame > depth and !isComplete(frame - depth))
+	{
+		auto start = Clock::now();
+		wait(frame - depth);
+		waitMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		blockedFrames++;
+	}
+
+	return static_cast<uint32_t>(frame % depth);
+}
+
+bool FrameScheduler::isComplete(uint64_t value)
+{
+	if (value <= completedValue)
+	{
+		return true;
+	}
+
+	vkGetSemaphoreCounterValue(device, timeline, &completedValue);
+	return value <= completedValue;
+}
+
+void FrameScheduler::wait(uint64_t value)
+{
+	if (isComplete(value))
+	{
+		return;
+	}
+
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &timeline;
+	waitInfo.pValues = &value;
+
+	if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to wait for the frame timeline.");
+	}
+	completedValue = std::max(completedValue, value);
+}
+
+void FrameScheduler::resetStatistics()
+{
+	waitMs = 0.0;
+	blockedFrames = 0;
+	frames = 0;
+}
+
+void FrameScheduler::printSummary(std::ostream& out) const
+{
+	double perFrame = frames > 0 ? waitMs / frames : 0.0;
+	double blockedPercent = frames > 0 ? 100.0 * blockedFrames / frames : 0.0;
+	out << "frame pacing: " << depth << " frames in flight, CPU waited " << waitMs << " ms on the GPU over " << frames
+		<< " frames (" << perFrame << " ms/frame, " << blockedPercent << "% of frames blocked)" << std::endl;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+/*
+* Frame pacing on a single timeline semaphore.
+* Frame n (counting from 1) signals value n when its graphics work completes, and before frame n starts
+* the CPU waits for value n - framesInFlight, so at most framesInFlight frames are queued on the GPU.
+* There are no per-frame fences to wait on and reset: anything that needs to know when a frame's work
+* is done keeps the frame's value and asks isComplete() or wait().
+* Owned by the render thread, it is not thread safe.
+*/
+class FrameScheduler
+{
+public:
+	static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+	// The device must have the timelineSemaphore feature enabled
+	void init(VkDevice device, uint32_t framesInFlight, const VkAllocationCallbacks* hostAllocator = nullptr);
+	// The device must be idle
+	void destroy();
+
+	/* Change the queue depth between frames, per-frame resources are sized for MAX_FRAMES_IN_FLIGHT
+	* so nothing needs to be recreated. The device must be idle, slots are reassigned.
+	*/
+	void setFramesInFlight(uint32_t count);
+	uint32_t framesInFlight() const { return depth; }
+
+	/* Block until the next frame may be queued
+	* @return the frame's slot in [0, framesInFlight), indexing its per-frame resources
+	*/
+	uint32_t beginFrame();
+	// Value the frame being built signals, valid between beginFrame() and endFrame()
+	uint64_t frameValue() const { return submittedValue + 1; }
+	// The frame's submit went out and will signal frameValue()
+	void endFrame() { submittedValue++; }
+	uint64_t lastSubmittedValue() const { return submittedValue; }
+
+	bool isComplete(uint64_t value);
+	void wait(uint64_t value);
+
+	VkSemaphore semaphore() const { return timeline; }
+
+	// Time beginFrame() spent blocked on the GPU, since the last resetStatistics()
+	void resetStatistics();
+	double waitMilliseconds() const { return waitMs; }
+	uint64_t blockedFrameCount() const { return blockedFrames; }
+	uint64_t frameCount() const { return frames; }
+	void printSummary(std::ostream& out) const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* hostAllocator = nullptr;
+	VkSemaphore timeline = VK_NULL_HANDLE;
+	uint32_t depth = 2;
+	uint64_t submittedValue = 0;
+	uint64_t completedValue = 0;	// last value read back from the semaphore, saves a driver call per query
+
+	double waitMs = 0.0;
+	uint64_t blockedFrames = 0;
+	uint64_t frames = 0;
+};
@@ -0,0 +1,363 @@
+#include "GpuAllocator.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+	VkDeviceSize nextPowerOfTwo(VkDeviceSize value)
+	{
+		VkDeviceSize power = 1;
+		while (power < value)
+		{
+			power <<= 1;
+		}
+		return power;
+	}
+
+	uint32_t log2(VkDeviceSize powerOfTwo)
+	{
+		uint32_t exponent = 0;
+		while ((VkDeviceSize(1) << exponent) < powerOfTwo)
+		{
+			exponent++;
+		}
+		return exponent;
+	}
+}
+
+void GpuAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks* hostAllocator, VkDeviceSize blockSize)
+{
+	this->physicalDevice = physicalDevice;
+	this->hostAllocator = hostAllocator;
+	this->device = device;
+	this->blockSize = nextPowerOfTwo(std::max(blockSize, MIN_BLOCK_SIZE));
+	maxOrder = log2(this->blockSize / MIN_BLOCK_SIZE);
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	nonCoherentAtomSize = std::max<VkDeviceSize>(1, properties.limits.nonCoherentAtomSize);
+}
+
+void GpuAllocator::destroy()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Freeing the memory also unmaps it.
+	for (auto& pool : pools)
+	{
+		for (auto& block : pool.blocks)
+		{
+			if (block)
+			{
+				vkFreeMemory(device, block->memory, hostAllocator);
+			}
+		}
+	}
+	pools.clear();
+}
+
+uint32_t GpuAllocator::memoryTypeIndex(uint32_t typeFilter, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const
+{
+	// First pass wants the preferred properties too, the second one settles for the required ones.
+	for (VkMemoryPropertyFlags wanted : { required | preferred, required })
+	{
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+		{
+			if ((typeFilter & (1u << i)) and (memoryProperties.memoryTypes[i].propertyFlags & wanted) == wanted)
+			{
+				return i;
+			}
+		}
+	}
+
+	throw std::runtime_error("failed to find suitable memory type.");
+}
+
+GpuAllocation GpuAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required,
+	VkMemoryPropertyFlags preferred, bool linear)
+{
+	uint32_t typeIndex = memoryTypeIndex(requirements.memoryTypeBits, required, preferred);
+
+	// A buddy range of size 2^k sits at a multiple of 2^k, so rounding up to the alignment also aligns the offset.
+	VkDeviceSize rangeSize = nextPowerOfTwo(std::max({ requirements.size, requirements.alignment, MIN_BLOCK_SIZE }));
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	GpuAllocation allocation;
+
+	if (rangeSize > blockSize)
+	{
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = requirements.size;
+		allocInfo.memoryTypeIndex = typeIndex;
+
+		if (vkAllocateMemory(device, &allocInfo, hostAllocator, &allocation.memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate device memory.");
+		}
+
+		allocation.size = requirements.size;
+		allocation.mapped = mapIfHostVisible(allocation.memory, typeIndex, requirements.size);
+		allocation.dedicated = true;
+		dedicatedAllocations++;
+	}
+	else
+	{
+		uint32_t poolIndex = findPool(typeIndex, linear);
+		Pool& pool = pools[poolIndex];
+		uint32_t order = log2(rangeSize / MIN_BLOCK_SIZE);
+
+		VkDeviceSize offset = 0;
+		uint32_t blockIndex = 0;
+		while (blockIndex < pool.blocks.size() and !(pool.blocks[blockIndex] and allocateFromBlock(*pool.blocks[blockIndex], order, offset)))
+		{
+			blockIndex++;
+		}
+
+		if (blockIndex == pool.blocks.size())
+		{
+			blockIndex = createBlock(pool);
+			allocateFromBlock(*pool.blocks[blockIndex], order, offset);
+		}
+
+		Block& block = *pool.blocks[blockIndex];
+		block.liveAllocations++;
+
+		allocation.memory = block.memory;
+		allocation.offset = offset;
+		allocation.size = rangeSize;
+		allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+		allocation.poolIndex = poolIndex;
+		allocation.blockIndex = blockIndex;
+		allocation.order = order;
+	}
+
+	allocation.memoryTypeIndex = typeIndex;
+	liveSubAllocations++;
+	liveBytes += allocation.size;
+	return allocation;
+}
+
+void GpuAllocator::free(GpuAllocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	liveSubAllocations--;
+	liveBytes -= allocation.size;
+
+	if (allocation.dedicated)
+	{
+		vkFreeMemory(device, allocation.memory, hostAllocator);
+		dedicatedAllocations--;
+		allocation = GpuAllocation{};
+		return;
+	}
+
+	Pool& pool = pools[allocation.poolIndex];
+	Block& block = *pool.blocks[allocation.blockIndex];
+
+	// Merge with the buddy for as long as it's free too.
+	VkDeviceSize offset = allocation.offset;
+	uint32_t order = allocation.order;
+	while (order < maxOrder and block.freeLists[order].erase(offset ^ (MIN_BLOCK_SIZE << order)) > 0)
+	{
+		offset &= ~(MIN_BLOCK_SIZE << order);
+		order++;
+	}
+	block.freeLists[order].insert(offset);
+
+	// Hand empty blocks back to the driver, but keep one per pool so a create/destroy cycle doesn't thrash.
+	block.liveAllocations--;
+	if (block.liveAllocations == 0)
+	{
+		size_t liveBlocks = std::count_if(pool.blocks.begin(), pool.blocks.end(), [](const auto& b) { return b != nullptr; });
+		if (liveBlocks > 1)
+		{
+			vkFreeMemory(device, block.memory, hostAllocator);
+			pool.blocks[allocation.blockIndex].reset();
+		}
+	}
+
+	allocation = GpuAllocation{};
+}
+
+VkBuffer GpuAllocator::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, GpuAllocation& allocation)
+{
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkBuffer buffer;
+	if (vkCreateBuffer(device, &bufferInfo, hostAllocator, &buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create buffer.");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+	allocation = allocate(memRequirements, properties, 0, true);
+	vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+
+	return buffer;
+}
+
+void GpuAllocator::destroyBuffer(VkBuffer buffer, GpuAllocation& allocation)
+{
+	vkDestroyBuffer(device, buffer, hostAllocator);
+	free(allocation);
+}
+
+GpuAllocation GpuAllocator::allocateImage(VkImage image, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred)
+{
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+	GpuAllocation allocation = allocate(memRequirements, required, preferred, false);
+	vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+
+	return allocation;
+}
+
+void GpuAllocator::flush(const GpuAllocation& allocation, VkDeviceSize offset, VkDeviceSize size) const
+{
+	if (memoryProperties.memoryTypes[allocation.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+	{
+		return;
+	}
+
+	// Flushed ranges must be multiples of nonCoherentAtomSize, widen to the atoms covering [offset, offset + size).
+	VkDeviceSize begin = allocation.offset + offset;
+	VkDeviceSize end = size == VK_WHOLE_SIZE ? allocation.offset + allocation.size : begin + size;
+	begin -= begin % nonCoherentAtomSize;
+	end = (end + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+
+	VkMappedMemoryRange range{};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = allocation.memory;
+	range.offset = begin;
+	range.size = allocation.dedicated ? VK_WHOLE_SIZE : end - begin;
+	vkFlushMappedMemoryRanges(device, 1, &range);
+}
+
+uint32_t GpuAllocator::deviceAllocationCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	uint32_t count = dedicatedAllocations;
+	for (const auto& pool : pools)
+	{
+		count += static_cast<uint32_t>(std::count_if(pool.blocks.begin(), pool.blocks.end(), [](const auto& b) { return b != nullptr; }));
+	}
+	return count;
+}
+
+uint32_t GpuAllocator::subAllocationCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return liveSubAllocations;
+}
+
+VkDeviceSize GpuAllocator::bytesInUse() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return liveBytes;
+}
+
+uint32_t GpuAllocator::findPool(uint32_t memoryTypeIndex, bool linear)
+{
+	for (uint32_t i = 0; i < pools.size(); i++)
+	{
+		if (pools[i].memoryTypeIndex == memoryTypeIndex and pools[i].linear == linear)
+		{
+			return i;
+		}
+	}
+
+	Pool pool;
+	pool.memoryTypeIndex = memoryTypeIndex;
+	pool.linear = linear;
+	pools.push_back(std::move(pool));
+	return static_cast<uint32_t>(pools.size() - 1);
+}
+
+uint32_t GpuAllocator::createBlock(Pool& pool)
+{
+	auto block = std::make_unique<Block>();
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = blockSize;
+	allocInfo.memoryTypeIndex = pool.memoryTypeIndex;
+
+	if (vkAllocateMemory(device, &allocInfo, hostAllocator, &block->memory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate device memory block.");
+	}
+
+	block->mapped = mapIfHostVisible(block->memory, pool.memoryTypeIndex, blockSize);
+	block->freeLists.resize(maxOrder + 1);
+	block->freeLists[maxOrder].insert(0);
+
+	// Reuse the slot of a released block, so indices held by live allocations never move.
+	auto slot = std::find(pool.blocks.begin(), pool.blocks.end(), nullptr);
+	if (slot != pool.blocks.end())
+	{
+		*slot = std::move(block);
+		return static_cast<uint32_t>(slot - pool.blocks.begin());
+	}
+
+	pool.blocks.push_back(std::move(block));
+	return static_cast<uint32_t>(pool.blocks.size() - 1);
+}
+
+bool GpuAllocator::allocateFromBlock(Block& block, uint32_t order, VkDeviceSize& offset)
+{
+	// Smallest free range that fits, then split it down, keeping the upper halves free.
+	uint32_t available = order;
+	while (available <= maxOrder and block.freeLists[available].empty())
+	{
+		available++;
+	}
+
+	if (available > maxOrder)
+	{
+		return false;
+	}
+
+	offset = *block.freeLists[available].begin();
+	block.freeLists[available].erase(block.freeLists[available].begin());
+
+	while (available > order)
+	{
+		available--;
+		block.freeLists[available].insert(offset + (MIN_BLOCK_SIZE << available));
+	}
+
+	return true;
+}
+
+void* GpuAllocator::mapIfHostVisible(VkDeviceMemory memory, uint32_t memoryTypeIndex, VkDeviceSize size)
+{
+	if (!(memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+	{
+		return nullptr;
+	}
+
+	void* mapped = nullptr;
+	if (vkMapMemory(device, memory, 0, size, 0, &mapped) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to map device memory.");
+	}
+	return mapped;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+// A range of device memory handed out by GpuAllocator.
+struct GpuAllocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;		// size actually reserved, a power of two for sub-allocations
+	void* mapped = nullptr;		// host address of offset when the memory is host visible, else nullptr
+
+	uint32_t memoryTypeIndex = 0;
+
+	// Bookkeeping needed to give the range back
+	uint32_t poolIndex = 0;
+	uint32_t blockIndex = 0;
+	uint32_t order = 0;
+	bool dedicated = false;
+};
+
+/*
+* Device memory sub-allocator.
+* Memory is allocated from the driver in large blocks (one pool of blocks per memory type and resource kind),
+* and resources get power-of-two ranges carved out of them by a buddy allocator. This keeps the number of
+* vkAllocateMemory calls tiny compared to maxMemoryAllocationCount, and allocation is a few set operations
+* instead of a driver round trip. Requests larger than a block get a dedicated allocation.
+* Host visible blocks are mapped once when created and stay mapped.
+*/
+class GpuAllocator
+{
+public:
+	// The host allocation callbacks are used for the device memory and buffer objects, and handed on to UploadQueue
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks* hostAllocator = nullptr,
+		VkDeviceSize blockSize = 64ull << 20);
+	void destroy();
+
+	/* Reserve memory for a resource
+	* @param the resource's memory requirements
+	* @param properties the memory type must have
+	* @param properties that are nice to have (e.g. LAZILY_ALLOCATED), ignored if no suitable type has them
+	* @param true for buffers and linear images, false for optimal tiling images; they never share a block,
+	*        which keeps them bufferImageGranularity apart without having to pad every range
+	*/
+	GpuAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required,
+		VkMemoryPropertyFlags preferred, bool linear);
+	void free(GpuAllocation& allocation);
+
+	// Create a buffer and bind it to freshly allocated memory
+	VkBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, GpuAllocation& allocation);
+	void destroyBuffer(VkBuffer buffer, GpuAllocation& allocation);
+
+	// Bind an existing image to freshly allocated memory
+	GpuAllocation allocateImage(VkImage image, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0);
+
+	const VkAllocationCallbacks* hostAllocationCallbacks() const { return hostAllocator; }
+	VkMemoryPropertyFlags memoryTypeProperties(uint32_t memoryTypeIndex) const { return memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags; }
+
+	uint32_t memoryTypeIndex(uint32_t typeFilter, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const;
+
+	// Make host writes to a mapped allocation visible to the device, a no-op for host coherent memory
+	void flush(const GpuAllocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) const;
+
+	// Number of live vkAllocateMemory allocations and sub-allocations, for comparison with maxMemoryAllocationCount
+	uint32_t deviceAllocationCount() const;
+	uint32_t subAllocationCount() const;
+	VkDeviceSize bytesInUse() const;
+
+private:
+	static constexpr VkDeviceSize MIN_BLOCK_SIZE = 256;
+
+	struct Block {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		void* mapped = nullptr;
+		std::vector<std::set<VkDeviceSize>> freeLists;	// free offsets per order, order k is MIN_BLOCK_SIZE << k bytes
+		uint32_t liveAllocations = 0;
+	};
+
+	struct Pool {
+		uint32_t memoryTypeIndex = 0;
+		bool linear = true;
+		std::vector<std::unique_ptr<Block>> blocks;		// released blocks leave a null slot, so block indices stay stable
+	};
+
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* hostAllocator = nullptr;
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	VkDeviceSize nonCoherentAtomSize = 1;
+	VkDeviceSize blockSize = 0;
+	uint32_t maxOrder = 0;
+
+	mutable std::mutex mutex;
+	std::vector<Pool> pools;
+	uint32_t dedicatedAllocations = 0;
+	uint32_t liveSubAllocations = 0;
+	VkDeviceSize liveBytes = 0;
+
+	uint32_t findPool(uint32_t memoryTypeIndex, bool linear);
+	uint32_t createBlock(Pool& pool);
+	bool allocateFromBlock(Block& block, uint32_t order, VkDeviceSize& offset);
+	void* mapIfHostVisible(VkDeviceMemory memory, uint32_t memoryTypeIndex, VkDeviceSize size);
+};
@@ -0,0 +1,310 @@
+#include "HostAllocator.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+HostAllocator::HostAllocator()
+{
+	vkCallbacks.pUserData = this;
+	vkCallbacks.pfnAllocation = allocationCallback;
+	vkCallbacks.pfnReallocation = reallocationCallback;
+	vkCallbacks.pfnFree = freeCallback;
+	vkCallbacks.pfnInternalAllocation = internalAllocationCallback;
+	vkCallbacks.pfnInternalFree = internalFreeCallback;
+}
+
+HostAllocator::~HostAllocator()
+{
+	for (Arena& arena : arenas)
+	{
+		for (void* page : arena.pages)
+		{
+			std::free(page);
+		}
+	}
+}
+
+void HostAllocator::setMode(HostAllocationMode mode)
+{
+	allocationMode = mode;
+}
+
+const VkAllocationCallbacks* HostAllocator::callbacks() const
+{
+	return allocationMode == HostAllocationMode::System ? nullptr : &vkCallbacks;
+}
+
+size_t HostAllocator::headerSpace(size_t alignment)
+{
+	// The header sits in front of the pointer, which has to stay aligned.
+	return std::max(sizeof(Header), alignment);
+}
+
+HostAllocator::Header* HostAllocator::headerOf(void* memory)
+{
+	return reinterpret_cast<Header*>(static_cast<char*>(memory) - sizeof(Header));
+}
+
+uint32_t HostAllocator::sizeClassFor(size_t size, size_t alignment)
+{
+	if (alignment > PAGE_ALIGNMENT)
+	{
+		return LARGE_CLASS;
+	}
+
+	size_t needed = headerSpace(alignment) + size;
+	for (uint32_t sizeClass = 0; sizeClass < CLASS_COUNT; sizeClass++)
+	{
+		if ((size_t{ 1 } << (MIN_CLASS_SHIFT + sizeClass)) >= needed)
+		{
+			return sizeClass;
+		}
+	}
+	return LARGE_CLASS;
+}
+
+void* HostAllocator::allocateChunk(Arena& arena, uint32_t sizeClass)
+{
+	if (arena.freeLists[sizeClass] == nullptr)
+	{
+		void* page = std::malloc(PAGE_SIZE + PAGE_ALIGNMENT);
+		if (page == nullptr)
+		{
+			return nullptr;
+		}
+		arena.pages.push_back(page);
+		arena.statistics.systemAllocations++;
+
+		// Every chunk of a PAGE_ALIGNMENT aligned page is aligned to its own size (up to PAGE_ALIGNMENT).
+		uintptr_t base = (reinterpret_cast<uintptr_t>(page) + PAGE_ALIGNMENT - 1) & ~uintptr_t{ PAGE_ALIGNMENT - 1 };
+		size_t chunkSize = size_t{ 1 } << (MIN_CLASS_SHIFT + sizeClass);
+		for (size_t offset = PAGE_SIZE; offset >= chunkSize; offset -= chunkSize)
+		{
+			FreeChunk* chunk = reinterpret_cast<FreeChunk*>(base + offset - chunkSize);
+			chunk->next = arena.freeLists[sizeClass];
+			arena.freeLists[sizeClass] = chunk;
+		}
+	}
+
+	FreeChunk* chunk = arena.freeLists[sizeClass];
+	arena.freeLists[sizeClass] = chunk->next;
+	return chunk;
+}
+
+// Returns nullptr on failure, the driver turns that into VK_ERROR_OUT_OF_HOST_MEMORY.
+void* HostAllocator::allocate(size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	if (size == 0)
+	{
+		return nullptr;
+	}
+
+	// The header in front of the pointer needs its own alignment too.
+	alignment = std::max(alignment, alignof(Header));
+
+	Arena& arena = arenas[scope];
+	uint32_t sizeClass = allocationMode == HostAllocationMode::Pooled ? sizeClassFor(size, alignment) : LARGE_CLASS;
+
+	std::lock_guard<std::mutex> lock(arena.mutex);
+
+	char* block;
+	char* memory;
+	if (sizeClass != LARGE_CLASS)
+	{
+		block = static_cast<char*>(allocateChunk(arena, sizeClass));
+		if (block == nullptr)
+		{
+			return nullptr;
+		}
+		memory = block + headerSpace(alignment);
+	}
+	else
+	{
+		// malloc is only aligned for the fundamental types, pad so the pointer can be moved up to the alignment.
+		block = static_cast<char*>(std::malloc(headerSpace(alignment) + size + alignment));
+		if (block == nullptr)
+		{
+			return nullptr;
+		}
+		uintptr_t address = reinterpret_cast<uintptr_t>(block) + sizeof(Header);
+		memory = block + ((address + alignment - 1) & ~uintptr_t{ alignment - 1 }) - reinterpret_cast<uintptr_t>(block);
+		arena.statistics.systemAllocations++;
+	}
+
+	Header* header = headerOf(memory);
+	header->size = size;
+	header->offset = static_cast<uint32_t>(memory - block);
+	header->scope = static_cast<uint8_t>(scope);
+	header->sizeClass = static_cast<uint8_t>(sizeClass);
+
+	Statistics& statistics = arena.statistics;
+	statistics.allocations++;
+	statistics.liveCount++;
+	statistics.liveBytes += size;
+	statistics.peakBytes = std::max(statistics.peakBytes, statistics.liveBytes);
+	return memory;
+}
+
+void* HostAllocator::reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	if (original == nullptr)
+	{
+		return allocate(size, alignment, scope);
+	}
+	if (size == 0)
+	{
+		free(original);
+		return nullptr;
+	}
+
+	// Still fits its chunk: nothing to copy.
+	Header* header = headerOf(original);
+	if (header->sizeClass != LARGE_CLASS and header->offset + size <= (size_t{ 1 } << (MIN_CLASS_SHIFT + header->sizeClass)))
+	{
+		Arena& arena = arenas[header->scope];
+		std::lock_guard<std::mutex> lock(arena.mutex);
+
+		Statistics& statistics = arena.statistics;
+		statistics.allocations++;
+		statistics.liveBytes = statistics.liveBytes - header->size + size;
+		statistics.peakBytes = std::max(statistics.peakBytes, statistics.liveBytes);
+		header->size = size;
+		return original;
+	}
+
+	// On failure the original allocation must stay untouched.
+	void* memory = allocate(size, alignment, scope);
+	if (memory != nullptr)
+	{
+		std::memcpy(memory, original, std::min<size_t>(size, header->size));
+		free(original);
+	}
+	return memory;
+}
+
+void HostAllocator::free(void* memory)
+{
+	if (memory == nullptr)
+	{
+		return;
+	}
+
+	Header* header = headerOf(memory);
+	Arena& arena = arenas[header->scope];
+	char* block = static_cast<char*>(memory) - header->offset;
+
+	std::lock_guard<std::mutex> lock(arena.mutex);
+
+	Statistics& statistics = arena.statistics;
+	statistics.frees++;
+	statistics.liveCount--;
+	statistics.liveBytes -= header->size;
+
+	if (header->sizeClass != LARGE_CLASS)
+	{
+		FreeChunk* chunk = reinterpret_cast<FreeChunk*>(block);
+		chunk->next = arena.freeLists[header->sizeClass];
+		arena.freeLists[header->sizeClass] = chunk;
+	}
+	else
+	{
+		std::free(block);
+	}
+}
+
+HostAllocator::Statistics HostAllocator::statistics(VkSystemAllocationScope scope) const
+{
+	std::lock_guard<std::mutex> lock(arenas[scope].mutex);
+	return arenas[scope].statistics;
+}
+
+HostAllocator::Statistics HostAllocator::totals() const
+{
+	// The peak is the sum of the scope peaks, an upper bound of the real one.
+	Statistics total;
+	for (uint32_t scope = 0; scope < SCOPE_COUNT; scope++)
+	{
+		Statistics s = statistics(static_cast<VkSystemAllocationScope>(scope));
+		total.liveBytes += s.liveBytes;
+		total.liveCount += s.liveCount;
+		total.peakBytes += s.peakBytes;
+		total.allocations += s.allocations;
+		total.frees += s.frees;
+		total.systemAllocations += s.systemAllocations;
+		total.internalBytes += s.internalBytes;
+	}
+	return total;
+}
+
+void HostAllocator::printSummary(std::ostream& out) const
+{
+	if (allocationMode == HostAllocationMode::System)
+	{
+		out << "host allocations: driver default allocator, not tracked" << std::endl;
+		return;
+	}
+
+	Statistics total = totals();
+	out << "host allocations (" << (allocationMode == HostAllocationMode::Pooled ? "pooled" : "tracking") << "): "
+		<< total.allocations << " calls, " << total.systemAllocations << " reached malloc, " << total.liveCount << " live ("
+		<< total.liveBytes / 1024 << " KiB), internal " << total.internalBytes / 1024 << " KiB" << std::endl;
+
+	for (uint32_t scope = 0; scope < SCOPE_COUNT; scope++)
+	{
+		Statistics s = statistics(static_cast<VkSystemAllocationScope>(scope));
+		if (s.allocations == 0 and s.internalBytes == 0)
+		{
+			continue;
+		}
+		out << "  " << scopeName(static_cast<VkSystemAllocationScope>(scope)) << ": " << s.allocations << " calls, "
+			<< s.systemAllocations << " reached malloc, peak " << s.peakBytes / 1024 << " KiB, " << s.liveCount << " live" << std::endl;
+	}
+}
+
+const char* HostAllocator::scopeName(VkSystemAllocationScope scope)
+{
+	switch (scope)
+	{
+	case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND:
+		return "command";
+	case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT:
+		return "object";
+	case VK_SYSTEM_ALLOCATION_SCOPE_CACHE:
+		return "cache";
+	case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE:
+		return "device";
+	case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE:
+		return "instance";
+	default:
+		return "unknown";
+	}
+}
+
+void* HostAllocator::allocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	return static_cast<HostAllocator*>(userData)->allocate(size, alignment, scope);
+}
+
+void* HostAllocator::reallocationCallback(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	return static_cast<HostAllocator*>(userData)->reallocate(original, size, alignment, scope);
+}
+
+void HostAllocator::freeCallback(void* userData, void* memory)
+{
+	static_cast<HostAllocator*>(userData)->free(memory);
+}
+
+void HostAllocator::internalAllocationCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+	Arena& arena = static_cast<HostAllocator*>(userData)->arenas[scope];
+	std::lock_guard<std::mutex> lock(arena.mutex);
+	arena.statistics.internalBytes += size;
+}
+
+void HostAllocator::internalFreeCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+	Arena& arena = static_cast<HostAllocator*>(userData)->arenas[scope];
+	std::lock_guard<std::mutex> lock(arena.mutex);
+	arena.statistics.internalBytes -= size;
+}
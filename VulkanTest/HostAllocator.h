@@ -0,0 +1,103 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "AppConfig.h"
+
+/*
+* VkAllocationCallbacks for the driver's host memory.
+* Pooled mode serves small allocations from size-class free lists carved out of 64 KiB pages, with one arena
+* per VkSystemAllocationScope: the command-scoped scratch memory of every vkCreate*() call churns through its
+* own free lists and never fragments the pages long-lived objects sit in. Freed chunks are recycled, pages are
+* only returned in the destructor. Larger allocations go straight to malloc.
+* Tracking mode sends everything to malloc and only counts, system mode hands the driver nullptr.
+* Thread safe (the driver may call from any thread), each arena has its own lock.
+* Must outlive every object created with its callbacks, including the instance.
+*/
+class HostAllocator
+{
+public:
+	// Allocation activity of one scope, or of all of them
+	struct Statistics {
+		uint64_t liveBytes = 0;
+		uint64_t liveCount = 0;
+		uint64_t peakBytes = 0;
+		uint64_t allocations = 0;		// allocation and reallocation calls made by the driver
+		uint64_t frees = 0;
+		uint64_t systemAllocations = 0;	// of those, the ones that had to go to malloc (including new pages)
+		uint64_t internalBytes = 0;		// memory the driver allocated itself and only reported
+	};
+
+	HostAllocator();
+	~HostAllocator();
+
+	HostAllocator(const HostAllocator&) = delete;
+	HostAllocator& operator=(const HostAllocator&) = delete;
+
+	// Select the mode before the instance is created, objects must be destroyed with the callbacks they were created with
+	void setMode(HostAllocationMode mode);
+	HostAllocationMode mode() const { return allocationMode; }
+
+	// What to pass as pAllocator: nullptr in system mode
+	const VkAllocationCallbacks* callbacks() const;
+
+	Statistics statistics(VkSystemAllocationScope scope) const;
+	Statistics totals() const;
+	void printSummary(std::ostream& out) const;
+
+	static const char* scopeName(VkSystemAllocationScope scope);
+
+private:
+	static constexpr uint32_t SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+	static constexpr uint32_t MIN_CLASS_SHIFT = 5;		// 32 bytes
+	static constexpr uint32_t CLASS_COUNT = 8;			// 32 bytes to 4 KiB
+	static constexpr size_t PAGE_SIZE = 64 * 1024;
+	static constexpr size_t PAGE_ALIGNMENT = 4096;		// chunks are aligned to their size, up to this
+	static constexpr uint8_t LARGE_CLASS = 0xFF;
+
+	// Stored right in front of every pointer handed to the driver, pfnFree only gives us the pointer.
+	struct alignas(16) Header {
+		uint64_t size;
+		uint32_t offset;	// from the chunk (or malloc block) start to the pointer
+		uint8_t scope;
+		uint8_t sizeClass;
+	};
+
+	struct FreeChunk {
+		FreeChunk* next;
+	};
+
+	struct Arena {
+		mutable std::mutex mutex;
+		FreeChunk* freeLists[CLASS_COUNT] = {};
+		std::vector<void*> pages;		// malloc results, freed in the destructor
+		Statistics statistics;
+	};
+
+	HostAllocationMode allocationMode = HostAllocationMode::Pooled;
+	VkAllocationCallbacks vkCallbacks{};
+	Arena arenas[SCOPE_COUNT];
+
+	void* allocate(size_t size, size_t alignment, VkSystemAllocationScope scope);
+	void* reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	void free(void* memory);
+
+	void* allocateChunk(Arena& arena, uint32_t sizeClass);
+	static uint32_t sizeClassFor(size_t size, size_t alignment);
+	static size_t headerSpace(size_t alignment);
+	static Header* headerOf(void* memory);
+
+	static VKAPI_ATTR void* VKAPI_CALL allocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void* VKAPI_CALL reallocationCallback(void* userData, void* original, size_t size, size_t alignment,
+		VkSystemAllocationScope scope);
+	static VKAPI_ATTR void VKAPI_CALL freeCallback(void* userData, void* memory);
+	static VKAPI_ATTR void VKAPI_CALL internalAllocationCallback(void* userData, size_t size, VkInternalAllocationType type,
+		VkSystemAllocationScope scope);
+	static VKAPI_ATTR void VKAPI_CALL internalFreeCallback(void* userData, size_t size, VkInternalAllocationType type,
+		VkSystemAllocationScope scope);
+};
@@ -0,0 +1,202 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+namespace {
+	thread_local uint32_t threadIndexInJobSystem = 0;
+}
+
+JobSystem::JobSystem(uint32_t threadCount)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		queues.push_back(std::make_unique<WorkQueue>());
+	}
+
+	// The owning thread is index 0 and works inside parallelFor(), so only threadCount - 1 workers are started.
+	for (uint32_t i = 1; i < threadCount; i++)
+	{
+		workers.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wakeCondition.notify_all();
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+uint32_t JobSystem::threadCount() const
+{
+	return static_cast<uint32_t>(queues.size());
+}
+
+uint32_t JobSystem::currentThreadIndex()
+{
+	return threadIndexInJobSystem;
+}
+
+void JobSystem::submit(Job job)
+{
+	// Spread fire-and-forget jobs round robin, stealing evens out whatever imbalance remains.
+	push(nextQueue.fetch_add(1, std::memory_order_relaxed) % threadCount(), std::move(job));
+}
+
+void JobSystem::submitBackground(Job job)
+{
+	if (workers.empty())
+	{
+		job();
+		return;
+	}
+
+	enqueue(backgroundQueue, std::move(job));
+}
+
+bool JobSystem::runPending()
+{
+	return runOne(currentThreadIndex());
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t taskCount, const std::function<void(uint32_t, uint32_t, uint32_t)>& body)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	taskCount = std::clamp(taskCount, 1u, count);
+	if (taskCount == 1)
+	{
+		body(0, 0, count);
+		return;
+	}
+
+	std::atomic<uint32_t> remaining{ taskCount };
+	uint32_t caller = currentThreadIndex();
+
+	for (uint32_t task = 0; task < taskCount; task++)
+	{
+		uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(count) * task / taskCount);
+		uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(count) * (task + 1) / taskCount);
+
+		// Seed every thread's queue so workers start without having to steal.
+		push((caller + task) % threadCount(), [&body, &remaining, task, begin, end]() {
+			body(task, begin, end);
+			remaining.fetch_sub(1, std::memory_order_release);
+		});
+	}
+
+	// Help out until every range is done; the ranges reference this stack frame, so we can't leave early.
+	while (remaining.load(std::memory_order_acquire) > 0)
+	{
+		if (!runOne(caller))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::push(uint32_t queueIndex, Job job)
+{
+	enqueue(*queues[queueIndex], std::move(job));
+}
+
+void JobSystem::enqueue(WorkQueue& queue, Job job)
+{
+	/*
+	* Counted while the queue is still locked: whoever pops the job locks the queue after us, so its decrement
+	* can't come first and wrap the count around.
+	*/
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(std::move(job));
+		queuedJobs.fetch_add(1, std::memory_order_release);
+	}
+
+	// A worker that checked the count before the increment holds sleepMutex until it's waiting, so the notify can't be lost.
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wakeCondition.notify_one();
+}
+
+bool JobSystem::runOne(uint32_t threadIndex)
+{
+	Job job;
+
+	// Own queue first, newest job first (LIFO keeps its data warm in cache).
+	{
+		WorkQueue& own = *queues[threadIndex];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.jobs.empty())
+		{
+			job = std::move(own.jobs.back());
+			own.jobs.pop_back();
+		}
+	}
+
+	// Then steal the oldest job of another thread, which is the most likely to be large and cold for its owner.
+	for (uint32_t offset = 1; !job and offset < threadCount(); offset++)
+	{
+		WorkQueue& victim = *queues[(threadIndex + offset) % threadCount()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.jobs.empty())
+		{
+			job = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+		}
+	}
+
+	// Background work last, in submission order, and never on the owning thread.
+	if (!job and threadIndex != 0)
+	{
+		std::lock_guard<std::mutex> lock(backgroundQueue.mutex);
+		if (!backgroundQueue.jobs.empty())
+		{
+			job = std::move(backgroundQueue.jobs.front());
+			backgroundQueue.jobs.pop_front();
+		}
+	}
+
+	if (!job)
+	{
+		return false;
+	}
+
+	queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+	job();
+	return true;
+}
+
+void JobSystem::workerLoop(uint32_t threadIndex)
+{
+	threadIndexInJobSystem = threadIndex;
+
+	while (true)
+	{
+		if (runOne(threadIndex))
+		{
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wakeCondition.wait(lock, [this]() { return stopping or queuedJobs.load(std::memory_order_acquire) > 0; });
+		if (stopping and queuedJobs.load(std::memory_order_acquire) == 0)
+		{
+			return;
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+* A small work-stealing thread pool.
+* Every thread (the owning thread at index 0 plus one worker per remaining core) has its own deque:
+* the owner pushes and pops at the back, idle threads steal from the front of the others.
+* The owning thread takes part in parallelFor() instead of sleeping while the workers run.
+* Background jobs sit in a queue of their own that only the workers take from, and only when nothing else is queued.
+*/
+class JobSystem
+{
+public:
+	using Job = std::function<void()>;
+
+	// @param total number of threads including the calling one, 0 picks one per hardware thread
+	explicit JobSystem(uint32_t threadCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Number of threads that can execute jobs, including the owning thread
+	uint32_t threadCount() const;
+
+	// Index of the calling thread inside this job system, 0 for the owning thread (and for foreign threads)
+	static uint32_t currentThreadIndex();
+
+	// Queue a job without waiting for it
+	void submit(Job job);
+
+	/* Queue a long job (e.g. a pipeline compile) that must not delay the owning thread: it never runs it inside
+	* parallelFor() or runPending(). Without worker threads there is nobody else, it runs right away on the caller.
+	*/
+	void submitBackground(Job job);
+
+	// Run one queued job on the calling thread, false when every queue is empty. Lets a waiting owner help out.
+	bool runPending();
+
+	/* Split [0, count) into taskCount contiguous ranges and run them in parallel, returns when all are done
+	* @param number of items
+	* @param number of ranges, clamped to [1, count]
+	* @param called as body(task, begin, end) once per range; task is unique per range, so it can index per-task resources
+	*/
+	void parallelFor(uint32_t count, uint32_t taskCount, const std::function<void(uint32_t, uint32_t, uint32_t)>& body);
+
+private:
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::unique_ptr<WorkQueue>> queues;	// one per thread, index 0 belongs to the owning thread
+	WorkQueue backgroundQueue;
+	std::vector<std::thread> workers;
+
+	std::mutex sleepMutex;
+	std::condition_variable wakeCondition;
+	std::atomic<uint32_t> queuedJobs{ 0 };
+	std::atomic<uint32_t> nextQueue{ 0 };
+	bool stopping = false;
+
+	void workerLoop(uint32_t threadIndex);
+	void push(uint32_t queueIndex, Job job);
+	// Append a job to a queue, count it and wake a sleeping worker
+	void enqueue(WorkQueue& queue, Job job);
+
+	// Pop from the thread's own queue, steal from another one, then (workers only) take a background job. False when there was nothing to run.
+	bool runOne(uint32_t threadIndex);
+};
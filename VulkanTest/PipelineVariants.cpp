@@ -0,0 +1,212 @@
+#include "PipelineVariants.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+uint64_t PipelineVariantKey::hash() const
+{
+	// FNV-1a over the fields, not the struct bytes: the padding isn't guaranteed to be zero.
+	uint64_t hash = 14695981039346656037ull;
+	auto mix = [&hash](uint64_t value) {
+		for (uint32_t i = 0; i < 8; i++)
+		{
+			hash ^= (value >> (i * 8)) & 0xFF;
+			hash *= 1099511628211ull;
+		}
+	};
+
+	mix(cullMode);
+	mix(static_cast<uint64_t>(topology));
+	mix(blendEnable ? 1 : 0);
+	mix(shadingMode);
+	return hash;
+}
+
+uint32_t PipelineVariantKey::distance(const PipelineVariantKey& other) const
+{
+	return (cullMode != other.cullMode ? 1 : 0) + (topology != other.topology ? 1 : 0)
+		+ (blendEnable != other.blendEnable ? 1 : 0) + (shadingMode != other.shadingMode ? 1 : 0);
+}
+
+void PipelineVariantCache::init(VkDevice device, const VkAllocationCallbacks* hostAllocator)
+{
+	this->device = device;
+	this->hostAllocator = hostAllocator;
+}
+
+void PipelineVariantCache::setCompiler(Compiler compiler)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	this->compiler = std::move(compiler);
+}
+
+void PipelineVariantCache::addReady(const PipelineVariantKey& key, VkPipeline pipeline)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	Variant& variant = variants[key];
+	variant.state = State::Ready;
+	variant.pipeline = pipeline;
+	stats.ready++;
+}
+
+VkPipeline PipelineVariantCache::acquire(const PipelineVariantKey& key, JobSystem& jobSystem)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	auto found = variants.find(key);
+	if (found != variants.end() and found->second.state == State::Ready)
+	{
+		return found->second.pipeline;
+	}
+
+	bool firstRequest = found == variants.end();
+	Compiler jobCompiler;
+	uint64_t jobGeneration = generation;
+	if (firstRequest)
+	{
+		variants.emplace(key, Variant{});
+		stats.pending++;
+		pending.fetch_add(1, std::memory_order_release);
+		jobCompiler = compiler;
+	}
+
+	// Pending or failed: the nearest ready variant stands in.
+	VkPipeline fallback = VK_NULL_HANDLE;
+	uint32_t nearest = std::numeric_limits<uint32_t>::max();
+	for (const auto& [candidateKey, candidate] : variants)
+	{
+		uint32_t distance = candidateKey.distance(key);
+		if (candidate.state == State::Ready and distance < nearest)
+		{
+			fallback = candidate.pipeline;
+			nearest = distance;
+		}
+	}
+	stats.fallbackAcquires++;
+
+	// Submitted without the lock held, without worker threads the job runs right here and takes it itself.
+	lock.unlock();
+	if (firstRequest)
+	{
+		jobSystem.submitBackground([this, key, jobCompiler = std::move(jobCompiler), jobGeneration]() {
+			compile(key, jobCompiler, jobGeneration);
+		});
+	}
+	return fallback;
+}
+
+void PipelineVariantCache::compile(const PipelineVariantKey& key, const Compiler& jobCompiler, uint64_t jobGeneration)
+{
+	auto compileStart = std::chrono::steady_clock::now();
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	try
+	{
+		pipeline = jobCompiler(key);
+	}
+	catch (const std::exception& e)
+	{
+		// Nothing waits on a background compile to throw to, keep using the fallback.
+		std::cerr << "pipeline variant failed: " << e.what() << std::endl;
+	}
+	double compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (jobGeneration != generation)
+		{
+			// Released meanwhile: no frame ever drew with it, and it was built from handles that are being replaced.
+			if (pipeline != VK_NULL_HANDLE)
+			{
+				vkDestroyPipeline(device, pipeline, hostAllocator);
+			}
+			stats.discarded++;
+			stale.fetch_sub(1, std::memory_order_release);
+			pending.fetch_sub(1, std::memory_order_release);
+			return;
+		}
+
+		Variant& variant = variants[key];
+		variant.state = pipeline != VK_NULL_HANDLE ? State::Ready : State::Failed;
+		variant.pipeline = pipeline;
+
+		stats.pending--;
+		if (pipeline != VK_NULL_HANDLE)
+		{
+			stats.ready++;
+		}
+		else
+		{
+			stats.failed++;
+		}
+		stats.backgroundCompiles++;
+		stats.backgroundCompileMs += compileMs;
+		stats.maxCompileMs = std::max(stats.maxCompileMs, compileMs);
+	}
+	pending.fetch_sub(1, std::memory_order_release);
+}
+
+void PipelineVariantCache::destroy()
+{
+	waitForCompiles();
+	for (VkPipeline pipeline : release())
+	{
+		vkDestroyPipeline(device, pipeline, hostAllocator);
+	}
+}
+
+void PipelineVariantCache::waitForCompiles()
+{
+	// The compile jobs reference this object and their compiler's handles.
+	while (pending.load(std::memory_order_acquire) > 0)
+	{
+		std::this_thread::yield();
+	}
+}
+
+std::vector<VkPipeline> PipelineVariantCache::release()
+{
+	std::vector<VkPipeline> pipelines;
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const auto& [key, variant] : variants)
+	{
+		if (variant.state == State::Pending)
+		{
+			// compile() sees the new generation under this lock and discards its result.
+			stale.fetch_add(1, std::memory_order_release);
+		}
+		else if (variant.pipeline != VK_NULL_HANDLE)
+		{
+			pipelines.push_back(variant.pipeline);
+		}
+	}
+	variants.clear();
+	generation++;
+	stats.ready = 0;
+	stats.pending = 0;
+	stats.failed = 0;
+	return pipelines;
+}
+
+PipelineVariantCache::Statistics PipelineVariantCache::statistics() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void PipelineVariantCache::printSummary(std::ostream& out) const
+{
+	Statistics s = statistics();
+	out << "pipeline variants: " << s.ready << " ready, " << s.pending << " pending, " << s.failed << " failed, "
+		<< s.backgroundCompiles << " compiled in the background";
+	if (s.backgroundCompiles > 0)
+	{
+		out << " (" << s.backgroundCompileMs / s.backgroundCompiles << " ms average, " << s.maxCompileMs << " ms max)";
+	}
+	if (s.discarded > 0)
+	{
+		out << ", " << s.discarded << " discarded after a release";
+	}
+	out << ", " << s.fallbackAcquires << " frames drawn with a fallback" << std::endl;
+}
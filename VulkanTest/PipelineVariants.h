@@ -0,0 +1,115 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "JobSystem.h"
+
+/*
+* The part of the graphics pipeline state that differs between variants, everything else (shaders, vertex layout,
+* attachments, depth state) is shared. shadingMode is specialization constant 0 of the fragment shader.
+*/
+struct PipelineVariantKey {
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	bool blendEnable = false;
+	uint32_t shadingMode = 0;	// 0 vertex colors, 1 luminance, 2 half transparent, see shader.frag
+
+	uint64_t hash() const;
+	// Number of fields that differ, the nearest ready variant stands in for a pending one
+	uint32_t distance(const PipelineVariantKey& other) const;
+	bool operator==(const PipelineVariantKey& other) const { return distance(other) == 0; }
+};
+
+/*
+* Graphics pipelines keyed by a hash of their PipelineVariantKey. A variant that isn't ready yet is compiled on a
+* job system worker in the background, through the shared VkPipelineCache, and until then acquire() returns the
+* nearest variant that is: asking for a new variant never blocks the frame.
+* The first variant is compiled synchronously by the owner and handed in with addReady(), so there always is a fallback.
+* release() starts a new generation without waiting for the compiles of the old one, which discard their pipeline.
+*/
+class PipelineVariantCache
+{
+public:
+	/*
+	* Creates the pipeline of a key, called on worker threads. vkCreateGraphicsPipelines() is free threaded.
+	* A compile keeps the compiler it was queued with, so it should hold copies of the handles it builds from.
+	*/
+	using Compiler = std::function<VkPipeline(const PipelineVariantKey&)>;
+
+	struct Statistics {
+		uint32_t ready = 0;
+		uint32_t pending = 0;
+		uint32_t failed = 0;
+		uint32_t discarded = 0;				// compiles that finished after their generation was released
+		uint32_t backgroundCompiles = 0;
+		double backgroundCompileMs = 0.0;	// summed over backgroundCompiles
+		double maxCompileMs = 0.0;
+		uint64_t fallbackAcquires = 0;		// acquire() calls answered with another variant than the one asked for
+	};
+
+	void init(VkDevice device, const VkAllocationCallbacks* hostAllocator);
+	// Compiles queued from now on use this compiler, set it before the first acquire() and whenever what it builds from is replaced
+	void setCompiler(Compiler compiler);
+
+	void addReady(const PipelineVariantKey& key, VkPipeline pipeline);
+
+	/* Look up a variant, queueing its compilation the first time it's asked for
+	* @param the variant wanted
+	* @param job system whose workers compile it
+	* @return the variant if it's ready, else the ready variant nearest to it
+	*/
+	VkPipeline acquire(const PipelineVariantKey& key, JobSystem& jobSystem);
+
+	// Wait for every compile, of any generation, and destroy every variant
+	void destroy();
+	// Wait for every compile, of any generation, staleCount() is 0 afterwards. For shutdown, frames never wait on a compile.
+	void waitForCompiles();
+
+	/* Hand every ready variant over and start a new generation, for when what the pipelines were built from changes
+	* and frames in flight may still use them. Doesn't wait for the compiles still running, see staleCount().
+	* @return every ready variant's pipeline, the cache is empty afterwards
+	*/
+	std::vector<VkPipeline> release();
+
+	// Compiles of released generations still running: until it's 0 they may read the handles their compiler holds
+	uint32_t staleCount() const { return stale.load(std::memory_order_acquire); }
+	Statistics statistics() const;
+	void printSummary(std::ostream& out) const;
+
+private:
+	struct KeyHash {
+		size_t operator()(const PipelineVariantKey& key) const { return static_cast<size_t>(key.hash()); }
+	};
+
+	enum class State {
+		Pending,
+		Ready,
+		Failed,
+	};
+
+	struct Variant {
+		State state = State::Pending;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* hostAllocator = nullptr;
+	Compiler compiler;
+
+	mutable std::mutex mutex;	// guards variants, statistics, the compiler and the generation, never held while compiling
+	std::unordered_map<PipelineVariantKey, Variant, KeyHash> variants;
+	Statistics stats;
+	uint64_t generation = 0;		// bumped by release()
+	std::atomic<uint32_t> pending{ 0 };	// compiles running, of any generation
+	std::atomic<uint32_t> stale{ 0 };	// the ones of released generations
+
+	// Runs as a background job: compile, then publish the result, or discard it if its generation was released
+	void compile(const PipelineVariantKey& key, const Compiler& jobCompiler, uint64_t jobGeneration);
+};
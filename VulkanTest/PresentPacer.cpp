@@ -0,0 +1,154 @@
+#include "PresentPacer.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+void PresentPacer::init(PresentPolicy policy, uint32_t targetFps)
+{
+	this->policy = policy;
+
+	// The power saver and fixed rate profiles always limit, the others only when asked to.
+	limitFps = targetFps;
+	if (limitFps == 0 and policy == PresentPolicy::FixedFps)
+	{
+		limitFps = 60;
+	}
+	else if (limitFps == 0 and policy == PresentPolicy::PowerSaver)
+	{
+		limitFps = 30;
+	}
+
+	period = limitFps > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / limitFps)) : Clock::duration::zero();
+	nextFrame = Clock::now();
+	hasInput = false;
+	latencyMs.assign(LATENCY_SAMPLES, 0.0);
+	latencyFrames = 0;
+	sleptMs = 0.0;
+}
+
+VkPresentModeKHR PresentPacer::choosePresentMode(const std::vector<VkPresentModeKHR>& availableModes) const
+{
+	/*
+	* low-latency: IMMEDIATE never waits for vblank (tears), MAILBOX replaces the queued image instead of waiting.
+	* throughput:  MAILBOX renders as fast as possible without tearing, without it FIFO (the default never tears).
+	* power-saver: FIFO blocks on vblank, so the GPU never renders frames that aren't shown.
+	* fixed-fps:   the limiter sets the pace, MAILBOX keeps vblank from quantizing it, FIFO_RELAXED doesn't
+	*              hold a late frame for another vblank.
+	*/
+	std::vector<VkPresentModeKHR> preferred;
+	switch (policy)
+	{
+	case PresentPolicy::LowLatency:
+		preferred = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+		break;
+	case PresentPolicy::Throughput:
+		preferred = { VK_PRESENT_MODE_MAILBOX_KHR };
+		break;
+	case PresentPolicy::PowerSaver:
+		break;
+	case PresentPolicy::FixedFps:
+		preferred = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+		break;
+	}
+
+	for (VkPresentModeKHR mode : preferred)
+	{
+		if (std::find(availableModes.begin(), availableModes.end(), mode) != availableModes.end())
+		{
+			return mode;
+		}
+	}
+
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+void PresentPacer::waitForNextFrame()
+{
+	if (period == Clock::duration::zero())
+	{
+		return;
+	}
+
+	/*
+	* Sleep most of the way and spin the rest, OS sleeps overshoot by up to a scheduler tick.
+	* A frame that ran late starts the next period from now instead of rushing to catch up.
+	*/
+	auto start = Clock::now();
+	if (nextFrame > start)
+	{
+		const auto spinMargin = std::chrono::milliseconds(2);
+		if (nextFrame - start > spinMargin)
+		{
+			std::this_thread::sleep_until(nextFrame - spinMargin);
+		}
+		while (Clock::now() < nextFrame)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	auto now = Clock::now();
+	sleptMs += std::chrono::duration<double, std::milli>(now - start).count();
+	nextFrame = std::max(nextFrame, now) + period;
+}
+
+void PresentPacer::inputSampled()
+{
+	inputTime = Clock::now();
+	hasInput = true;
+}
+
+void PresentPacer::presented()
+{
+	if (!hasInput)
+	{
+		return;
+	}
+
+	latencyMs[latencyFrames % LATENCY_SAMPLES] = std::chrono::duration<double, std::milli>(Clock::now() - inputTime).count();
+	latencyFrames++;
+	hasInput = false;
+}
+
+void PresentPacer::printSummary(std::ostream& out) const
+{
+	if (latencyFrames == 0)
+	{
+		return;
+	}
+
+	// The ring is filled from the start, until it wraps only its first latencyFrames samples are set.
+	std::vector<double> sorted(latencyMs.begin(), latencyMs.begin() + std::min<uint64_t>(latencyFrames, LATENCY_SAMPLES));
+	std::sort(sorted.begin(), sorted.end());
+
+	// nearest-rank percentile
+	auto percentile = [&sorted](double p) {
+		size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+		return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+	};
+
+	out << "input to present: p50 " << percentile(50.0) << " ms, p95 " << percentile(95.0) << " ms, p99 " << percentile(99.0)
+		<< " ms, max " << sorted.back() << " ms over ";
+	if (latencyFrames > sorted.size())
+	{
+		out << "the last " << sorted.size() << " of ";
+	}
+	out << latencyFrames << " frames";
+	if (limitFps > 0)
+	{
+		out << ", limiter slept " << sleptMs / latencyFrames << " ms/frame";
+	}
+	out << std::endl;
+}
+
+const char* PresentPacer::presentModeName(VkPresentModeKHR mode)
+{
+	switch (mode)
+	{
+	case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+	case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+	case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+	default: return "unknown";
+	}
+}
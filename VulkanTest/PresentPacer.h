@@ -0,0 +1,52 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "AppConfig.h"
+
+/*
+* Applies a PresentPolicy: picks the present mode, limits the frame rate on the CPU and measures the
+* latency from input sampling (glfwPollEvents()) to the return of vkQueuePresentKHR.
+* The limiter sleeps before input is sampled rather than after the frame, so the time spent waiting
+* doesn't age the input the frame is built from.
+*/
+class PresentPacer
+{
+public:
+	void init(PresentPolicy policy, uint32_t targetFps);
+
+	// Best mode for the policy among the surface's, FIFO is always supported
+	VkPresentModeKHR choosePresentMode(const std::vector<VkPresentModeKHR>& availableModes) const;
+
+	// Sleep until the next frame is due, a no-op without a frame limit
+	void waitForNextFrame();
+	// Input for the next frame has just been sampled
+	void inputSampled();
+	// vkQueuePresentKHR returned for the frame built from the last sampled input
+	void presented();
+
+	uint32_t frameLimit() const { return limitFps; }
+	void printSummary(std::ostream& out) const;
+
+	static const char* presentModeName(VkPresentModeKHR mode);
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	PresentPolicy policy = PresentPolicy::Throughput;
+	uint32_t limitFps = 0;
+	Clock::duration period = Clock::duration::zero();
+	Clock::time_point nextFrame;
+	Clock::time_point inputTime;
+	bool hasInput = false;
+
+	// Ring of the latest latencies, allocated once by init(): a long run keeps constant memory and a recent window.
+	static constexpr uint32_t LATENCY_SAMPLES = 4096;
+	std::vector<double> latencyMs;
+	uint64_t latencyFrames = 0;		// frames measured, the next one goes to latencyFrames % LATENCY_SAMPLES
+	double sleptMs = 0.0;
+};
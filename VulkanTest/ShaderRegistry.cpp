@@ -0,0 +1,192 @@
+#include "ShaderRegistry.h"
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	/*
+	* compileShader.py writes every validated module next to its source as a comma separated list of 32 bit words,
+	* which is exactly an array initializer. They are build outputs, a build without them is an error.
+	*/
+#if !__has_include("vert.spv.inc") or !__has_include("frag.spv.inc") or !__has_include("cull.spv.inc")
+#error "missing a .spv.inc shader word list, run compileShader.py"
+#endif
+
+	alignas(16) constexpr uint32_t vertSpirv[] = {
+#include "vert.spv.inc"
+	};
+
+	alignas(16) constexpr uint32_t fragSpirv[] = {
+#include "frag.spv.inc"
+	};
+
+	alignas(16) constexpr uint32_t cullSpirv[] = {
+#include "cull.spv.inc"
+	};
+
+	bool findEmbedded(const std::string& name, const uint32_t*& code, size_t& size)
+	{
+		if (name == "vert.spv")
+		{
+			code = vertSpirv;
+			size = sizeof(vertSpirv);
+			return true;
+		}
+		if (name == "frag.spv")
+		{
+			code = fragSpirv;
+			size = sizeof(fragSpirv);
+			return true;
+		}
+		if (name == "cull.spv")
+		{
+			code = cullSpirv;
+			size = sizeof(cullSpirv);
+			return true;
+		}
+		return false;
+	}
+}
+
+ShaderBinary::~ShaderBinary()
+{
+	unmap();
+}
+
+ShaderBinary::ShaderBinary(ShaderBinary&& other) noexcept
+	: words(std::exchange(other.words, nullptr)), bytes(std::exchange(other.bytes, 0)), mapping(std::exchange(other.mapping, nullptr))
+{
+}
+
+ShaderBinary& ShaderBinary::operator=(ShaderBinary&& other) noexcept
+{
+	if (this != &other)
+	{
+		unmap();
+		words = std::exchange(other.words, nullptr);
+		bytes = std::exchange(other.bytes, 0);
+		mapping = std::exchange(other.mapping, nullptr);
+	}
+	return *this;
+}
+
+ShaderBinary ShaderBinary::embedded(const uint32_t* code, size_t size)
+{
+	ShaderBinary binary;
+	binary.words = code;
+	binary.bytes = size;
+	return binary;
+}
+
+ShaderBinary ShaderBinary::map(const std::string& path)
+{
+	ShaderBinary binary;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("failed to open shader " + path);
+	}
+
+	LARGE_INTEGER fileSize{};
+	GetFileSizeEx(file, &fileSize);
+	size_t size = static_cast<size_t>(fileSize.QuadPart);
+
+	// A mapping of an empty file is an error, the size check below reports it instead.
+	HANDLE fileMapping = size > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	void* mapping = fileMapping != nullptr ? MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	// The view keeps the file mapped after both handles are closed.
+	if (fileMapping != nullptr)
+	{
+		CloseHandle(fileMapping);
+	}
+	CloseHandle(file);
+#else
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		throw std::runtime_error("failed to open shader " + path);
+	}
+
+	struct stat status{};
+	fstat(file, &status);
+	size_t size = static_cast<size_t>(status.st_size);
+
+	void* mapping = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0) : nullptr;
+	if (mapping == MAP_FAILED)
+	{
+		mapping = nullptr;
+	}
+	// The mapping keeps the file referenced after the descriptor is closed.
+	close(file);
+#endif
+
+	binary.mapping = mapping;
+	binary.words = static_cast<const uint32_t*>(mapping);
+	binary.bytes = size;
+
+	if (size == 0 or size % sizeof(uint32_t) != 0)
+	{
+		throw std::runtime_error("shader " + path + " is not a SPIR-V module.");
+	}
+	if (mapping == nullptr)
+	{
+		throw std::runtime_error("failed to map shader " + path);
+	}
+
+	return binary;
+}
+
+void ShaderBinary::unmap()
+{
+	if (mapping == nullptr)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(mapping);
+#else
+	munmap(mapping, bytes);
+#endif
+	mapping = nullptr;
+}
+
+ShaderRegistry::ShaderRegistry(std::string overrideDirectory)
+	: overrideDirectory(std::move(overrideDirectory))
+{
+}
+
+ShaderBinary ShaderRegistry::load(const std::string& name) const
+{
+	if (!overrideDirectory.empty())
+	{
+		std::filesystem::path path = std::filesystem::path(overrideDirectory) / name;
+		if (std::filesystem::exists(path))
+		{
+			return ShaderBinary::map(path.string());
+		}
+	}
+
+	const uint32_t* code = nullptr;
+	size_t size = 0;
+	if (findEmbedded(name, code, size))
+	{
+		return ShaderBinary::embedded(code, size);
+	}
+
+	throw std::runtime_error("no embedded shader " + name);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+* SPIR-V words ready for vkCreateShaderModule: either an array compiled into the executable
+* or a read-only mapping of a .spv file. Mappings are page aligned, so unlike a std::vector<char>
+* the words can be handed to Vulkan as they are, without a copy.
+*/
+class ShaderBinary
+{
+public:
+	ShaderBinary() = default;
+	~ShaderBinary();
+
+	ShaderBinary(ShaderBinary&& other) noexcept;
+	ShaderBinary& operator=(ShaderBinary&& other) noexcept;
+	ShaderBinary(const ShaderBinary&) = delete;
+	ShaderBinary& operator=(const ShaderBinary&) = delete;
+
+	static ShaderBinary embedded(const uint32_t* code, size_t size);
+	// Throws std::runtime_error when the file can't be mapped or isn't a whole number of words
+	static ShaderBinary map(const std::string& path);
+
+	const uint32_t* code() const { return words; }
+	size_t size() const { return bytes; }	// in bytes, as VkShaderModuleCreateInfo::codeSize wants it
+	bool isMapped() const { return mapping != nullptr; }
+
+private:
+	const uint32_t* words = nullptr;
+	size_t bytes = 0;
+	void* mapping = nullptr;	// base of the file mapping, nullptr for embedded code
+
+	void unmap();
+};
+
+/*
+* Looks up shaders by their .spv name (e.g. "vert.spv").
+* Every shader is embedded at build time from the <name>.inc word list compileShader.py generates, so startup
+* does no file I/O. A file in the override directory takes precedence over the embedded copy, which allows
+* swapping shaders without a rebuild.
+*/
+class ShaderRegistry
+{
+public:
+	// @param directory searched before the embedded shaders, empty for none
+	explicit ShaderRegistry(std::string overrideDirectory = "");
+
+	// Throws std::runtime_error for a name that is neither in the override directory nor embedded
+	ShaderBinary load(const std::string& name) const;
+
+private:
+	std::string overrideDirectory;
+};
@@ -0,0 +1,149 @@
+#include "ShaderWatcher.h"
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+namespace {
+
+#ifndef __linux__
+	std::filesystem::file_time_type lastWriteTime(const std::filesystem::path& path)
+	{
+		// A file is briefly missing while some editors save, that's not an error.
+		std::error_code error;
+		auto time = std::filesystem::last_write_time(path, error);
+		return error ? std::filesystem::file_time_type::min() : time;
+	}
+#endif
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+#ifdef __linux__
+	if (descriptor >= 0)
+	{
+		close(descriptor);
+	}
+#endif
+}
+
+void ShaderWatcher::watch(const std::string& directory, const std::vector<std::string>& names)
+{
+	this->names = names;
+
+#ifdef __linux__
+	descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (descriptor < 0)
+	{
+		throw std::runtime_error("failed to create an inotify instance.");
+	}
+
+	/*
+	* The directory is watched rather than the files: editors that save to a temporary file and rename it over
+	* the original replace the inode, and a watch on the file would go with it.
+	* CLOSE_WRITE instead of MODIFY, a file written in several chunks is reported once, when it's complete.
+	*/
+	if (inotify_add_watch(descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		close(descriptor);
+		descriptor = -1;
+		throw std::runtime_error("failed to watch shader directory " + directory);
+	}
+#else
+	if (!std::filesystem::is_directory(directory))
+	{
+		throw std::runtime_error("failed to watch shader directory " + directory);
+	}
+	for (const std::string& name : names)
+	{
+		lastWriteTimes[name] = lastWriteTime(std::filesystem::path(directory) / name);
+	}
+#endif
+
+	watchedDirectory = directory;
+}
+
+std::vector<std::string> ShaderWatcher::poll()
+{
+	std::vector<std::string> changed;
+	auto report = [this, &changed](const std::string& name) {
+		if (std::find(names.begin(), names.end(), name) != names.end() and std::find(changed.begin(), changed.end(), name) == changed.end())
+		{
+			changed.push_back(name);
+		}
+	};
+
+#ifdef __linux__
+	if (descriptor < 0)
+	{
+		return changed;
+	}
+
+	// Non-blocking: read() fails with EAGAIN once every queued event has been consumed.
+	alignas(inotify_event) char buffer[4096];
+	ssize_t length;
+	while ((length = read(descriptor, buffer, sizeof(buffer))) > 0)
+	{
+		for (char* next = buffer; next < buffer + length; )
+		{
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(next);
+			if (event->len > 0)
+			{
+				report(event->name);
+			}
+			next += sizeof(inotify_event) + event->len;
+		}
+	}
+#else
+	for (auto& [name, lastTime] : lastWriteTimes)
+	{
+		auto time = lastWriteTime(std::filesystem::path(watchedDirectory) / name);
+		if (time != lastTime)
+		{
+			lastTime = time;
+			report(name);
+		}
+	}
+#endif
+
+	return changed;
+}
+
+std::string ShaderWatcher::compileGlsl(const std::string& glslc, const std::string& source, const std::string& output)
+{
+	std::string command = "\"" + glslc + "\" \"" + source + "\" -o \"" + output + "\" 2>&1";
+#ifdef _WIN32
+	// cmd.exe /c strips the first and last quote of the line, an extra pair keeps the ones around the paths.
+	command = "\"" + command + "\"";
+#endif
+
+	FILE* pipe = popen(command.c_str(), "r");
+	if (pipe == nullptr)
+	{
+		throw std::runtime_error("failed to run " + glslc);
+	}
+
+	std::string messages;
+	char buffer[256];
+	while (fgets(buffer, sizeof(buffer), pipe) != nullptr)
+	{
+		messages += buffer;
+	}
+
+	int status = pclose(pipe);
+	if (status == 0)
+	{
+		return "";
+	}
+	// The shell reports a missing glslc by its exit status, possibly without printing anything.
+	return messages.empty() ? glslc + " exited with status " + std::to_string(status) : messages;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#ifndef __linux__
+#include <filesystem>
+#include <unordered_map>
+#endif
+
+/*
+* Reports edits of shader sources during development, so they can be recompiled without restarting.
+* On Linux an inotify descriptor is read without blocking, the disk is only touched when something changed.
+* Elsewhere poll() compares modification times, a handful of stat calls per frame.
+*/
+class ShaderWatcher
+{
+public:
+	ShaderWatcher() = default;
+	~ShaderWatcher();
+
+	ShaderWatcher(const ShaderWatcher&) = delete;
+	ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+	/* Start watching
+	* @param directory of the sources
+	* @param file names inside it to report, changes to anything else are ignored
+	* Throws std::runtime_error when the directory can't be watched.
+	*/
+	void watch(const std::string& directory, const std::vector<std::string>& names);
+
+	bool isWatching() const { return !watchedDirectory.empty(); }
+	const std::string& directory() const { return watchedDirectory; }
+
+	// Names changed since the last call, each once however often it was written. Never blocks.
+	std::vector<std::string> poll();
+
+	/* Compile a GLSL source to SPIR-V by running glslc, blocks until it exits
+	* @param glslc executable, a bare name is looked up on the PATH
+	* @return empty on success, else what glslc printed (the compile errors)
+	*/
+	static std::string compileGlsl(const std::string& glslc, const std::string& source, const std::string& output);
+
+private:
+	std::string watchedDirectory;
+	std::vector<std::string> names;
+
+#ifdef __linux__
+	int descriptor = -1;
+#else
+	std::unordered_map<std::string, std::filesystem::file_time_type> lastWriteTimes;
+#endif
+};
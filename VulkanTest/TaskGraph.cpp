@@ -0,0 +1,128 @@
+#include "TaskGraph.h"
+#include <stdexcept>
+#include <thread>
+
+TaskGraph::TaskId TaskGraph::add(const char* name, std::function<void()> work, const std::vector<TaskId>& dependencies, Affinity affinity)
+{
+	TaskId id = static_cast<TaskId>(tasks.size());
+
+	auto task = std::make_unique<Task>();
+	task->name = name;
+	task->work = std::move(work);
+	task->affinity = affinity;
+	for (TaskId dependency : dependencies)
+	{
+		if (dependency >= id)
+		{
+			throw std::logic_error(std::string("task ") + name + " depends on a task added after it.");
+		}
+		tasks[dependency]->dependents.push_back(id);
+		task->dependencyCount++;
+	}
+
+	tasks.push_back(std::move(task));
+	return id;
+}
+
+void TaskGraph::run(JobSystem& jobs, bool serial)
+{
+	if (serial)
+	{
+		for (TaskId id = 0; id < tasks.size(); id++)
+		{
+			tasks[id]->work();
+		}
+		return;
+	}
+
+	unfinishedTasks.store(static_cast<uint32_t>(tasks.size()));
+	for (auto& task : tasks)
+	{
+		task->remainingDependencies.store(task->dependencyCount);
+	}
+
+	for (TaskId id = 0; id < tasks.size(); id++)
+	{
+		if (tasks[id]->dependencyCount == 0)
+		{
+			schedule(id, jobs);
+		}
+	}
+
+	// Main thread tasks first, they may be on the critical path and nobody else can run them.
+	while (unfinishedTasks.load(std::memory_order_acquire) > 0)
+	{
+		bool hasMainThreadTask = false;
+		TaskId id = 0;
+		{
+			std::lock_guard<std::mutex> lock(mainThreadMutex);
+			if (!mainThreadTasks.empty())
+			{
+				id = mainThreadTasks.front();
+				mainThreadTasks.pop_front();
+				hasMainThreadTask = true;
+			}
+		}
+
+		if (hasMainThreadTask)
+		{
+			execute(id, &jobs);
+		}
+		else if (!jobs.runPending())
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
+
+void TaskGraph::schedule(TaskId id, JobSystem& jobs)
+{
+	if (tasks[id]->affinity == Affinity::MainThread)
+	{
+		std::lock_guard<std::mutex> lock(mainThreadMutex);
+		mainThreadTasks.push_back(id);
+		return;
+	}
+
+	JobSystem* jobSystem = &jobs;
+	jobs.submit([this, id, jobSystem]() { execute(id, jobSystem); });
+}
+
+void TaskGraph::execute(TaskId id, JobSystem* jobs)
+{
+	Task& task = *tasks[id];
+
+	if (!failed.load(std::memory_order_acquire))
+	{
+		try
+		{
+			task.work();
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if (!error)
+			{
+				error = std::current_exception();
+			}
+			failed.store(true, std::memory_order_release);
+		}
+	}
+
+	// Skipped tasks still release their dependents, so run() always sees every task finish.
+	for (TaskId dependent : task.dependents)
+	{
+		if (tasks[dependent]->remainingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			schedule(dependent, *jobs);
+		}
+	}
+
+	// Last, run() may return and destroy the graph as soon as this reaches zero.
+	unfinishedTasks.fetch_sub(1, std::memory_order_acq_rel);
+}
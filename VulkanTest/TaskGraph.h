@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "JobSystem.h"
+
+/*
+* A one-shot dependency graph of tasks executed on a JobSystem.
+* A task is queued as soon as the last of its dependencies has finished. MainThread tasks (e.g. GLFW window
+* calls) are only ever run by the thread calling run(), which otherwise helps the workers with queued jobs.
+* Dependencies must be added before their dependents, so insertion order is always a valid serial order.
+*/
+class TaskGraph
+{
+public:
+	using TaskId = uint32_t;
+
+	enum class Affinity { AnyThread, MainThread };
+
+	TaskId add(const char* name, std::function<void()> work, const std::vector<TaskId>& dependencies = {},
+		Affinity affinity = Affinity::AnyThread);
+
+	/* Run every task and return once all have finished
+	* @param job system whose threads run the AnyThread tasks, the caller must be its owning thread
+	* @param true runs the tasks one after another on the calling thread, in insertion order
+	* Rethrows the first exception thrown by a task, tasks that hadn't started by then are skipped.
+	*/
+	void run(JobSystem& jobs, bool serial = false);
+
+private:
+	struct Task {
+		const char* name;
+		std::function<void()> work;
+		std::vector<TaskId> dependents;
+		uint32_t dependencyCount = 0;
+		Affinity affinity = Affinity::AnyThread;
+		std::atomic<uint32_t> remainingDependencies{ 0 };
+	};
+
+	std::vector<std::unique_ptr<Task>> tasks;
+
+	std::mutex mainThreadMutex;
+	std::deque<TaskId> mainThreadTasks;
+	std::atomic<uint32_t> unfinishedTasks{ 0 };
+
+	std::mutex errorMutex;
+	std::exception_ptr error;
+	std::atomic<bool> failed{ false };
+
+	void schedule(TaskId id, JobSystem& jobs);
+	void execute(TaskId id, JobSystem* jobs);
+};
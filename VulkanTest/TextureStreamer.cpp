@@ -0,0 +1,653 @@
+#include "TextureStreamer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+
+	VkImageMemoryBarrier imageBarrier(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout,
+		VkAccessFlags srcAccess, VkAccessFlags dstAccess, uint32_t baseLevel, uint32_t levelCount)
+	{
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, levelCount, 0, 1 };
+		return barrier;
+	}
+
+	uint32_t mipExtent(uint32_t size, uint32_t level)
+	{
+		return std::max(size >> level, 1u);
+	}
+}
+
+void TextureStreamer::init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t graphicsFamily, GpuAllocator& gpuAllocator,
+	BindlessDescriptors& bindless, DeletionQueue& deletionQueue, JobSystem& jobSystem, VkDeviceSize budget,
+	bool memoryBudgetExtension, VkDeviceSize stagingSize)
+{
+	this->physicalDevice = physicalDevice;
+	this->device = device;
+	this->hostAllocator = gpuAllocator.hostAllocationCallbacks();
+	this->gpuAllocator = &gpuAllocator;
+	this->bindless = &bindless;
+	this->deletionQueue = &deletionQueue;
+	this->jobSystem = &jobSystem;
+	this->stagingSize = stagingSize;
+	this->memoryBudgetExtension = memoryBudgetExtension;
+	configuredBudget = effectiveBudget = budget;
+	// A couple of decodes per worker keeps them busy without holding many decoded mips in memory.
+	maxDecodesInFlight = std::max(2u, jobSystem.threadCount());
+
+	// The mip chain is generated by linear blits, and sampled with linear filtering.
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, FORMAT, &formatProperties);
+	VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT
+		| VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	if ((formatProperties.optimalTilingFeatures & requiredFeatures) != requiredFeatures)
+	{
+		throw std::runtime_error("failed to find blit and linear filtering support for streamed textures.");
+	}
+
+	// The heap the allocator places device local images in, the one whose budget the textures share.
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+	heapIndex = memoryProperties.memoryTypes[gpuAllocator.memoryTypeIndex(~0u, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0)].heapIndex;
+	refreshBudget();
+
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	// Views start at the finest resident mip, the LOD is clamped to what the view holds.
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	if (vkCreateSampler(device, &samplerInfo, hostAllocator, &sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create texture sampler.");
+	}
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = graphicsFamily;
+
+	for (uint32_t i = 0; i < FrameScheduler::MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (vkCreateCommandPool(device, &poolInfo, hostAllocator, &commandPools[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create texture streaming command pool.");
+		}
+
+		VkCommandBufferAllocateInfo commandBufferAllocInfo{};
+		commandBufferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		commandBufferAllocInfo.commandPool = commandPools[i];
+		commandBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		commandBufferAllocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(device, &commandBufferAllocInfo, &commandBuffers[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate texture streaming command buffer.");
+		}
+	}
+
+	stagingBuffer = gpuAllocator.createBuffer(stagingSize * FrameScheduler::MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, stagingAllocation);
+	if (stagingAllocation.mapped == nullptr)
+	{
+		throw std::runtime_error("failed to map the texture staging buffer.");
+	}
+}
+
+void TextureStreamer::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// The jobs still running push into decoded.
+	while (decodesInFlight > 0)
+	{
+		std::this_thread::yield();
+	}
+
+	for (Texture& texture : textures)
+	{
+		if (texture.image != VK_NULL_HANDLE)
+		{
+			vkDestroyImageView(device, texture.view, hostAllocator);
+			vkDestroyImage(device, texture.image, hostAllocator);
+			gpuAllocator->free(texture.allocation);
+		}
+	}
+	for (ReplacedImage& old : replaced)
+	{
+		vkDestroyImageView(device, old.view, hostAllocator);
+		vkDestroyImage(device, old.image, hostAllocator);
+		gpuAllocator->free(old.allocation);
+	}
+	textures.clear();
+	replaced.clear();
+	decoded.clear();
+	waitingForStaging.clear();
+
+	// Destroying a pool frees its command buffer.
+	for (VkCommandPool pool : commandPools)
+	{
+		vkDestroyCommandPool(device, pool, hostAllocator);
+	}
+	gpuAllocator->destroyBuffer(stagingBuffer, stagingAllocation);
+	vkDestroySampler(device, sampler, hostAllocator);
+	device = VK_NULL_HANDLE;
+}
+
+uint32_t TextureStreamer::addTexture(uint32_t size, uint32_t seed)
+{
+	if (size == 0 or (size & (size - 1)) != 0 or VkDeviceSize(size) * size * sizeof(uint32_t) > stagingSize)
+	{
+		throw std::runtime_error("failed to add a texture of " + std::to_string(size) + " pixels, its size must be a power of two"
+			" whose mip 0 fits the " + std::to_string(stagingSize) + " bytes of staging.");
+	}
+
+	Texture texture;
+	texture.size = size;
+	texture.seed = seed;
+	while ((size >> texture.mipCount) > 0)
+	{
+		texture.mipCount++;
+	}
+	while ((size >> texture.tailLevel) > TAIL_SIZE)
+	{
+		texture.tailLevel++;
+	}
+	texture.residentLevel = texture.mipCount;
+	texture.wantedLevel = texture.tailLevel;
+
+	textures.push_back(texture);
+	usedTextures.reserve(textures.size());
+	return static_cast<uint32_t>(textures.size() - 1);
+}
+
+void TextureStreamer::use(uint32_t textureId, uint32_t level)
+{
+	Texture& texture = textures[textureId];
+	level = std::min(level, texture.mipCount - 1);
+	if (texture.lastUsedFrame != frame)
+	{
+		texture.lastUsedFrame = frame;
+		texture.wantedLevel = level;
+		usedTextures.push_back(textureId);
+	}
+	else
+	{
+		texture.wantedLevel = std::min(texture.wantedLevel, level);
+	}
+}
+
+VkCommandBuffer TextureStreamer::update(uint32_t frameSlot)
+{
+	if (device == VK_NULL_HANDLE)
+	{
+		return VK_NULL_HANDLE;
+	}
+	this->frameSlot = frameSlot;
+	stagingUsed = 0;
+	recording = VK_NULL_HANDLE;
+
+	// The driver's budget moves with what other processes allocate, there's no need to query it every frame.
+	if (frame % 32 == 1)
+	{
+		refreshBudget();
+	}
+
+	// Over the budget (it went down, or an allocation came out larger than estimated), unused textures go first.
+	while (bytesResident > effectiveBudget and evictLeastRecentlyUsed(false))
+	{
+	}
+	while (bytesResident > effectiveBudget and evictLeastRecentlyUsed(true))
+	{
+	}
+
+	// The mips left over from the last frame come first, they've waited longest.
+	{
+		std::lock_guard<std::mutex> lock(decodedMutex);
+		for (DecodedMip& mip : decoded)
+		{
+			waitingForStaging.push_back(std::move(mip));
+		}
+		decoded.clear();
+	}
+	size_t waiting = 0;
+	for (size_t i = 0; i < waitingForStaging.size(); i++)
+	{
+		DecodedMip& mip = waitingForStaging[i];
+		if (install(mip))
+		{
+			textures[mip.texture].decoding = false;
+			pendingBytes -= mip.reservedBytes;
+		}
+		else if (waiting++ != i)
+		{
+			waitingForStaging[waiting - 1] = std::move(mip);
+		}
+	}
+	waitingForStaging.erase(waitingForStaging.begin() + waiting, waitingForStaging.end());
+
+	startDecodes();
+
+	usedTextures.clear();
+	frame++;
+
+	if (recording != VK_NULL_HANDLE and vkEndCommandBuffer(recording) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record texture streaming commands.");
+	}
+	return recording;
+}
+
+void TextureStreamer::frameSubmitted()
+{
+	// The view goes before its image, the queue destroys in retirement order.
+	for (const ReplacedImage& old : replaced)
+	{
+		deletionQueue->retire(VK_OBJECT_TYPE_IMAGE_VIEW, old.view);
+		deletionQueue->retireImage(old.image, old.allocation);
+		bindless->freeTexture(old.bindlessIndex);
+	}
+	replaced.clear();
+}
+
+void TextureStreamer::refreshBudget()
+{
+	effectiveBudget = configuredBudget;
+	if (!memoryBudgetExtension)
+	{
+		return;
+	}
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT memoryBudget{};
+	memoryBudget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+	VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+	memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	memoryProperties.pNext = &memoryBudget;
+	vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memoryProperties);
+
+	/*
+	* The heap's usage includes the textures, they may grow by what's left of the process' budget. A tenth of the budget
+	* is kept for everything else (swapchain recreation, pipelines, the driver), above that the textures shrink.
+	*/
+	VkDeviceSize heapBudget = memoryBudget.heapBudget[heapIndex];
+	VkDeviceSize heapUsage = memoryBudget.heapUsage[heapIndex];
+	VkDeviceSize reserved = heapUsage + heapBudget / 10;
+	VkDeviceSize limit;
+	if (reserved <= heapBudget)
+	{
+		limit = bytesResident + (heapBudget - reserved);
+	}
+	else
+	{
+		limit = bytesResident - std::min(bytesResident, reserved - heapBudget);
+	}
+	effectiveBudget = std::min(configuredBudget, limit);
+}
+
+void TextureStreamer::startDecodes()
+{
+	// What evicting the unused textures down to their tails would free, growing a used texture may take it.
+	VkDeviceSize evictable = 0;
+	for (const Texture& texture : textures)
+	{
+		if (texture.lastUsedFrame != frame and texture.residentLevel < texture.tailLevel)
+		{
+			evictable += texture.allocation.size - std::min(texture.allocation.size, chainBytes(texture.size, texture.tailLevel));
+		}
+	}
+
+	// Coarsest next mip first: every used texture gets its tail before any gets a finer mip.
+	std::sort(usedTextures.begin(), usedTextures.end(), [this](uint32_t a, uint32_t b) {
+		const Texture& textureA = textures[a];
+		const Texture& textureB = textures[b];
+		uint32_t levelA = textureA.residentLevel == textureA.mipCount ? textureA.tailLevel : textureA.residentLevel - 1;
+		uint32_t levelB = textureB.residentLevel == textureB.mipCount ? textureB.tailLevel : textureB.residentLevel - 1;
+		return mipExtent(textureA.size, levelA) < mipExtent(textureB.size, levelB);
+	});
+
+	for (uint32_t textureId : usedTextures)
+	{
+		if (decodesInFlight >= maxDecodesInFlight)
+		{
+			break;
+		}
+
+		Texture& texture = textures[textureId];
+		if (texture.decoding or texture.residentLevel <= texture.wantedLevel)
+		{
+			continue;
+		}
+
+		bool firstLoad = texture.residentLevel == texture.mipCount;
+		uint32_t level = firstLoad ? texture.tailLevel : texture.residentLevel - 1;
+		VkDeviceSize cost = chainBytes(texture.size, level) - (firstLoad ? 0 : chainBytes(texture.size, texture.residentLevel));
+		if (bytesResident + pendingBytes + cost > effectiveBudget + evictable)
+		{
+			budgetDeferrals++;
+			continue;
+		}
+
+		texture.decoding = true;
+		pendingBytes += cost;
+		decodesInFlight++;
+		uint32_t size = texture.size;
+		uint32_t seed = texture.seed;
+		jobSystem->submitBackground([this, textureId, size, seed, level, cost]() {
+			DecodedMip mip;
+			mip.texture = textureId;
+			mip.level = level;
+			mip.reservedBytes = cost;
+			decode(size, seed, level, mip.pixels);
+			{
+				std::lock_guard<std::mutex> lock(decodedMutex);
+				decoded.push_back(std::move(mip));
+			}
+			decodesInFlight--;
+		});
+	}
+}
+
+bool TextureStreamer::install(DecodedMip& mip)
+{
+	Texture& texture = textures[mip.texture];
+	// An eviction since the decode started moved the finest resident mip, the decoded one doesn't fit on anymore.
+	uint32_t expectedLevel = texture.residentLevel == texture.mipCount ? texture.tailLevel : texture.residentLevel - 1;
+	if (mip.level != expectedLevel)
+	{
+		return true;
+	}
+	if (texture.resizedFrame == frame)
+	{
+		return false;
+	}
+
+	VkDeviceSize bytes = mip.pixels.size() * sizeof(uint32_t);
+	if (stagingUsed + bytes > stagingSize)
+	{
+		stagingDeferrals++;
+		return false;
+	}
+
+	// Make room by evicting what this frame doesn't use. Still no room: the budget went down meanwhile, drop the mip.
+	VkDeviceSize grownBytes = bytesResident - texture.allocation.size + chainBytes(texture.size, mip.level);
+	while (grownBytes > effectiveBudget and evictLeastRecentlyUsed(false, mip.texture))
+	{
+		grownBytes = bytesResident - texture.allocation.size + chainBytes(texture.size, mip.level);
+	}
+	if (grownBytes > effectiveBudget)
+	{
+		budgetDeferrals++;
+		return true;
+	}
+
+	VkDeviceSize stagingOffset = frameSlot * stagingSize + stagingUsed;
+	std::memcpy(static_cast<char*>(stagingAllocation.mapped) + stagingOffset, mip.pixels.data(), bytes);
+	gpuAllocator->flush(stagingAllocation, stagingOffset, bytes);
+	stagingUsed += bytes;
+
+	streamedMips += texture.residentLevel == texture.mipCount ? texture.mipCount - mip.level : 1;
+	uploadedBytes += bytes;
+	resize(mip.texture, mip.level, &mip, stagingOffset);
+	return true;
+}
+
+bool TextureStreamer::evictLeastRecentlyUsed(bool includeUsed, uint32_t keep)
+{
+	uint32_t victim = NO_TEXTURE;
+	for (uint32_t i = 0; i < textures.size(); i++)
+	{
+		const Texture& texture = textures[i];
+		if (i == keep or texture.residentLevel >= texture.tailLevel or texture.resizedFrame == frame
+			or (!includeUsed and texture.lastUsedFrame == frame))
+		{
+			continue;
+		}
+		if (victim == NO_TEXTURE or texture.lastUsedFrame < textures[victim].lastUsedFrame)
+		{
+			victim = i;
+		}
+	}
+
+	if (victim == NO_TEXTURE)
+	{
+		return false;
+	}
+	resize(victim, textures[victim].residentLevel + 1, nullptr, 0);
+	evictedMips++;
+	return true;
+}
+
+void TextureStreamer::resize(uint32_t textureId, uint32_t level, const DecodedMip* mip, VkDeviceSize stagingOffset)
+{
+	Texture& texture = textures[textureId];
+	bool firstLoad = texture.image == VK_NULL_HANDLE;
+	uint32_t levelCount = texture.mipCount - level;
+	uint32_t extent = mipExtent(texture.size, level);
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = FORMAT;
+	imageInfo.extent = { extent, extent, 1 };
+	imageInfo.mipLevels = levelCount;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	// A source too: the next resize copies out of it, and the first load blits within it.
+	imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkImage image;
+	if (vkCreateImage(device, &imageInfo, hostAllocator, &image) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create texture image.");
+	}
+	GpuAllocation allocation = gpuAllocator->allocateImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VkCommandBuffer commandBuffer = commands();
+
+	/*
+	* The old image was sampled by earlier frames, those reads are ordered before the copy out of it. The new one starts
+	* undefined and is written whole. Frames retire in order, so only the fragment shader reads of the old image matter.
+	*/
+	VkImageMemoryBarrier toTransfer[2] = {
+		imageBarrier(image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			0, VK_ACCESS_TRANSFER_WRITE_BIT, 0, levelCount),
+		imageBarrier(texture.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			0, VK_ACCESS_TRANSFER_READ_BIT, 0, texture.mipCount - texture.residentLevel),
+	};
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr, 0, nullptr, firstLoad ? 1 : 2, toTransfer);
+
+	// Mip k is level k - residentLevel of the old image and k - level of the new one.
+	if (!firstLoad)
+	{
+		VkImageCopy copies[32];
+		uint32_t copyCount = 0;
+		for (uint32_t k = std::max(level, texture.residentLevel); k < texture.mipCount; k++)
+		{
+			VkImageCopy& copy = copies[copyCount++];
+			copy = VkImageCopy{};
+			copy.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, k - texture.residentLevel, 0, 1 };
+			copy.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, k - level, 0, 1 };
+			copy.extent = { mipExtent(texture.size, k), mipExtent(texture.size, k), 1 };
+		}
+		vkCmdCopyImage(commandBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			copyCount, copies);
+	}
+
+	if (mip != nullptr)
+	{
+		VkBufferImageCopy region{};
+		region.bufferOffset = stagingOffset;
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageExtent = { extent, extent, 1 };
+		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+	}
+
+	// The first load only has the tail's finest mip, each coarser one is blitted from the one before.
+	uint32_t blitSources = 0;
+	if (firstLoad)
+	{
+		for (uint32_t i = 1; i < levelCount; i++)
+		{
+			VkImageMemoryBarrier toSource = imageBarrier(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, i - 1, 1);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+				0, nullptr, 0, nullptr, 1, &toSource);
+
+			int32_t sourceExtent = static_cast<int32_t>(mipExtent(extent, i - 1));
+			int32_t destinationExtent = static_cast<int32_t>(mipExtent(extent, i));
+			VkImageBlit blit{};
+			blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1 };
+			blit.srcOffsets[1] = { sourceExtent, sourceExtent, 1 };
+			blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+			blit.dstOffsets[1] = { destinationExtent, destinationExtent, 1 };
+			vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &blit, VK_FILTER_LINEAR);
+		}
+		blitSources = levelCount - 1;
+	}
+
+	// The blit sources come from TRANSFER_SRC, the rest from TRANSFER_DST.
+	VkImageMemoryBarrier toShader[2];
+	uint32_t toShaderCount = 0;
+	if (blitSources > 0)
+	{
+		toShader[toShaderCount++] = imageBarrier(image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT, 0, blitSources);
+	}
+	toShader[toShaderCount++] = imageBarrier(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, blitSources, levelCount - blitSources);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr, 0, nullptr, toShaderCount, toShader);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = FORMAT;
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 };
+
+	VkImageView view;
+	if (vkCreateImageView(device, &viewInfo, hostAllocator, &view) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create texture image view.");
+	}
+
+	if (!firstLoad)
+	{
+		replaced.push_back({ texture.image, texture.allocation, texture.view, texture.bindlessIndex });
+		bytesResident -= texture.allocation.size;
+	}
+	texture.image = image;
+	texture.allocation = allocation;
+	texture.view = view;
+	// Draws recorded from here on pick up the new index, the frames in flight keep reading the old one.
+	texture.bindlessIndex = bindless->addTexture(view, sampler);
+	texture.residentLevel = level;
+	texture.resizedFrame = frame;
+	bytesResident += allocation.size;
+}
+
+VkCommandBuffer TextureStreamer::commands()
+{
+	if (recording == VK_NULL_HANDLE)
+	{
+		// The slot's previous frame has completed, and its commands with it.
+		vkResetCommandPool(device, commandPools[frameSlot], 0);
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if (vkBeginCommandBuffer(commandBuffers[frameSlot], &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to begin recording texture streaming commands.");
+		}
+		recording = commandBuffers[frameSlot];
+	}
+	return recording;
+}
+
+void TextureStreamer::decode(uint32_t size, uint32_t seed, uint32_t level, std::vector<uint32_t>& pixels)
+{
+	/*
+	* Soft stripes times rings in a light tint picked by the seed. Nothing in the pattern is finer than a few cycles
+	* across the image, so a mip evaluated at its own resolution matches one filtered down from mip 0.
+	*/
+	const float twoPi = 6.2831853f;
+	float tint[3];
+	for (uint32_t c = 0; c < 3; c++)
+	{
+		float phase = (seed + 1) * 0.618034f * (c + 1);
+		tint[c] = 0.7f + 0.3f * (phase - std::floor(phase));
+	}
+	float angle = (seed * 2654435761u) * (twoPi / 4294967296.0f);
+	float directionU = std::cos(angle);
+	float directionV = std::sin(angle);
+
+	uint32_t extent = mipExtent(size, level);
+	pixels.resize(size_t(extent) * extent);
+	for (uint32_t y = 0; y < extent; y++)
+	{
+		float v = (y + 0.5f) / extent;
+		for (uint32_t x = 0; x < extent; x++)
+		{
+			float u = (x + 0.5f) / extent;
+			float stripes = 0.5f + 0.5f * std::sin(twoPi * 3.0f * (u * directionU + v * directionV));
+			float rings = 0.5f + 0.5f * std::cos(twoPi * 4.0f * std::hypot(u - 0.5f, v - 0.5f));
+			float value = 0.55f + 0.45f * stripes * rings;
+
+			uint32_t pixel = 0xff000000u;
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				pixel |= static_cast<uint32_t>(value * tint[c] * 255.0f + 0.5f) << (8 * c);
+			}
+			pixels[size_t(y) * extent + x] = pixel;
+		}
+	}
+}
+
+VkDeviceSize TextureStreamer::chainBytes(uint32_t size, uint32_t level)
+{
+	VkDeviceSize bytes = 0;
+	for (uint32_t extent = mipExtent(size, level); ; extent /= 2)
+	{
+		bytes += VkDeviceSize(extent) * extent * sizeof(uint32_t);
+		if (extent == 1)
+		{
+			return bytes;
+		}
+	}
+}
+
+void TextureStreamer::printSummary(std::ostream& out) const
+{
+	const double megabyte = 1024.0 * 1024.0;
+	out << "texture streaming: " << textures.size() << " textures, " << bytesResident / megabyte << " of "
+		<< effectiveBudget / megabyte << " MB budget resident" << (memoryBudgetExtension ? " (VK_EXT_memory_budget)" : "")
+		<< ", " << streamedMips << " mips streamed in (" << uploadedBytes / megabyte << " MB uploaded), " << evictedMips
+		<< " evicted, " << budgetDeferrals << " deferred by the budget, " << stagingDeferrals << " by staging space" << std::endl;
+}
@@ -0,0 +1,164 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "BindlessDescriptors.h"
+#include "DeletionQueue.h"
+#include "FrameScheduler.h"
+#include "GpuAllocator.h"
+#include "JobSystem.h"
+
+/*
+* Textures streamed in mip by mip, coarsest first, and evicted least recently used first to stay within a memory budget.
+* A texture's image only holds its resident mips, [residentLevel, mipCount). Streaming in a finer mip (or evicting the
+* finest) creates an image one level larger (or smaller), copies the resident mips over on the GPU and swaps the bindless
+* descriptor. The old image and index are retired behind the frame that replaced them, so draws never wait: a texture
+* has no index until its first mips are resident, and from then on always a complete chain down to 1x1.
+* The first load decodes the mip of the small tail (TAIL_SIZE) and generates the coarser ones with vkCmdBlitImage,
+* a texture is usable the frame after it was first asked for. Finer mips are then decoded one level at a time,
+* as long as the frames use the texture at that level and the budget has room.
+* Decoding runs on background jobs. The GPU work of a frame goes into one command buffer submitted ahead of the frame
+* on the graphics queue (blits need one), the decoded pixels through a staging region per frame in flight,
+* which also caps what a frame uploads.
+* Owned by the render thread, only the decode jobs run elsewhere.
+*/
+class TextureStreamer
+{
+public:
+	static constexpr uint32_t NO_TEXTURE = UINT32_MAX;	// bindless index of a texture without resident mips
+	static constexpr uint32_t TAIL_SIZE = 64;			// mips up to this size are loaded together, the first time
+
+	/* Create the sampler, the per-frame command buffers and the staging buffer
+	* @param bytes of device memory the textures may use; with VK_EXT_memory_budget enabled (memoryBudgetExtension)
+	*        it's lowered to what the device's budget leaves, as reported by the driver
+	* @param staging bytes per frame in flight, the largest mip 0 a texture may have
+	*/
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t graphicsFamily, GpuAllocator& gpuAllocator,
+		BindlessDescriptors& bindless, DeletionQueue& deletionQueue, JobSystem& jobSystem, VkDeviceSize budget,
+		bool memoryBudgetExtension, VkDeviceSize stagingSize = 16ull << 20);
+	// The device must be idle, waits for the decodes still running
+	void destroy();
+
+	/* Add a texture, none of its mips are resident until it's used
+	* @param width and height of mip 0, a power of two
+	* @param seed of the synthetic image
+	* @return the texture's id
+	*/
+	uint32_t addTexture(uint32_t size, uint32_t seed);
+
+	// The frame being built draws with the texture and needs its mips from level on
+	void use(uint32_t texture, uint32_t level);
+	// Element of the texture in the bindless texture array, NO_TEXTURE until its first mips are resident
+	uint32_t bindlessIndex(uint32_t texture) const { return textures[texture].bindlessIndex; }
+
+	/* Once per frame, after the frame's use() calls: evict over the budget, copy decoded mips into place and start decodes
+	* @param slot of the frame, the frame that used it before has completed
+	* @return commands to submit ahead of the frame's, VK_NULL_HANDLE when there are none
+	*/
+	VkCommandBuffer update(uint32_t frameSlot);
+	// The frame's submit went out, the images it replaced are retired behind it
+	void frameSubmitted();
+
+	uint32_t textureCount() const { return static_cast<uint32_t>(textures.size()); }
+	VkDeviceSize residentBytes() const { return bytesResident; }
+	VkDeviceSize budget() const { return effectiveBudget; }
+	void printSummary(std::ostream& out) const;
+
+private:
+	struct Texture {
+		uint32_t size = 0;
+		uint32_t seed = 0;
+		uint32_t mipCount = 0;
+		uint32_t tailLevel = 0;			// finest mip of the tail, the one the first load decodes
+		uint32_t residentLevel = 0;		// finest resident mip, mipCount when nothing is resident
+		uint32_t wantedLevel = 0;		// finest mip the last frame using the texture asked for
+		uint64_t lastUsedFrame = 0;
+		uint64_t resizedFrame = 0;		// a texture is resized at most once per frame
+		bool decoding = false;
+
+		VkImage image = VK_NULL_HANDLE;
+		GpuAllocation allocation;
+		VkImageView view = VK_NULL_HANDLE;
+		uint32_t bindlessIndex = NO_TEXTURE;
+	};
+
+	// An image a texture has outgrown (or shrunk out of), retired once the frame that replaced it has been submitted
+	struct ReplacedImage {
+		VkImage image;
+		GpuAllocation allocation;
+		VkImageView view;
+		uint32_t bindlessIndex;
+	};
+
+	struct DecodedMip {
+		uint32_t texture = 0;
+		uint32_t level = 0;
+		VkDeviceSize reservedBytes = 0;		// counted in pendingBytes while the mip is on its way
+		std::vector<uint32_t> pixels;		// RGBA8
+	};
+
+	static constexpr VkFormat FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* hostAllocator = nullptr;
+	GpuAllocator* gpuAllocator = nullptr;
+	BindlessDescriptors* bindless = nullptr;
+	DeletionQueue* deletionQueue = nullptr;
+	JobSystem* jobSystem = nullptr;
+
+	VkSampler sampler = VK_NULL_HANDLE;
+	VkCommandPool commandPools[FrameScheduler::MAX_FRAMES_IN_FLIGHT] = {};
+	VkCommandBuffer commandBuffers[FrameScheduler::MAX_FRAMES_IN_FLIGHT] = {};
+	VkCommandBuffer recording = VK_NULL_HANDLE;	// the frame's command buffer once something was recorded into it
+	uint32_t frameSlot = 0;
+
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	GpuAllocation stagingAllocation;
+	VkDeviceSize stagingSize = 0;		// per frame in flight
+	VkDeviceSize stagingUsed = 0;		// of the current frame's region
+
+	std::vector<Texture> textures;
+	std::vector<uint32_t> usedTextures;		// by the frame being built, each once
+	std::vector<ReplacedImage> replaced;	// by the frame being built
+	uint64_t frame = 1;
+
+	VkDeviceSize configuredBudget = 0;
+	VkDeviceSize effectiveBudget = 0;
+	bool memoryBudgetExtension = false;
+	uint32_t heapIndex = 0;				// the device local heap the textures live in
+	VkDeviceSize bytesResident = 0;		// allocation sizes of the textures' images
+	VkDeviceSize pendingBytes = 0;		// what the decodes in flight will add
+
+	// Filled by the decode jobs
+	std::mutex decodedMutex;
+	std::vector<DecodedMip> decoded;
+	std::atomic<uint32_t> decodesInFlight{ 0 };
+	uint32_t maxDecodesInFlight = 1;
+	std::vector<DecodedMip> waitingForStaging;	// decoded, didn't fit the last frame's staging region
+
+	uint64_t streamedMips = 0;
+	uint64_t evictedMips = 0;
+	uint64_t uploadedBytes = 0;
+	uint64_t budgetDeferrals = 0;		// decodes not started, or decoded mips dropped, for lack of budget
+	uint64_t stagingDeferrals = 0;		// decoded mips that waited a frame for staging space
+
+	// Evaluate the synthetic image at a mip's resolution, like a decoder that can produce any mip on its own
+	static void decode(uint32_t size, uint32_t seed, uint32_t level, std::vector<uint32_t>& pixels);
+	static VkDeviceSize chainBytes(uint32_t size, uint32_t level);
+
+	void refreshBudget();
+	void startDecodes();
+	// false when the mip has to wait for the next frame's staging region
+	bool install(DecodedMip& mip);
+	// Evict the finest mip of the least recently used texture that has more than its tail, false when there's none
+	bool evictLeastRecentlyUsed(bool includeUsed, uint32_t keep = NO_TEXTURE);
+	// Give the texture an image holding [level, mipCount), copying the mips it shares with the current one
+	void resize(uint32_t textureId, uint32_t level, const DecodedMip* mip, VkDeviceSize stagingOffset);
+	VkCommandBuffer commands();
+};
@@ -0,0 +1,64 @@
+#include "TraceProfiler.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+void TraceProfiler::enable()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	origin = Clock::now();
+	zones.clear();
+	threads.clear();
+	enabled = true;
+}
+
+void TraceProfiler::addZone(const char* name, const char* category, Clock::time_point begin, Clock::time_point end)
+{
+	double beginUs = std::chrono::duration<double, std::micro>(begin - origin).count();
+	double durationUs = std::chrono::duration<double, std::micro>(end - begin).count();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	zones.push_back({ name, category, threadIndex(std::this_thread::get_id()), beginUs, durationUs });
+}
+
+uint32_t TraceProfiler::threadIndex(std::thread::id id)
+{
+	// A handful of threads at most, a linear search beats hashing.
+	auto it = std::find(threads.begin(), threads.end(), id);
+	if (it != threads.end())
+	{
+		return static_cast<uint32_t>(it - threads.begin());
+	}
+
+	threads.push_back(id);
+	return static_cast<uint32_t>(threads.size() - 1);
+}
+
+void TraceProfiler::write(const std::string& path) const
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("failed to open trace file " + path);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Complete events ("ph": "X") carry their duration, so nesting is derived from the timestamps.
+	file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	file << std::fixed << std::setprecision(3);
+	for (uint32_t i = 0; i < threads.size(); i++)
+	{
+		file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << i
+			<< ", \"args\": {\"name\": \"" << (i == 0 ? "main" : "worker " + std::to_string(i)) << "\"}},\n";
+	}
+	for (size_t i = 0; i < zones.size(); i++)
+	{
+		const Zone& zone = zones[i];
+		file << "{\"name\": \"" << zone.name << "\", \"cat\": \"" << zone.category << "\", \"ph\": \"X\", \"ts\": " << zone.beginUs
+			<< ", \"dur\": " << zone.durationUs << ", \"pid\": 1, \"tid\": " << zone.thread << "}"
+			<< (i + 1 < zones.size() ? ",\n" : "\n");
+	}
+	file << "]}\n";
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+* Collects timed zones and writes them as Chrome trace_event JSON, which chrome://tracing and Perfetto open.
+* Disabled by default: a TraceZone on a disabled profiler is a single branch and never reads the clock.
+* Zones may be recorded from any thread, names and categories must outlive the profiler (string literals).
+*/
+class TraceProfiler
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// Start recording, timestamps in the trace are relative to this call
+	void enable();
+	bool isEnabled() const { return enabled; }
+
+	void addZone(const char* name, const char* category, Clock::time_point begin, Clock::time_point end);
+
+	// Throws std::runtime_error when the file can't be written
+	void write(const std::string& path) const;
+
+private:
+	struct Zone {
+		const char* name;
+		const char* category;
+		uint32_t thread;
+		double beginUs;
+		double durationUs;
+	};
+
+	bool enabled = false;
+	Clock::time_point origin;
+
+	mutable std::mutex mutex;
+	std::vector<Zone> zones;
+	std::vector<std::thread::id> threads;	// trace thread ids are indices into this, the first recording thread is 0
+
+	uint32_t threadIndex(std::thread::id id);
+};
+
+// Records the zone from construction to destruction.
+class TraceZone
+{
+public:
+	TraceZone(TraceProfiler& profiler, const char* name, const char* category = "init")
+		: profiler(profiler.isEnabled() ? &profiler : nullptr), name(name), category(category)
+	{
+		if (this->profiler != nullptr)
+		{
+			begin = TraceProfiler::Clock::now();
+		}
+	}
+
+	~TraceZone()
+	{
+		if (profiler != nullptr)
+		{
+			profiler->addZone(name, category, begin, TraceProfiler::Clock::now());
+		}
+	}
+
+	TraceZone(const TraceZone&) = delete;
+	TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+	TraceProfiler* profiler;
+	const char* name;
+	const char* category;
+	TraceProfiler::Clock::time_point begin;
+};
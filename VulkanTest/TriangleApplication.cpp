@@ -1,12 +1,89 @@
 #include "TriangleApplication.h"
+#include <cstdio>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	// Write a file and wait until its contents are on disk, not just in the OS cache
+	bool writeFileToDisk(const std::filesystem::path& path, const char* data, size_t size)
+	{
+		FILE* file = std::fopen(path.string().c_str(), "wb");
+		if (file == nullptr)
+		{
+			return false;
+		}
+
+		bool written = std::fwrite(data, 1, size, file) == size and std::fflush(file) == 0;
+#ifdef _WIN32
+		written = written and _commit(_fileno(file)) == 0;
+#else
+		written = written and fsync(fileno(file)) == 0;
+#endif
+		return std::fclose(file) == 0 and written;
+	}
+
+	// Make a rename in the directory durable, the directory entry is written separately from the file (POSIX only)
+	void syncDirectory(const std::filesystem::path& directory)
+	{
+#ifndef _WIN32
+		int descriptor = open(directory.empty() ? "." : directory.string().c_str(), O_RDONLY);
+		if (descriptor >= 0)
+		{
+			fsync(descriptor);
+			close(descriptor);
+		}
+#endif
+	}
+}
+
+TriangleApplication::TriangleApplication(const AppConfig& config)
+	: config(config), shaderRegistry(config.shaderDirectory)
+{
+	hostAllocator.setMode(config.hostAllocation);
+	if (!config.traceOutput.empty())
+	{
+		tracer.enable();
+	}
+}
 
 void TriangleApplication::run()
 {
-	initWindow();
+	runStart = std::chrono::steady_clock::now();
 	initVkn();
 
-	mainLoop();
+	if (config.recordBenchmark)
+	{
+		runRecordingBenchmark();
+	}
+	else if (config.instanceSweep)
+	{
+		runInstanceSweep();
+	}
+	else if (config.pacingSweep)
+	{
+		runPacingSweep();
+	}
+	else if (config.bindingBenchmark)
+	{
+		runBindingBenchmark();
+	}
+	else
+	{
+		mainLoop();
+	}
 	cleanUp();
+
+	if (tracer.isEnabled())
+	{
+		tracer.write(config.traceOutput);
+		std::cout << "trace written to " << config.traceOutput << std::endl;
+	}
 }
 
 VkBool32 TriangleApplication::debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -21,94 +98,442 @@ VkBool32 TriangleApplication::debugCallback(VkDebugUtilsMessageSeverityFlagBitsE
 
 void TriangleApplication::mainLoop()
 {
+	if (config.headless)
+	{
+		/*
+		* Without a window there are no events to poll and no vsync to wait for,
+		* drawFrame() is only throttled by the frame timeline, i.e. by the device itself.
+		*/
+		uint32_t frameCount = benchmark ? benchmark->totalFrames() : config.frameCount;
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < frameCount; i++)
+		{
+			drawFrame();
+		}
+		vkDeviceWaitIdle(logicalDevice);
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "rendered " << frameCount << " headless frames in " << seconds * 1000.0 << " ms ("
+			<< (seconds > 0.0 ? frameCount / seconds : 0.0) << " fps)" << std::endl;
+		printRunSummary();
+		return;
+	}
+
 	if (window == nullptr)
 	{
 		return;
 	}
 
-	while (!glfwWindowShouldClose(window))
+	while (!glfwWindowShouldClose(window) and !(benchmark and benchmark->isFinished()))
 	{
+		// Wait for the frame limit before sampling input, not after, so the input is fresh when the frame is built.
+		presentPacer.waitForNextFrame();
 		glfwPollEvents();
+		presentPacer.inputSampled();
 		drawFrame();
 	}
 
 	vkDeviceWaitIdle(logicalDevice);
+	printRunSummary();
+}
+
+void TriangleApplication::printRunSummary()
+{
+	std::cout << "command buffer cache: " << commandBufferReplays << " replays, " << commandBufferRecords << " recordings" << std::endl;
+	std::cout << "uploads: " << uploadQueue.uploadedBytes() << " bytes in " << uploadQueue.submittedBatchCount() << " batches, "
+		<< uploadQueue.stallCount() << " waits for staging space" << std::endl;
+	std::cout << "uniform ring: " << uniformRing.highWaterMark() << " of " << uniformRing.regionSize() << " bytes per frame used at most" << std::endl;
+	if (config.textureCount > 0)
+	{
+		textureStreamer.printSummary(std::cout);
+	}
+	frameScheduler.printSummary(std::cout);
+	deletionQueue.printSummary(std::cout);
+	presentPacer.printSummary(std::cout);
+	hostAllocator.printSummary(std::cout);
+	pipelineVariants.printSummary(std::cout);
+	if (shaderWatcher.isWatching())
+	{
+		std::cout << "shader reloads: " << shaderReloads << std::endl;
+	}
+	if (swapchainRecreations > 0 and config.hostAllocation != HostAllocationMode::System)
+	{
+		std::cout << "swap chain recreation: " << recreationHostAllocations.allocations / swapchainRecreations << " host allocations, "
+			<< recreationHostAllocations.systemAllocations / swapchainRecreations << " reaching malloc per recreation ("
+			<< swapchainRecreations << " recreations)" << std::endl;
+	}
+	printOverdrawSummary();
+	reportBenchmark();
 }
 
 void TriangleApplication::drawFrame()
 {
-	vkWaitForFences(logicalDevice, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
-	vkResetFences(logicalDevice, 1, &inFlightFences[currentFrame]);
+	FrameBenchmark* bench = benchmark ? &benchmark.value() : nullptr;
+	uint64_t benchFrame = bench ? bench->beginFrame() : 0;
+	TraceProfiler* trace = tracer.isEnabled() ? &tracer : nullptr;
+	TraceZone frameZone(tracer, "frame", "frame");
+
+	{
+		ScopedFramePhase phase(bench, FramePhase::WaitFrame, trace);
+		currentFrame = frameScheduler.beginFrame();
+	}
+
+	// The frame that last used this slot has completed, so its queries are available.
+	collectTimestamps(currentFrame);
+	retireCompileInputs();
+	deletionQueue.collect();
+	bindless.collect();
 
 	uint32_t imageIndex;
-	vkAcquireNextImageKHR(logicalDevice, swapchain, UINT64_MAX, imageAvaliableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	if (config.headless)
+	{
+		// The offscreen images are owned by us, so there is nothing to acquire.
+		imageIndex = offscreenImageIndex;
+		offscreenImageIndex = (offscreenImageIndex + 1) % static_cast<uint32_t>(swapChainImages.size());
+	}
+	else
+	{
+		VkResult result;
+		{
+			ScopedFramePhase phase(bench, FramePhase::Acquire, trace);
+			result = vkAcquireNextImageKHR(logicalDevice, swapchain, UINT64_MAX, imageAvaliableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+		}
+
+		/*
+		* OUT_OF_DATE: the surface changed and the swap chain can't be presented to anymore, nothing was acquired.
+		* SUBOPTIMAL: the image is still usable, so render and present it and recreate after presenting.
+		* Nothing was submitted for the frame's timeline value yet, so the next frame simply reuses it.
+		*/
+		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			recreateSwapChain();
+			if (bench)
+			{
+				bench->endFrame();
+			}
+			return;
+		}
+		else if (result != VK_SUCCESS and result != VK_SUBOPTIMAL_KHR)
+		{
+			throw std::runtime_error("failed to acquire swap chain image.");
+		}
+	}
+
+	VkCommandBuffer textureCommands;
+	{
+		ScopedFramePhase phase(bench, FramePhase::Record, trace);
+		pollShaderReload();
+		selectPipelineVariant();
+		// Before the uniforms are written, they pick up the bindless indices of the mips streamed in now.
+		textureCommands = useTextures();
+		prepareCommandBuffer(imageIndex);
+	}
+
+	{
+		ScopedFramePhase phase(bench, FramePhase::Update, trace);
+		updateInstances(imageIndex);
+	}
+
+	// Uploads queued since the last frame go out now, and this frame waits for every batch submitted so far.
+	streamUploads();
+	uploadQueue.submit();
+	UploadQueue::Handoff uploads;
+	uploadQueue.takeHandoff(uploads, frameScheduler.semaphore(), frameScheduler.frameValue());
+
+	VkSemaphore waitSemaphores[1 + UploadQueue::MAX_BATCHES];
+	VkPipelineStageFlags waitStages[1 + UploadQueue::MAX_BATCHES];
+	uint32_t waitSemaphoreCount = 0;
+	if (!config.headless)
+	{
+		// Offscreen images are owned by us, there is no acquire to wait for.
+		waitSemaphores[waitSemaphoreCount] = imageAvaliableSemaphores[currentFrame];
+		waitStages[waitSemaphoreCount] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		waitSemaphoreCount++;
+	}
+	for (uint32_t i = 0; i < uploads.waitSemaphoreCount; i++)
+	{
+		waitSemaphores[waitSemaphoreCount] = uploads.waitSemaphores[i];
+		waitStages[waitSemaphoreCount] = uploads.waitStages[i];
+		waitSemaphoreCount++;
+	}
+
+	/*
+	* Acquire barriers first, then the streamed texture mips the frame samples, then the frame.
+	* Timestamps live in their own pre-recorded command buffers so the cached frame commands stay query free.
+	*/
+	VkCommandBuffer submitCommandBuffers[4 + UploadQueue::MAX_BATCHES];
+	uint32_t submitCommandBufferCount = 0;
+	for (uint32_t i = 0; i < uploads.commandBufferCount; i++)
+	{
+		submitCommandBuffers[submitCommandBufferCount++] = uploads.commandBuffers[i];
+	}
+	if (textureCommands != VK_NULL_HANDLE)
+	{
+		submitCommandBuffers[submitCommandBufferCount++] = textureCommands;
+	}
+	if (timestampQueryPool != VK_NULL_HANDLE)
+	{
+		submitCommandBuffers[submitCommandBufferCount++] = timestampCommandBuffers[2 * currentFrame];
+	}
+	submitCommandBuffers[submitCommandBufferCount++] = commandBufferCache[imageIndex].primary;
+	if (timestampQueryPool != VK_NULL_HANDLE)
+	{
+		submitCommandBuffers[submitCommandBufferCount++] = timestampCommandBuffers[2 * currentFrame + 1];
+	}
+
+	/*
+	* The frame signals its value on the timeline, and the binary semaphore presentation waits on.
+	* Every wait is on a binary semaphore, so no wait values are needed.
+	*/
+	VkSemaphore signalSemaphores[] = { frameScheduler.semaphore(), renderFinishedSemaphores[currentFrame] };
+	uint64_t signalValues[] = { frameScheduler.frameValue(), 0 };
 
-	vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-	recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	// Headless frames are never presented, nobody waits for them but the CPU.
+	timelineInfo.signalSemaphoreValueCount = config.headless ? 1 : 2;
+	timelineInfo.pSignalSemaphoreValues = signalValues;
 
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-	VkSemaphore waitSemaphores[] = { imageAvaliableSemaphores[currentFrame] };
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = waitSemaphoreCount;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
-	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.commandBufferCount = submitCommandBufferCount;
+	submitInfo.pCommandBuffers = submitCommandBuffers;
+	submitInfo.signalSemaphoreCount = timelineInfo.signalSemaphoreValueCount;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	if (vkQueueSubmit(graphicQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
 	{
-		throw std::runtime_error("failed to submit draw command buffer.");
+		ScopedFramePhase phase(bench, FramePhase::Submit, trace);
+		if (vkQueueSubmit(graphicQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to submit draw command buffer.");
+		}
 	}
+	frameScheduler.endFrame();
+	textureStreamer.frameSubmitted();
+
+	if (!config.headless)
+	{
+		VkPresentInfoKHR presentInfo{};
+		VkSwapchainKHR swapchains[] = { swapchain };
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		presentInfo.waitSemaphoreCount = 1;
+		presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
+		presentInfo.swapchainCount = 1;
+		presentInfo.pSwapchains = swapchains;
+		presentInfo.pImageIndices = &imageIndex;
+
+		VkResult result;
+		{
+			ScopedFramePhase phase(bench, FramePhase::Present, trace);
+			result = vkQueuePresentKHR(presentationQueue, &presentInfo);
+		}
+		presentPacer.presented();
 
-	VkPresentInfoKHR presentInfo{};
-	VkSwapchainKHR swapchains[] = { swapchain };
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = swapchains;
-	presentInfo.pImageIndices = &imageIndex;
+		if (result == VK_ERROR_OUT_OF_DATE_KHR or result == VK_SUBOPTIMAL_KHR or framebufferResized)
+		{
+			framebufferResized = false;
+			recreateSwapChain();
+		}
+		else if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to present swap chain image.");
+		}
+	}
 
-	vkQueuePresentKHR(presentationQueue, &presentInfo);
+	// Headless has nothing to present, there it's the first submit.
+	if (!firstFrameReported)
+	{
+		double firstFrameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - runStart).count();
+		std::cout << "time to first present: " << firstFrameMs << " ms (init " << initMs << " ms, "
+			<< (config.serialInit ? "serial" : "parallel") << " init)" << std::endl;
+		firstFrameReported = true;
+	}
 
-	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	if (bench)
+	{
+		if (timestampQueryPool != VK_NULL_HANDLE)
+		{
+			timestampFrames[currentFrame] = benchFrame;
+		}
+		bench->endFrame();
+	}
 }
 
 void TriangleApplication::initVkn()
 {
-	createInstance();
-	setupDebugMessenger();
+	TraceZone zone(tracer, "initVkn");
+	auto initStart = std::chrono::steady_clock::now();
+
+	// GLFW has to be initialized on the main thread before the instance can ask it for the surface extensions.
+	if (!config.headless)
+	{
+		glfwInit();
+	}
+
+	// Worker threads for the init graph, then for command recording and instance updates.
+	{
+		TraceZone zone(tracer, "createJobSystem");
+		jobSystem = std::make_unique<JobSystem>(config.threadCount);
+	}
+
+	/*
+	* Instance, surface and device creation are the critical path. Once the device exists, shader loading,
+	* the pipeline cache and pipeline compilation run next to swap chain, buffer and sync object creation.
+	* The render pass only needs the format, which is picked up front, so the pipelines don't wait for the swap chain.
+	* GLFW window calls (and vkCreateSwapchainKHR through glfwGetFramebufferSize) stay on the main thread.
+	*/
+	using Affinity = TaskGraph::Affinity;
+	TaskGraph graph;
+	Affinity windowThread = config.headless ? Affinity::AnyThread : Affinity::MainThread;
+
+	auto instanceTask = graph.add("instance", [this]() {
+		createInstance();
+		setupDebugMessenger();
+	});
 	// The window surface needs to be create right after the instance, because it can influence the pyhsical device selection.
-	createSurface();
-	pickPhysicalDevice();
-	createLogicalDevice();
-	createSwapChain();
-	createImageViews();
-	createRenderPass();
-	createGraphicsPipeline();
-	createFrameBuffers();
-	createCommanPool();
-	allocateCommandBuffers();
-	createSyncObjects();
+	auto surfaceTask = instanceTask;
+	if (!config.headless)
+	{
+		auto windowTask = graph.add("window", [this]() { initWindow(); }, {}, Affinity::MainThread);
+		surfaceTask = graph.add("surface", [this]() { createSurface(); }, { instanceTask, windowTask });
+	}
+	auto deviceTask = graph.add("device", [this]() {
+		pickPhysicalDevice();
+		createLogicalDevice();
+		{
+			TraceZone zone(tracer, "gpuAllocator.init");
+			gpuAllocator.init(physicalDevice, logicalDevice, hostAllocator.callbacks());
+		}
+		chooseSwapchainFormat();
+		chooseDepthFormat();
+		chooseSampleCount();
+	}, { surfaceTask });
+
+	auto shaderTask = graph.add("shaders", [this]() { createShaderModules(); }, { deviceTask });
+	auto pipelineCacheTask = graph.add("pipelineCache", [this]() { createPipelineCache(); }, { deviceTask });
+	auto renderPassTask = graph.add("renderPass", [this]() { createRenderPass(); }, { deviceTask });
+	auto bindlessTask = graph.add("bindless", [this]() {
+		TraceZone zone(tracer, "bindless.init");
+		bindless.init(physicalDevice, logicalDevice, hostAllocator.callbacks(), frameScheduler);
+	}, { deviceTask });
+	auto uniformLayoutTask = graph.add("uniformLayout", [this]() { createUniformSetLayout(); }, { deviceTask });
+	graph.add("graphicsPipeline", [this]() { createGraphicsPipeline(); },
+		{ shaderTask, pipelineCacheTask, renderPassTask, bindlessTask, uniformLayoutTask });
+	// gpuDriven is only known once the device has been picked, so the culling tasks are always added and check it themselves.
+	auto cullPipelineTask = graph.add("cullPipeline", [this]() {
+		if (gpuDriven)
+		{
+			createCullPipeline();
+		}
+	}, { shaderTask, pipelineCacheTask });
+
+	auto swapchainTask = graph.add("swapchain", [this]() {
+		if (config.headless)
+		{
+			createOffscreenTargets();
+		}
+		else
+		{
+			presentPacer.init(config.presentPolicy, config.targetFps);
+			createSwapChain();
+
+			std::cout << "presenting with " << PresentPacer::presentModeName(swapchainPresentMode);
+			if (presentPacer.frameLimit() > 0)
+			{
+				std::cout << ", limited to " << presentPacer.frameLimit() << " fps";
+			}
+			std::cout << std::endl;
+		}
+		createImageViews();
+	}, { deviceTask }, windowThread);
+	auto colorTargetsTask = graph.add("colorTargets", [this]() {
+		createColorTargets();
+		if (!msaaImages.empty())
+		{
+			bool lazy = gpuAllocator.memoryTypeProperties(msaaImageAllocations[0].memoryTypeIndex) & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+			std::cout << "MSAA targets in " << (lazy ? "lazily allocated" : "device local") << " memory" << std::endl;
+		}
+		createDepthTargets();
+	}, { swapchainTask });
+	graph.add("frameBuffers", [this]() { createFrameBuffers(); }, { colorTargetsTask, renderPassTask });
+
+	auto commandPoolTask = graph.add("commandPool", [this]() { createCommanPool(); }, { deviceTask });
+	graph.add("uploads", [this]() {
+		createUploadQueue();
+		createMaterials();
+		createGeometryBuffers();
+	}, { deviceTask, bindlessTask });
+	graph.add("textures", [this]() { createTextures(); }, { deviceTask, bindlessTask });
+	auto instanceBufferTask = graph.add("instanceBuffer", [this]() { createInstanceBuffer(); }, { swapchainTask });
+	graph.add("uniformRing", [this]() {
+		uniformRing.init(physicalDevice, gpuAllocator);
+		createUniformRing();
+	}, { swapchainTask, uniformLayoutTask });
+	graph.add("cullingBuffers", [this]() {
+		if (gpuDriven)
+		{
+			createCullingBuffers();
+		}
+	}, { instanceBufferTask, cullPipelineTask });
+	// The per-image pools get one pool per job system thread.
+	graph.add("commandBuffers", [this]() { allocateCommandBuffers(); }, { swapchainTask });
+	graph.add("syncObjects", [this]() { createSyncObjects(); }, { deviceTask });
+	if (config.benchFrames > 0)
+	{
+		graph.add("timestampQueries", [this]() { createTimestampQueries(); }, { commandPoolTask });
+	}
+	if (config.overdrawQueries)
+	{
+		graph.add("overdrawQueries", [this]() { createOverdrawQueries(); }, { swapchainTask });
+	}
+
+	graph.run(*jobSystem, config.serialInit);
+
+	if (!config.shaderSourceDirectory.empty())
+	{
+		watchShaderSources();
+	}
+
+	if (config.benchFrames > 0)
+	{
+		benchmark.emplace(config.warmupFrames, config.benchFrames);
+	}
+
+	initMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - initStart).count();
+	std::cout << "initialized in " << initMs << " ms (" << (config.serialInit ? "serial" : "parallel") << ")";
+	if (config.hostAllocation != HostAllocationMode::System)
+	{
+		HostAllocator::Statistics hostAllocations = hostAllocator.totals();
+		std::cout << ", " << hostAllocations.allocations << " host allocations, " << hostAllocations.systemAllocations << " reached malloc";
+	}
+	std::cout << std::endl;
 }
 
 void TriangleApplication::initWindow()
 {
-	glfwInit();
+	TraceZone zone(tracer, "initWindow");
 
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 	window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+
+	/*
+	* Not every platform reports a resize through VK_ERROR_OUT_OF_DATE_KHR,
+	* so the resize callback flags it explicitly as well.
+	*/
+	glfwSetWindowUserPointer(window, this);
+	glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
 }
 
 void TriangleApplication::createInstance()
 {
+	TraceZone zone(tracer, "createInstance");
 	if (enableLayerValidation && !checkValidationLayerSupport())
 	{
 		throw std::runtime_error("Validation layer required, but not supported.");
@@ -144,11 +569,11 @@ void TriangleApplication::createInstance()
 	else
 	{
 		createInfo.enabledLayerCount = 0;
-		createInfo.ppEnabledExtensionNames = nullptr;
+		createInfo.ppEnabledLayerNames = nullptr;
 		createInfo.pNext = nullptr;
 	}
 
-	if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS)
+	if (vkCreateInstance(&createInfo, hostAllocator.callbacks(), &instance) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create vulkan instance.");
 	}
@@ -156,13 +581,14 @@ void TriangleApplication::createInstance()
 
 void TriangleApplication::createSurface()
 {
+	TraceZone zone(tracer, "createSurface");
 	/*
 	* Although the VKSurfaceKHR object and its usage is platform agonistic, its creation isn't becatuse it depends on window system details.
 	* GLFW actually has glfwCreateWindowSurface that handles the platform differences for us.
 	* If you wanna know more about what it does behine the scenes, you can read this:
 	* https://vulkan-tutorial.com/Drawing_a_triangle/Presentation/Window_surface
 	*/
-	if(glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS)
+	if(glfwCreateWindowSurface(instance, window, hostAllocator.callbacks(), &surface) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create window surface!");
 	}
@@ -170,40 +596,116 @@ void TriangleApplication::createSurface()
 
 void TriangleApplication::createLogicalDevice()
 {
+	TraceZone zone(tracer, "createLogicalDevice");
 	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
-	VkDeviceQueueCreateInfo graphicsQueueCreateInfo{};
-	graphicsQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	graphicsQueueCreateInfo.queueFamilyIndex = indices.graphicFamliy.value();
-	graphicsQueueCreateInfo.queueCount = 1;
-
-
-	VkDeviceQueueCreateInfo presentationQueueCreateInfo{};
-	presentationQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	presentationQueueCreateInfo.queueFamilyIndex = indices.presentationFamily.value();
-	presentationQueueCreateInfo.queueCount = 1;
+	// A family may only appear once in pQueueCreateInfos, and headless mode has no presentation family at all.
+	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicFamliy.value() };
+	if (indices.presentationFamily.has_value())
+	{
+		uniqueQueueFamilies.insert(indices.presentationFamily.value());
+	}
+	if (indices.transferFamily.has_value())
+	{
+		uniqueQueueFamilies.insert(indices.transferFamily.value());
+	}
 
 	/*
 	* Vulkan lets you assign priorities to queues to influence the sceduling of
 	* command buffer excution using floatging point numbers between [0, 1].
 	*/
 	float queuePriority = 1.0f;
-	graphicsQueueCreateInfo.pQueuePriorities = &queuePriority;
-	presentationQueueCreateInfo.pQueuePriorities = &queuePriority;
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	queueCreateInfos.push_back(graphicsQueueCreateInfo);
-	queueCreateInfos.push_back(presentationQueueCreateInfo);
+	for (uint32_t queueFamily : uniqueQueueFamilies)
+	{
+		VkDeviceQueueCreateInfo queueCreateInfo{};
+		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queueCreateInfo.queueFamilyIndex = queueFamily;
+		queueCreateInfo.queueCount = 1;
+		queueCreateInfo.pQueuePriorities = &queuePriority;
+		queueCreateInfos.push_back(queueCreateInfo);
+	}
+
+	std::vector<const char*> deviceExtensions = getRequiredDeviceExtensions();
 
 	VkPhysicalDeviceFeatures deviceFeatures{};
+	VkPhysicalDeviceVulkan12Features vulkan12Features{};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	// Frame pacing runs on a timeline semaphore, isDeviceSuitable() only accepts devices that have them.
+	vulkan12Features.timelineSemaphore = VK_TRUE;
+	// The bindless descriptor set (BindlessDescriptors), isDeviceSuitable() checks for these as well.
+	vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+	vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+	vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+
+	if (config.gpuDriven)
+	{
+		// A dispatch and a single indirect draw with firstInstance 0, which every device can do.
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+		gpuDriven = true;
+		maxComputeGroups = properties.limits.maxComputeWorkGroupCount[0];
+		std::cout << "GPU-driven culling into a single vkCmdDrawIndexedIndirect" << std::endl;
+	}
+
+	/*
+	* Both are core in 1.3, as extensions they also work on 1.2 drivers. Dynamic rendering depends on
+	* VK_KHR_depth_stencil_resolve and VK_KHR_create_renderpass2, which are core in 1.2.
+	*/
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+	dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+	VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features{};
+	synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+	synchronization2Features.pNext = &dynamicRenderingFeatures;
+
+	if (config.dynamicRendering and hasDeviceExtension(physicalDevice, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)
+		and hasDeviceExtension(physicalDevice, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceFeatures2 supportedFeatures{};
+		supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supportedFeatures.pNext = &synchronization2Features;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+
+		dynamicRendering = dynamicRenderingFeatures.dynamicRendering and synchronization2Features.synchronization2;
+	}
+
+	// The queried structs now say VK_TRUE for both features, which is exactly what gets enabled.
+	if (dynamicRendering)
+	{
+		deviceExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+		deviceExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+		vulkan12Features.pNext = &synchronization2Features;
+	}
+	std::cout << "rendering with " << (dynamicRendering ? "VK_KHR_dynamic_rendering" : "render pass and framebuffer objects") << std::endl;
+
+	// The texture streamer sizes its budget by what the driver reports as left, when it can.
+	if (config.textureCount > 0 and hasDeviceExtension(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+	{
+		deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		memoryBudgetSupported = true;
+	}
+
+	if (config.overdrawQueries)
+	{
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+		deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+		pipelineStatisticsEnabled = supportedFeatures.pipelineStatisticsQuery;
+	}
+
 	VkDeviceCreateInfo createInfo{};
 
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.pEnabledFeatures = &deviceFeatures;
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExensions.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	createInfo.pNext = &vulkan12Features;
 
 	if (enableLayerValidation)
 	{
@@ -215,20 +717,38 @@ void TriangleApplication::createLogicalDevice()
 		createInfo.enabledLayerCount = 0;
 	}
 
-	if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &logicalDevice) != VK_SUCCESS)
+	if (vkCreateDevice(physicalDevice, &createInfo, hostAllocator.callbacks(), &logicalDevice) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create a logical device.");
 	}
 
+	// Extension commands aren't exported by the loader.
+	if (dynamicRendering)
+	{
+		cmdBeginRendering = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(vkGetDeviceProcAddr(logicalDevice, "vkCmdBeginRenderingKHR"));
+		cmdEndRendering = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(vkGetDeviceProcAddr(logicalDevice, "vkCmdEndRenderingKHR"));
+		cmdPipelineBarrier2 = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(vkGetDeviceProcAddr(logicalDevice, "vkCmdPipelineBarrier2KHR"));
+	}
+
 	vkGetDeviceQueue(logicalDevice, indices.graphicFamliy.value(), 0, &graphicQueue);
-	vkGetDeviceQueue(logicalDevice, indices.presentationFamily.value(), 0, &presentationQueue);
+	if (indices.presentationFamily.has_value())
+	{
+		vkGetDeviceQueue(logicalDevice, indices.presentationFamily.value(), 0, &presentationQueue);
+	}
+
+	// Without a dedicated transfer family uploads share the graphics queue.
+	transferQueue = graphicQueue;
+	if (indices.transferFamily.has_value())
+	{
+		vkGetDeviceQueue(logicalDevice, indices.transferFamily.value(), 0, &transferQueue);
+	}
 }
 
 void TriangleApplication::createSwapChain()
 {
+	TraceZone zone(tracer, "createSwapChain");
 	SwapChainSupportDetails swapChainSupport = querySwapchainSupport(physicalDevice);
 
-	VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
 	VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentMode);
 	VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
@@ -244,8 +764,9 @@ void TriangleApplication::createSwapChain()
 	createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
 	createInfo.surface = surface;
 	createInfo.minImageCount = imgCount;
-	createInfo.imageFormat = surfaceFormat.format;
-	createInfo.imageColorSpace = surfaceFormat.colorSpace;
+	// Picked by chooseSwapchainFormat() and never written here: during init the render pass is created from it concurrently.
+	createInfo.imageFormat = swapchainFormat;
+	createInfo.imageColorSpace = swapchainColorSpace;
 	createInfo.imageExtent = extent;
 	createInfo.imageArrayLayers = 1;								// specifies the amount of layers each image consist of, always 1.			
 	createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;	// specifies what kind of opeartions we'll use the image in wht swap chain.
@@ -278,9 +799,10 @@ void TriangleApplication::createSwapChain()
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;	// specifies if th alpha channel should be used for blending with other windows in the window system. For now we just ignore the alpha channel.
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE;
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	// Handing over the current swap chain lets the driver reuse its resources and keep presenting the images it still owns.
+	createInfo.oldSwapchain = swapchain;
 
-	if (vkCreateSwapchainKHR(logicalDevice, &createInfo, nullptr, &swapchain) != VK_SUCCESS)
+	if (vkCreateSwapchainKHR(logicalDevice, &createInfo, hostAllocator.callbacks(), &swapchain) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create swap chain.");
 	}
@@ -289,113 +811,557 @@ void TriangleApplication::createSwapChain()
 	swapChainImages.resize(imgCount);
 	vkGetSwapchainImagesKHR(logicalDevice, swapchain, &imgCount, swapChainImages.data());
 
-	swapchainFormat = surfaceFormat.format;
 	swapchainExtent = extent;
+	swapchainPresentMode = presentMode;
 }
 
-void TriangleApplication::createImageViews()
+void TriangleApplication::framebufferResizeCallback(GLFWwindow* window, int width, int height)
 {
-	swapchainImageViews.resize(swapChainImages.size());
-	for (size_t i = 0; i < swapChainImages.size(); i++)
-	{
-		VkImageViewCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		createInfo.image = swapChainImages[i];
-		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		createInfo.format = swapchainFormat;
-		
-		createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-		createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-		createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-		createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-
-		createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		createInfo.subresourceRange.baseMipLevel = 0;
-		createInfo.subresourceRange.levelCount = 1;
-		createInfo.subresourceRange.baseArrayLayer = 0;
-		createInfo.subresourceRange.layerCount = 1;
-
-		if (vkCreateImageView(logicalDevice, &createInfo, nullptr, &swapchainImageViews[i]) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to create image view.");
-		}
-	}
+	auto app = reinterpret_cast<TriangleApplication*>(glfwGetWindowUserPointer(window));
+	app->framebufferResized = true;
 }
 
-void TriangleApplication::createRenderPass()
+void TriangleApplication::recreateSwapChain()
 {
-	VkAttachmentDescription colorAttachment{};
-	colorAttachment.format = swapchainFormat;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT; // 1 sample, no anti-aliaing
+	// A minimized window has a zero sized framebuffer, which is not a valid swap chain extent. Wait until it's visible again.
+	int width = 0, height = 0;
+	glfwGetFramebufferSize(window, &width, &height);
+	while (width == 0 || height == 0)
+	{
+		glfwGetFramebufferSize(window, &width, &height);
+		glfwWaitEvents();
+	}
 
 	/*
-	* loadOp and storeOp determin what to do with the data in the attachment before rendering and after rendering
-	* VK_ATTACHMENT_LOAD_OP_LOAD : Preserve the existing contents
-	* VK_ATTACHMENT_LOAP_OP_CLEAR : Clear the values to constant at the start.
-	* VK_ATTACHMENT_LOAD_OP_DONT_CARE : Existing contents are undefined; we don't care about them.
-	* VK_ATTACHMENT_STORE_OP_STORE : Render contents will be stored in memeory and can be read later.
-	* VK_ATTACHMENT_STORE_OP_DONT_CARE : Contents of the framebuffer will be undefined after the rendering operation
+	* No vkDeviceWaitIdle here: frames in flight keep rendering into and presenting the old images.
+	* The old swap chain, its image views and framebuffers go to the deletion queue, which destroys them
+	* from drawFrame() once every frame submitted so far has completed.
 	*/
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; // we want to see the rendered triangle, so we choose the store operation here.
-	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-	VkAttachmentReference colorAttachmentRef{};
-	colorAttachmentRef.attachment = 0;
-	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	HostAllocator::Statistics hostAllocationsBefore = hostAllocator.totals();
 
-	VkSubpassDescription subpass{};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorAttachmentRef;
+	// The overdraw queries belong to the images, read what's still in flight first. It's a diagnostic mode, the stall doesn't matter.
+	if (overdrawQueryPool != VK_NULL_HANDLE)
+	{
+		frameScheduler.wait(frameScheduler.lastSubmittedValue());
+		for (uint32_t i = 0; i < overdrawPending.size(); i++)
+		{
+			collectOverdraw(i);
+		}
+	}
 
-	VkSubpassDependency dependency{};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	// Retired in the order they are destroyed: views before their images, image views before the swap chain.
+	for (VkFramebuffer frameBuffer : swapchainFrameBuffers)
+	{
+		deletionQueue.retire(VK_OBJECT_TYPE_FRAMEBUFFER, frameBuffer);
+	}
+	for (const auto* views : { &swapchainImageViews, &msaaImageViews, &depthImageViews })
+	{
+		for (VkImageView view : *views)
+		{
+			deletionQueue.retire(VK_OBJECT_TYPE_IMAGE_VIEW, view);
+		}
+	}
+	for (size_t i = 0; i < msaaImages.size(); i++)
+	{
+		deletionQueue.retireImage(msaaImages[i], msaaImageAllocations[i]);
+	}
+	for (size_t i = 0; i < depthImages.size(); i++)
+	{
+		deletionQueue.retireImage(depthImages[i], depthImageAllocations[i]);
+	}
+	deletionQueue.retire(VK_OBJECT_TYPE_SWAPCHAIN_KHR, swapchain);
+	for (const auto& cached : commandBufferCache)
+	{
+		deletionQueue.retire(VK_OBJECT_TYPE_COMMAND_POOL, cached.primaryPool);
+		for (VkCommandPool pool : cached.taskPools)
+		{
+			deletionQueue.retire(VK_OBJECT_TYPE_COMMAND_POOL, pool);
+		}
+	}
+	swapchainFrameBuffers.clear();
+	swapchainImageViews.clear();
+	msaaImageViews.clear();
+	depthImageViews.clear();
+	msaaImages.clear();
+	msaaImageAllocations.clear();
+	depthImages.clear();
+	depthImageAllocations.clear();
+
+	// The surface may prefer another format now, e.g. after the window moved to another display.
+	VkFormat previousFormat = swapchainFormat;
+	chooseSwapchainFormat();
+	createSwapChain();
+
+	// Every image has its own instance region, more images need a bigger buffer.
+	if (swapChainImages.size() > instanceRegionCount)
+	{
+		deletionQueue.retireBuffer(instanceBuffer, instanceAllocation);
+		createInstanceBuffer();
+
+		if (gpuDriven)
+		{
+			deletionQueue.retireBuffer(sceneInstanceBuffer, sceneInstanceAllocation);
+			deletionQueue.retireBuffer(indirectBuffer, indirectAllocation);
+			deletionQueue.retireBuffer(cullFrameBuffer, cullFrameAllocation);
+			deletionQueue.retire(VK_OBJECT_TYPE_DESCRIPTOR_POOL, cullDescriptorPool);
+			createCullingBuffers();
+		}
+	}
+
+	// The uniform ring has a region per image too. Its descriptor set points at the buffer and goes with it.
+	if (swapChainImages.size() > uniformRing.regionCount())
+	{
+		VkBuffer retiredBuffer;
+		GpuAllocation retiredAllocation;
+		uniformRing.release(retiredBuffer, retiredAllocation);
+		deletionQueue.retireBuffer(retiredBuffer, retiredAllocation);
+		deletionQueue.retire(VK_OBJECT_TYPE_DESCRIPTOR_POOL, uniformDescriptorPool);
+		createUniformRing();
+	}
+
+	if (swapchainFormat != previousFormat)
+	{
+		/*
+		* Rare (e.g. the window moved to a display with another format): the render pass and the pipeline
+		* depend on the format. Frames in flight still use the old ones, they are retired like the swap chain.
+		* A shader reload in flight was built for the old render pass, it's built again afterwards.
+		* Variant compiles still running aren't waited for, the layout and render pass they read wait for them instead.
+		*/
+		discardShaderReload();
+		for (VkPipeline variant : pipelineVariants.release())
+		{
+			deletionQueue.retire(VK_OBJECT_TYPE_PIPELINE, variant);
+		}
+		compileInputs.insert(compileInputs.end(), { { VK_OBJECT_TYPE_PIPELINE_LAYOUT, (uint64_t)pipelineLayout },
+			{ VK_OBJECT_TYPE_RENDER_PASS, (uint64_t)renderPass } });
+		createRenderPass();
+		createGraphicsPipeline();
+	}
+
+	createImageViews();
+	createColorTargets();
+	createDepthTargets();
+	createFrameBuffers();
+
+	if (overdrawQueryPool != VK_NULL_HANDLE)
+	{
+		if (swapChainImages.size() > overdrawQueryCount)
+		{
+			deletionQueue.retire(VK_OBJECT_TYPE_QUERY_POOL, overdrawQueryPool);
+			createOverdrawQueries();
+		}
+		overdrawPending.assign(swapChainImages.size(), false);
+	}
+
+	// New framebuffers (and possibly a different image count): every image starts with an unrecorded cache entry.
+	allocateCommandBuffers();
+
+	HostAllocator::Statistics hostAllocationsAfter = hostAllocator.totals();
+	recreationHostAllocations.allocations += hostAllocationsAfter.allocations - hostAllocationsBefore.allocations;
+	recreationHostAllocations.systemAllocations += hostAllocationsAfter.systemAllocations - hostAllocationsBefore.systemAllocations;
+	swapchainRecreations++;
+}
+
+void TriangleApplication::createOffscreenTargets()
+{
+	TraceZone zone(tracer, "createOffscreenTargets");
+	/*
+	* One target per frame in flight, so a frame never renders into an image the previous frame is still using.
+	* They are only ever touched by the GPU, so they live in device local memory.
+	* The format was picked by chooseSwapchainFormat().
+	*/
+	swapchainExtent = { WIDTH, HEIGHT };
+
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, swapchainFormat, &formatProperties);
+	if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT))
+	{
+		throw std::runtime_error("offscreen format can't be used as color attachment.");
+	}
+
+	// The pacing sweep goes up to the deepest queue, make sure it never has to share a target.
+	uint32_t targetCount = config.pacingSweep ? FrameScheduler::MAX_FRAMES_IN_FLIGHT : config.framesInFlight;
+	swapChainImages.resize(targetCount);
+	offscreenImageAllocations.resize(targetCount);
+
+	for (size_t i = 0; i < swapChainImages.size(); i++)
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = swapchainFormat;
+		imageInfo.extent = { swapchainExtent.width, swapchainExtent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		// TRANSFER_SRC so batch jobs can read the rendered frame back.
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(logicalDevice, &imageInfo, hostAllocator.callbacks(), &swapChainImages[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create offscreen image.");
+		}
+
+		offscreenImageAllocations[i] = gpuAllocator.allocateImage(swapChainImages[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+}
+
+void TriangleApplication::createImageViews()
+{
+	TraceZone zone(tracer, "createImageViews");
+	swapchainImageViews.resize(swapChainImages.size());
+	for (size_t i = 0; i < swapChainImages.size(); i++)
+	{
+		VkImageViewCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		createInfo.image = swapChainImages[i];
+		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		createInfo.format = swapchainFormat;
+
+		createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+		createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+		createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+		createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+
+		createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		createInfo.subresourceRange.baseMipLevel = 0;
+		createInfo.subresourceRange.levelCount = 1;
+		createInfo.subresourceRange.baseArrayLayer = 0;
+		createInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(logicalDevice, &createInfo, hostAllocator.callbacks(), &swapchainImageViews[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create image view.");
+		}
+	}
+}
+
+void TriangleApplication::createColorTargets()
+{
+	TraceZone zone(tracer, "createColorTargets");
+	if (msaaSamples == VK_SAMPLE_COUNT_1_BIT)
+	{
+		return;
+	}
+
+	/*
+	* The multisampled targets only exist during rendering: cleared on load, resolved into the image and discarded.
+	* TRANSIENT usage lets tile-based GPUs keep them on chip, and in lazily allocated memory (where the device has it)
+	* they never get backing pages at all, so MSAA costs neither the memory nor the bandwidth of a full-size image.
+	* One per image, like everything else a frame in flight writes to.
+	*/
+	msaaImages.resize(swapChainImages.size());
+	msaaImageAllocations.resize(swapChainImages.size());
+	msaaImageViews.resize(swapChainImages.size());
+
+	for (size_t i = 0; i < msaaImages.size(); i++)
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = swapchainFormat;
+		imageInfo.extent = { swapchainExtent.width, swapchainExtent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = msaaSamples;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(logicalDevice, &imageInfo, hostAllocator.callbacks(), &msaaImages[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create MSAA image.");
+		}
+		msaaImageAllocations[i] = gpuAllocator.allocateImage(msaaImages[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = msaaImages[i];
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = swapchainFormat;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+		if (vkCreateImageView(logicalDevice, &viewInfo, hostAllocator.callbacks(), &msaaImageViews[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create MSAA image view.");
+		}
+	}
+}
+
+void TriangleApplication::createDepthTargets()
+{
+	TraceZone zone(tracer, "createDepthTargets");
+	/*
+	* Like the MSAA targets the depth buffer only lives during rendering: cleared on load and never stored,
+	* so it's transient and lazily allocated where the device allows it. It has the color target's sample count.
+	*/
+	depthImages.resize(swapChainImages.size());
+	depthImageAllocations.resize(swapChainImages.size());
+	depthImageViews.resize(swapChainImages.size());
+
+	for (size_t i = 0; i < depthImages.size(); i++)
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = depthFormat;
+		imageInfo.extent = { swapchainExtent.width, swapchainExtent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = msaaSamples;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(logicalDevice, &imageInfo, hostAllocator.callbacks(), &depthImages[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create depth image.");
+		}
+		depthImageAllocations[i] = gpuAllocator.allocateImage(depthImages[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = depthImages[i];
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = depthFormat;
+		viewInfo.subresourceRange = { depthAspectMask(), 0, 1, 0, 1 };
+
+		if (vkCreateImageView(logicalDevice, &viewInfo, hostAllocator.callbacks(), &depthImageViews[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create depth image view.");
+		}
+	}
+}
+
+void TriangleApplication::createRenderPass()
+{
+	TraceZone zone(tracer, "createRenderPass");
+	// Dynamic rendering describes the attachments when rendering begins, there is no render pass object.
+	if (dynamicRendering)
+	{
+		return;
+	}
+
+	VkAttachmentDescription colorAttachment{};
+	colorAttachment.format = swapchainFormat;
+	colorAttachment.samples = msaaSamples; // 1 sample without anti-aliasing, else the MSAA target
+
+	/*
+	* loadOp and storeOp determin what to do with the data in the attachment before rendering and after rendering
+	* VK_ATTACHMENT_LOAD_OP_LOAD : Preserve the existing contents
+	* VK_ATTACHMENT_LOAP_OP_CLEAR : Clear the values to constant at the start.
+	* VK_ATTACHMENT_LOAD_OP_DONT_CARE : Existing contents are undefined; we don't care about them.
+	* VK_ATTACHMENT_STORE_OP_STORE : Render contents will be stored in memeory and can be read later.
+	* VK_ATTACHMENT_STORE_OP_DONT_CARE : Contents of the framebuffer will be undefined after the rendering operation
+	*/
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; // we want to see the rendered triangle, so we choose the store operation here.
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	// Offscreen targets are never presented, leave them ready to be copied out instead.
+	colorAttachment.finalLayout = config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkAttachmentReference colorAttachmentRef{};
+	colorAttachmentRef.attachment = 0;
+	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	/*
+	* With MSAA the multisampled attachment is resolved into the image at the end of the subpass and then discarded:
+	* storeOp DONT_CARE means it never has to leave tile memory. The image only receives the resolve.
+	*/
+	VkAttachmentDescription resolveAttachment = colorAttachment;
+	resolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	resolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+
+	VkAttachmentReference resolveAttachmentRef{};
+	resolveAttachmentRef.attachment = 1;
+	resolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	bool multisampled = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+	if (multisampled)
+	{
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	}
+
+	// Depth is cleared to the far plane and dropped at the end, nothing reads it after the subpass.
+	VkAttachmentDescription depthAttachment{};
+	depthAttachment.format = depthFormat;
+	depthAttachment.samples = msaaSamples;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	// Attachments in framebuffer order: color, the resolve target with MSAA, depth.
+	std::vector<VkAttachmentDescription> attachments = { colorAttachment };
+	if (multisampled)
+	{
+		attachments.push_back(resolveAttachment);
+	}
+	attachments.push_back(depthAttachment);
+
+	VkAttachmentReference depthAttachmentRef{};
+	depthAttachmentRef.attachment = static_cast<uint32_t>(attachments.size() - 1);
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorAttachmentRef;
+	subpass.pResolveAttachments = multisampled ? &resolveAttachmentRef : nullptr;
+	subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+	// The depth clear also has to wait for the last frame's depth writes to the same image.
+	VkSubpassDependency dependency{};
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass = 0;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
 	VkRenderPassCreateInfo renderPassInfo{};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassInfo.attachmentCount = 1;
-	renderPassInfo.pAttachments = &colorAttachment;
+	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassInfo.pAttachments = attachments.data();
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = 1;
 	renderPassInfo.pDependencies = &dependency;
 
-	if (vkCreateRenderPass(logicalDevice, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+	if (vkCreateRenderPass(logicalDevice, &renderPassInfo, hostAllocator.callbacks(), &renderPass) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create render pass.");
 	}
 }
 
 void TriangleApplication::createGraphicsPipeline()
 {
-	// read the shader bytecode
-	auto vertexShader = readFile("vert.spv");
-	auto fragmentShader = readFile("frag.spv");
+	TraceZone zone(tracer, "createGraphicsPipeline");
+	// The bindless set, the uniforms and the draw's material index, see shader.vert and shader.frag
+	VkDescriptorSetLayout setLayouts[] = { bindless.layout(), uniformSetLayout };
+	VkPushConstantRange pushConstantRange = drawConstantRange();
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 2;
+	pipelineLayoutInfo.pSetLayouts = setLayouts;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, hostAllocator.callbacks(), &pipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline layout!");
+	}
+
+	pipelineVariants.init(logicalDevice, hostAllocator.callbacks());
+	bindVariantCompiler();
+
+	// The default variant is compiled right here, it's what every other variant falls back to until it's ready.
+	auto compileStart = std::chrono::steady_clock::now();
+	pipeline = compilePipelineVariant(PipelineVariantKey{}, pipelineLayout, vertexShaderModule, fragmentShaderModule, renderPass, swapchainFormat);
+	pipelineVariants.addReady(PipelineVariantKey{}, pipeline);
+	double compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+
+	// A warm cache should turn this into little more than a lookup, compare against a run with an empty cache.
+	std::cout << "graphics pipeline created in " << compileMs << " ms (pipeline cache "
+		<< (pipelineCache == VK_NULL_HANDLE ? "disabled" : (pipelineCacheLoadedSize > 0 ? "warm" : "cold")) << ")" << std::endl;
+}
+
+void TriangleApplication::bindVariantCompiler()
+{
+	/*
+	* Variants are compiled from worker threads later on, from copies of the handles: the members change when a shader
+	* reload or a format change releases the variants, while compiles queued before may still be running.
+	*/
+	pipelineVariants.setCompiler([this, layout = pipelineLayout, vertexModule = vertexShaderModule, fragmentModule = fragmentShaderModule,
+		pass = renderPass, format = swapchainFormat](const PipelineVariantKey& key) {
+		return compilePipelineVariant(key, layout, vertexModule, fragmentModule, pass, format);
+	});
+}
+
+void TriangleApplication::retireCompileInputs()
+{
+	// The frames in flight may still use these as well, the deletion queue takes it from here.
+	if (compileInputs.empty() or pipelineVariants.staleCount() > 0)
+	{
+		return;
+	}
+
+	for (const auto& [type, handle] : compileInputs)
+	{
+		deletionQueue.retire(type, handle);
+	}
+	compileInputs.clear();
+}
+
+void TriangleApplication::selectPipelineVariant()
+{
+	if (!config.cycleVariants)
+	{
+		return;
+	}
+
+	// A few variants that differ in cull mode, topology, blending and the specialized shading mode, two seconds each.
+	static const PipelineVariantKey cycle[] = {
+		{ VK_CULL_MODE_BACK_BIT, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, false, 0 },
+		{ VK_CULL_MODE_NONE, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, false, 1 },
+		{ VK_CULL_MODE_BACK_BIT, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, true, 2 },
+		{ VK_CULL_MODE_NONE, VK_PRIMITIVE_TOPOLOGY_LINE_STRIP, false, 0 },
+		{ VK_CULL_MODE_NONE, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, true, 1 },
+	};
+	float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - animationStart).count();
+	const PipelineVariantKey& requested = cycle[static_cast<uint32_t>(seconds / 2.0f) % std::size(cycle)];
+
+	// Never waits: until the variant is compiled this is the nearest one that is.
+	VkPipeline selected = pipelineVariants.acquire(requested, *jobSystem);
+	if (selected != pipeline)
+	{
+		// The cached command buffers bind the pipeline, every image records again with the new one.
+		pipeline = selected;
+		sceneVersion++;
+	}
+}
 
-	// create shader module
-	VkShaderModule vertexShaderModule = createShaderModule(vertexShader);
-	VkShaderModule fragmentShaderModule = createShaderModule(fragmentShader);
+VkPipeline TriangleApplication::compilePipelineVariant(const PipelineVariantKey& key, VkPipelineLayout layout,
+	VkShaderModule vertexModule, VkShaderModule fragmentModule, VkRenderPass pass, VkFormat colorFormat)
+{
+	TraceZone zone(tracer, "compilePipelineVariant");
+	// The shader modules were created by createShaderModules(), or by a shader reload that isn't swapped in yet
 
 	// create vertex shader stage
 	VkPipelineShaderStageCreateInfo vertexShaderStageInfo{};
 	vertexShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	vertexShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertexShaderStageInfo.module = vertexShaderModule;
+	vertexShaderStageInfo.module = vertexModule;
 	vertexShaderStageInfo.pName = "main";
 
 	VkPipelineShaderStageCreateInfo fragmentShaderStageInfo{};
 	fragmentShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	fragmentShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragmentShaderStageInfo.module = fragmentShaderModule;
+	fragmentShaderStageInfo.module = fragmentModule;
 	fragmentShaderStageInfo.pName = "main";
 
+	// constant_id 0 of shader.frag, the shading mode is folded into the variant's code at compile time.
+	VkSpecializationMapEntry specializationEntry{};
+	specializationEntry.constantID = 0;
+	specializationEntry.offset = 0;
+	specializationEntry.size = sizeof(uint32_t);
+
+	VkSpecializationInfo specializationInfo{};
+	specializationInfo.mapEntryCount = 1;
+	specializationInfo.pMapEntries = &specializationEntry;
+	specializationInfo.dataSize = sizeof(key.shadingMode);
+	specializationInfo.pData = &key.shadingMode;
+	fragmentShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderStageInfo, fragmentShaderStageInfo };
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
@@ -403,13 +1369,15 @@ void TriangleApplication::createGraphicsPipeline()
 	/*
 	* pVertexBindingDescriptions : spacing between data and whether the data is per-vertex or per-instance.
 	* pVertexAttributeDescriptions: type of the attributes passed to the vertex shader, which binding to load them from and at which offset
-	* Since we are hard coding the vertex data directly in the vertex shader, we'll fill in this tow structs to specify that
-	* there is no vertex data or to load for now.
 	*/
-	vertexInputInfo.vertexBindingDescriptionCount = 0;
-	vertexInputInfo.pVertexBindingDescriptions = nullptr;
-	vertexInputInfo.vertexAttributeDescriptionCount = 0;
-	vertexInputInfo.pVertexAttributeDescriptions = nullptr;
+	VkVertexInputBindingDescription bindingDescriptions[] = { Vertex::getBindingDescription(), InstanceData::getBindingDescription() };
+	auto attributeDescriptions = Vertex::getAttributeDescriptions();
+	auto instanceAttributeDescriptions = InstanceData::getAttributeDescriptions();
+	attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributeDescriptions.begin(), instanceAttributeDescriptions.end());
+	vertexInputInfo.vertexBindingDescriptionCount = 2;
+	vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions;
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
 	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
 	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -420,21 +1388,9 @@ void TriangleApplication::createGraphicsPipeline()
 	* VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST: triangle from every 3 vertices without reuse
 	* VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP: the second and the third vertex of every triangle are used as the first two vertices of the next triangle
 	*/
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssembly.topology = key.topology;
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-	VkViewport viewport{};
-	viewport.x = 0;
-	viewport.y = 0;
-	viewport.width = (float)swapchainExtent.width;
-	viewport.height = (float)swapchainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor{};
-	scissor.offset = { 0, 0 };
-	scissor.extent = swapchainExtent;
-
 	// It's often convient to make viewport and scissor state dynamic as it gives a lot more flexibility.
 	std::vector<VkDynamicState> dynamicStates = {
 		VK_DYNAMIC_STATE_VIEWPORT,
@@ -456,6 +1412,8 @@ void TriangleApplication::createGraphicsPipeline()
 	* Any changes required to these values would require a new pipeline to create with the new values.
 	* viewportState.pViewports = &viewport;
 	* viewportState.pScissor = &scissor;
+	* Being dynamic, they are set in recordSceneCommands() and the pipeline doesn't depend on the swap chain extent,
+	* which lets it compile while the swap chain is being created.
 	*/
 
 	VkPipelineRasterizationStateCreateInfo rasterizer{};
@@ -464,7 +1422,7 @@ void TriangleApplication::createGraphicsPipeline()
 	rasterizer.rasterizerDiscardEnable = VK_FALSE;
 	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
 	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+	rasterizer.cullMode = key.cullMode;
 	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
 	rasterizer.depthBiasEnable = VK_FALSE;
 	//rasterizer.depthBiasConstantFactor = 0.0f; //optional
@@ -474,7 +1432,7 @@ void TriangleApplication::createGraphicsPipeline()
 	VkPipelineMultisampleStateCreateInfo multisampling{};
 	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	multisampling.rasterizationSamples = msaaSamples;
 
 	/*
 	* Two way of blending
@@ -483,12 +1441,14 @@ void TriangleApplication::createGraphicsPipeline()
 	*/
 	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
 	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_FALSE;
-	//colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-	//colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-	//colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-	//colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-	//colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
+	colorBlendAttachment.blendEnable = key.blendEnable ? VK_TRUE : VK_FALSE;
+	// Plain alpha blending: color = src * srcAlpha + dst * (1 - srcAlpha)
+	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
 
 	VkPipelineColorBlendStateCreateInfo colorBlending{};
 	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
@@ -501,16 +1461,18 @@ void TriangleApplication::createGraphicsPipeline()
 	colorBlending.blendConstants[2] = 0.0f;
 	colorBlending.blendConstants[3] = 0.0f;
 
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 0; // Optional
-	pipelineLayoutInfo.pSetLayouts = nullptr; // Optional
-	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
-
-	if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create pipeline layout!");
-	}
+	/*
+	* Opaque geometry: test and write depth, nearer wins. The fragment shader neither discards nor writes
+	* gl_FragDepth, so the test can run before shading (early-Z) and fragments hidden by nearer instances
+	* drawn earlier are never shaded. How much that saves depends on the draw order, see updateInstances().
+	*/
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = VK_TRUE;
+	depthStencil.depthWriteEnable = key.blendEnable ? VK_FALSE : VK_TRUE;	// blended geometry is tested but doesn't occlude
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.stencilTestEnable = VK_FALSE;
 
 	VkGraphicsPipelineCreateInfo pipelineInfo{};
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -521,122 +1483,1464 @@ void TriangleApplication::createGraphicsPipeline()
 	pipelineInfo.pViewportState = &viewportState;
 	pipelineInfo.pRasterizationState = &rasterizer;
 	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pDepthStencilState = nullptr;
+	pipelineInfo.pDepthStencilState = &depthStencil;
 	pipelineInfo.pColorBlendState = &colorBlending;
 	pipelineInfo.pDynamicState = &dynamicState;
-	pipelineInfo.layout = pipelineLayout;
-	pipelineInfo.renderPass = renderPass;
+	pipelineInfo.layout = layout;
+	pipelineInfo.renderPass = pass;
 	pipelineInfo.subpass = 0;
 
-	if (vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+	// Without a render pass (pass is null) the pipeline is given the attachment formats directly.
+	VkPipelineRenderingCreateInfoKHR renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachmentFormats = &colorFormat;
+	renderingInfo.depthAttachmentFormat = depthFormat;
+	if (dynamicRendering)
 	{
-		throw std::runtime_error("failed to create graphics pipeline.");
+		pipelineInfo.pNext = &renderingInfo;
 	}
 
-	vkDestroyShaderModule(logicalDevice, vertexShaderModule, nullptr);
-	vkDestroyShaderModule(logicalDevice, fragmentShaderModule, nullptr);
-}
-
-VkShaderModule TriangleApplication::createShaderModule(const std::vector<char>& shader)
-{
-	VkShaderModuleCreateInfo createInfo{};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = shader.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(shader.data());
-
-	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(logicalDevice, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+	// The shared cache is internally synchronized, concurrent compiles of different variants can use it.
+	VkPipeline variantPipeline;
+	if (vkCreateGraphicsPipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, hostAllocator.callbacks(), &variantPipeline) != VK_SUCCESS)
 	{
-		throw std::runtime_error("failed to create shader module.");
+		throw std::runtime_error("failed to create graphics pipeline.");
 	}
-
-	return shaderModule;
+	return variantPipeline;
 }
 
-void TriangleApplication::createFrameBuffers()
+void TriangleApplication::createPipelineCache()
 {
-	swapchainFrameBuffers.resize(swapchainImageViews.size());
-
-	for (size_t i = 0; i < swapchainFrameBuffers.size(); i++)
+	TraceZone zone(tracer, "createPipelineCache");
+	if (config.pipelineCachePath.empty())
 	{
-		VkImageView attachments[] = {
-			swapchainImageViews[i]
-		};
+		return;
+	}
 
-		VkFramebufferCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		createInfo.renderPass = renderPass;
-		createInfo.attachmentCount = 1;
-		createInfo.pAttachments = attachments;
-		createInfo.width = swapchainExtent.width;
-		createInfo.height = swapchainExtent.height;
-		createInfo.layers = 1;
+	/*
+	* The blob is only usable by the exact device + driver that produced it.
+	* Drivers should reject foreign data themselves, but not all of them do it gracefully,
+	* so anything that doesn't match is dropped and we start with an empty cache.
+	*/
+	std::vector<char> initialData;
+	if (std::filesystem::exists(config.pipelineCachePath))
+	{
+		auto loadStart = std::chrono::steady_clock::now();
+		initialData = readFile(config.pipelineCachePath);
+		double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
 
-		if (vkCreateFramebuffer(logicalDevice, &createInfo, nullptr, &swapchainFrameBuffers[i]) != VK_SUCCESS)
+		if (isPipelineCacheCompatible(initialData))
 		{
-			throw std::runtime_error("failed to create framebuffer.");
+			std::cout << "pipeline cache hit: loaded " << initialData.size() << " bytes from " << config.pipelineCachePath
+				<< " in " << loadMs << " ms" << std::endl;
+		}
+		else
+		{
+			std::cout << "pipeline cache " << config.pipelineCachePath << " was written by another device or driver, ignoring it" << std::endl;
+			initialData.clear();
 		}
 	}
-}
+	else
+	{
+		std::cout << "pipeline cache miss: " << config.pipelineCachePath << " doesn't exist yet" << std::endl;
+	}
 
-void TriangleApplication::createCommanPool()
+	pipelineCacheLoadedSize = initialData.size();
+
+	VkPipelineCacheCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = initialData.size();
+	createInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+	if (vkCreatePipelineCache(logicalDevice, &createInfo, hostAllocator.callbacks(), &pipelineCache) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create pipeline cache.");
+	}
+}
+
+bool TriangleApplication::isPipelineCacheCompatible(const std::vector<char>& data)
+{
+	VkPipelineCacheHeaderVersionOne header{};
+	if (data.size() < sizeof(header))
+	{
+		return false;
+	}
+
+	// The blob has no alignment guarantees, copy the header out instead of casting.
+	std::memcpy(&header, data.data(), sizeof(header));
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	return header.headerSize >= sizeof(header)
+		and header.headerSize <= data.size()
+		and header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		and header.vendorID == properties.vendorID
+		and header.deviceID == properties.deviceID
+		and std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void TriangleApplication::savePipelineCache()
+{
+	if (pipelineCache == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(logicalDevice, pipelineCache, &dataSize, nullptr) != VK_SUCCESS or dataSize == 0)
+	{
+		return;
+	}
+
+	std::vector<char> data(dataSize);
+	if (vkGetPipelineCacheData(logicalDevice, pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+	{
+		return;
+	}
+
+	/*
+	* Write to a temporary file and rename it over the old one, so a crash or a concurrent
+	* instance never leaves a truncated cache behind for the next start. The contents reach the disk
+	* before the rename: otherwise a power loss can persist the new name with the data still missing.
+	*/
+	std::filesystem::path target(config.pipelineCachePath);
+	std::filesystem::path temporary = target;
+	temporary += ".tmp";
+
+	std::error_code error;
+	if (!writeFileToDisk(temporary, data.data(), dataSize))
+	{
+		std::cerr << "failed to write pipeline cache " << temporary << std::endl;
+		std::filesystem::remove(temporary, error);
+		return;
+	}
+
+	std::filesystem::rename(temporary, target, error);
+	if (error)
+	{
+		std::cerr << "failed to replace pipeline cache " << target << ": " << error.message() << std::endl;
+		std::filesystem::remove(temporary, error);
+		return;
+	}
+	syncDirectory(target.parent_path());
+
+	std::cout << "pipeline cache saved: " << dataSize << " bytes to " << config.pipelineCachePath << std::endl;
+}
+
+void TriangleApplication::createShaderModules()
+{
+	TraceZone zone(tracer, "createShaderModules", "shader");
+
+	// Kept until a shader reload replaces them, pipelines are recreated when the swap chain format changes.
+	ShaderBinary vertexShader = shaderRegistry.load("vert.spv");
+	ShaderBinary fragmentShader = shaderRegistry.load("frag.spv");
+	vertexShaderModule = createShaderModule(vertexShader);
+	fragmentShaderModule = createShaderModule(fragmentShader);
+
+	if (gpuDriven)
+	{
+		ShaderBinary cullShader = shaderRegistry.load("cull.spv");
+		cullShaderModule = createShaderModule(cullShader);
+	}
+}
+
+void TriangleApplication::watchShaderSources()
+{
+	TraceZone zone(tracer, "watchShaderSources", "shader");
+	shaderWatcher.watch(config.shaderSourceDirectory, { "shader.vert", "shader.frag" });
+	std::cout << "watching shaders in " << config.shaderSourceDirectory << std::endl;
+}
+
+void TriangleApplication::pollShaderReload()
+{
+	if (!shaderWatcher.isWatching())
+	{
+		return;
+	}
+
+	// An edit that arrives while a reload is building is picked up by the next one.
+	if (!shaderWatcher.poll().empty())
+	{
+		shaderReloadQueued = true;
+	}
+
+	if (shaderReload and shaderReload->done.load(std::memory_order_acquire))
+	{
+		finishShaderReload();
+	}
+
+	if (shaderReloadQueued and !shaderReload)
+	{
+		startShaderReload();
+	}
+}
+
+void TriangleApplication::startShaderReload()
+{
+	shaderReloadQueued = false;
+	shaderReload = std::make_unique<ShaderReload>();
+
+	/*
+	* glslc, module creation and the pipeline compile all run on a worker, the frame keeps drawing with the old pipeline.
+	* Both shaders are rebuilt whichever one changed: the new pipeline owns a fresh pair of modules,
+	* and the old pair can be retired together with the old pipelines.
+	*/
+	ShaderReload* reload = shaderReload.get();
+	jobSystem->submitBackground([this, reload]() {
+		TraceZone zone(tracer, "shaderReload", "shader");
+		auto buildStart = std::chrono::steady_clock::now();
+		std::filesystem::path directory = config.shaderSourceDirectory;
+
+		try
+		{
+			// Same .spv outputs as compileShader.py, so --shader-dir on the same directory starts with the edited shaders.
+			for (const auto& [source, output] : { std::pair<const char*, const char*>{ "shader.vert", "vert.spv" }, { "shader.frag", "frag.spv" } })
+			{
+				std::string errors = ShaderWatcher::compileGlsl(config.glslcPath, (directory / source).string(), (directory / output).string());
+				if (!errors.empty())
+				{
+					throw std::runtime_error(errors);
+				}
+			}
+
+			reload->vertexShaderModule = createShaderModule(ShaderBinary::map((directory / "vert.spv").string()));
+			reload->fragmentShaderModule = createShaderModule(ShaderBinary::map((directory / "frag.spv").string()));
+			reload->pipeline = compilePipelineVariant(PipelineVariantKey{}, pipelineLayout, reload->vertexShaderModule, reload->fragmentShaderModule,
+				renderPass, swapchainFormat);
+		}
+		catch (const std::exception& e)
+		{
+			reload->error = e.what();
+		}
+
+		reload->buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+		reload->done.store(true, std::memory_order_release);
+	});
+}
+
+void TriangleApplication::finishShaderReload()
+{
+	std::unique_ptr<ShaderReload> reload = std::move(shaderReload);
+
+	if (!reload->error.empty())
+	{
+		// Whatever did get created was never used by a frame.
+		for (VkShaderModule module : { reload->vertexShaderModule, reload->fragmentShaderModule })
+		{
+			if (module != VK_NULL_HANDLE)
+			{
+				vkDestroyShaderModule(logicalDevice, module, hostAllocator.callbacks());
+			}
+		}
+		std::cerr << "shader reload failed, keeping the current shaders:\n" << reload->error << std::endl;
+		return;
+	}
+
+	/*
+	* No vkDeviceWaitIdle: frames in flight keep using the old pipelines and modules, the deletion queue destroys
+	* them from drawFrame() once every frame submitted so far has completed. This frame hasn't been submitted yet,
+	* so it's the first one to use the new pipeline.
+	* Every variant was built from the old modules, they go as well and are compiled again when next asked for.
+	* Variant compiles still running read the old modules, those wait for them in retireCompileInputs().
+	*/
+	for (VkPipeline variant : pipelineVariants.release())
+	{
+		deletionQueue.retire(VK_OBJECT_TYPE_PIPELINE, variant);
+	}
+	compileInputs.insert(compileInputs.end(), { { VK_OBJECT_TYPE_SHADER_MODULE, (uint64_t)vertexShaderModule },
+		{ VK_OBJECT_TYPE_SHADER_MODULE, (uint64_t)fragmentShaderModule } });
+
+	vertexShaderModule = reload->vertexShaderModule;
+	fragmentShaderModule = reload->fragmentShaderModule;
+	pipeline = reload->pipeline;
+	pipelineVariants.addReady(PipelineVariantKey{}, pipeline);
+	bindVariantCompiler();
+
+	// The cached command buffers bind the old pipeline, every image records again.
+	sceneVersion++;
+	shaderReloads++;
+	std::cout << "shaders reloaded, built in " << reload->buildMs << " ms in the background" << std::endl;
+}
+
+void TriangleApplication::discardShaderReload()
+{
+	if (!shaderReload)
+	{
+		return;
+	}
+
+	// The job reads the render pass and the pipeline layout, it has to finish before either changes.
+	while (!shaderReload->done.load(std::memory_order_acquire))
+	{
+		std::this_thread::yield();
+	}
+
+	if (shaderReload->pipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(logicalDevice, shaderReload->pipeline, hostAllocator.callbacks());
+	}
+	for (VkShaderModule module : { shaderReload->vertexShaderModule, shaderReload->fragmentShaderModule })
+	{
+		if (module != VK_NULL_HANDLE)
+		{
+			vkDestroyShaderModule(logicalDevice, module, hostAllocator.callbacks());
+		}
+	}
+	shaderReload.reset();
+
+	// The edit hasn't been applied, build it again against whatever replaces the pipeline.
+	shaderReloadQueued = true;
+}
+
+void TriangleApplication::chooseSwapchainFormat()
+{
+	// Offscreen targets always use the same format, a swap chain the one the surface prefers.
+	if (config.headless)
+	{
+		swapchainFormat = VK_FORMAT_B8G8R8A8_SRGB;
+	}
+	else
+	{
+		VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(querySwapchainSupport(physicalDevice).formats);
+		swapchainFormat = surfaceFormat.format;
+		swapchainColorSpace = surfaceFormat.colorSpace;
+	}
+}
+
+void TriangleApplication::chooseSampleCount()
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	/*
+	* The highest supported count up to the requested one, VkSampleCountFlagBits values are the counts themselves.
+	* The depth buffer is multisampled as well, so the count has to work for both.
+	*/
+	VkSampleCountFlags supportedCounts = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+	msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+	for (uint32_t samples = config.msaaSamples; samples > 1; samples /= 2)
+	{
+		if (supportedCounts & samples)
+		{
+			msaaSamples = static_cast<VkSampleCountFlagBits>(samples);
+			break;
+		}
+	}
+
+	if (config.msaaSamples > 1)
+	{
+		std::cout << "MSAA " << msaaSamples << "x";
+		if (msaaSamples != config.msaaSamples)
+		{
+			std::cout << " (" << config.msaaSamples << "x is not supported)";
+		}
+		std::cout << std::endl;
+	}
+}
+
+void TriangleApplication::chooseDepthFormat()
+{
+	/*
+	* No stencil needed, so the first depth-only format that works as an optimal tiling attachment.
+	* The spec guarantees D16_UNORM, and one of X8_D24_UNORM_PACK32 or D32_SFLOAT.
+	*/
+	const VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM };
+
+	depthFormat = VK_FORMAT_UNDEFINED;
+	for (VkFormat format : candidates)
+	{
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+		if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+		{
+			depthFormat = format;
+			break;
+		}
+	}
+
+	if (depthFormat == VK_FORMAT_UNDEFINED)
+	{
+		throw std::runtime_error("failed to find a depth attachment format.");
+	}
+}
+
+VkImageAspectFlags TriangleApplication::depthAspectMask() const
+{
+	// Views and barriers of a combined format have to name both aspects.
+	if (depthFormat == VK_FORMAT_D24_UNORM_S8_UINT)
+	{
+		return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+	return VK_IMAGE_ASPECT_DEPTH_BIT;
+}
+
+VkShaderModule TriangleApplication::createShaderModule(const ShaderBinary& shader)
+{
+	// Embedded arrays and file mappings are both word aligned, so the code is passed as is.
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = shader.size();
+	createInfo.pCode = shader.code();
+
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(logicalDevice, &createInfo, hostAllocator.callbacks(), &shaderModule) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shader module.");
+	}
+
+	return shaderModule;
+}
+
+void TriangleApplication::createFrameBuffers()
+{
+	TraceZone zone(tracer, "createFrameBuffers");
+	// Dynamic rendering renders into the image views directly.
+	if (dynamicRendering)
+	{
+		return;
+	}
+
+	swapchainFrameBuffers.resize(swapchainImageViews.size());
+
+	for (size_t i = 0; i < swapchainFrameBuffers.size(); i++)
+	{
+		// Same order as the render pass attachments: the MSAA target first, resolved into the image, then depth.
+		std::vector<VkImageView> attachments;
+		if (!msaaImageViews.empty())
+		{
+			attachments.push_back(msaaImageViews[i]);
+		}
+		attachments.push_back(swapchainImageViews[i]);
+		attachments.push_back(depthImageViews[i]);
+
+		VkFramebufferCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		createInfo.renderPass = renderPass;
+		createInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		createInfo.pAttachments = attachments.data();
+		createInfo.width = swapchainExtent.width;
+		createInfo.height = swapchainExtent.height;
+		createInfo.layers = 1;
+
+		if (vkCreateFramebuffer(logicalDevice, &createInfo, hostAllocator.callbacks(), &swapchainFrameBuffers[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create framebuffer.");
+		}
+	}
+}
+
+void TriangleApplication::createCommanPool()
+{
+	TraceZone zone(tracer, "createCommanPool");
+	// we store commands on command buffer and submit them on one of the device queue.
+	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = 0; // only holds buffers recorded once, frame commands come from the per-image pools
+	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicFamliy.value();
+
+	if (vkCreateCommandPool(logicalDevice, &poolInfo, hostAllocator.callbacks(), &commandPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create command pool.");
+	}
+}
+
+void TriangleApplication::createGeometryBuffers()
+{
+	TraceZone zone(tracer, "createGeometryBuffers");
+	vertexBuffer = createDeviceLocalBuffer(vertices.data(), sizeof(vertices[0]) * vertices.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, vertexBufferAllocation);
+	indexBuffer = createDeviceLocalBuffer(indices.data(), sizeof(indices[0]) * indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, indexBufferAllocation);
+
+	// The first frame's submit waits for the copies.
+	uploadQueue.submit();
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	std::cout << "device memory: " << gpuAllocator.subAllocationCount() << " allocations in "
+		<< gpuAllocator.deviceAllocationCount() << " vkAllocateMemory blocks (maxMemoryAllocationCount "
+		<< properties.limits.maxMemoryAllocationCount << ")" << std::endl;
+}
+
+VkBuffer TriangleApplication::createDeviceLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, GpuAllocation& allocation)
+{
+	/*
+	* Device local memory is usually not host visible (and the fastest to read from for the GPU),
+	* so the data goes through the staging ring and a copy on the transfer queue.
+	*/
+	VkBuffer buffer = gpuAllocator.createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, allocation);
+
+	uploadQueue.uploadBuffer(buffer, 0, data, size, dstStage, dstAccess);
+	return buffer;
+}
+
+void TriangleApplication::createMaterials()
+{
+	TraceZone zone(tracer, "createMaterials");
+	/*
+	* One small material (a tint) per draw, each its own element of the bindless buffer array.
+	* They share a buffer, MATERIAL_STRIDE apart so every region is a valid storage buffer offset.
+	* Tints stay close to white so the scene looks the same, draws just differ slightly.
+	*/
+	std::vector<float> materialData(MATERIAL_COUNT * MATERIAL_STRIDE / sizeof(float), 0.0f);
+	for (uint32_t i = 0; i < MATERIAL_COUNT; i++)
+	{
+		float* tint = &materialData[i * MATERIAL_STRIDE / sizeof(float)];
+		for (uint32_t channel = 0; channel < 3; channel++)
+		{
+			float phase = (i + 1) * 0.618034f * (channel + 1);
+			tint[channel] = 0.8f + 0.2f * (phase - std::floor(phase));
+		}
+		tint[3] = 1.0f;
+	}
+
+	materialBuffer = createDeviceLocalBuffer(materialData.data(), materialData.size() * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, materialAllocation);
+
+	materialIndices.resize(MATERIAL_COUNT);
+	for (uint32_t i = 0; i < MATERIAL_COUNT; i++)
+	{
+		materialIndices[i] = bindless.addStorageBuffer(materialBuffer, i * MATERIAL_STRIDE, 4 * sizeof(float));
+	}
+}
+
+VkPushConstantRange TriangleApplication::drawConstantRange()
+{
+	// DrawConstants of shader.vert and shader.frag: the draw's material in the bindless buffer array and its DrawUniforms
+	VkPushConstantRange range{};
+	range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	range.offset = 0;
+	range.size = sizeof(DrawConstants);
+	return range;
+}
+
+void TriangleApplication::createInstanceBuffer()
+{
+	TraceZone zone(tracer, "createInstanceBuffer");
+	/*
+	* Written by the CPU every frame and read once by the GPU, so plain host visible memory is the right place:
+	* a device local copy would cost a transfer of the same size every frame. On the GPU-driven path the cull pass
+	* writes them instead, into device local memory.
+	*/
+	instanceRegionCount = static_cast<uint32_t>(swapChainImages.size());
+	instanceCapacity = std::max(config.instanceCount, config.instanceSweep ? sweepInstanceCapacity() : 0u);
+	instanceCount = config.instanceCount;
+	animationStart = std::chrono::steady_clock::now();
+
+	// 256 is the largest minStorageBufferOffsetAlignment the spec allows.
+	instanceRegionSize = (static_cast<VkDeviceSize>(instanceCapacity) * sizeof(InstanceData) + 255) / 256 * 256;
+
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | (gpuDriven ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0);
+	VkMemoryPropertyFlags properties = gpuDriven ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	instanceBuffer = gpuAllocator.createBuffer(instanceRegionSize * instanceRegionCount, usage, properties, instanceAllocation);
+}
+
+uint32_t TriangleApplication::sweepInstanceCapacity() const
+{
+	/*
+	* MAX_SWEEP_INSTANCES take about 240 MB per image. The buffer holding a region per image has to be a single
+	* allocation, and shouldn't take more than a quarter of its heap (host visible, or device local on the GPU-driven
+	* path, which also keeps a copy of the scene), so the sweep stops earlier on GPUs that can't spare that.
+	*/
+	VkPhysicalDeviceVulkan11Properties vulkan11Properties{};
+	vulkan11Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &vulkan11Properties;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+	uint32_t memoryType = gpuAllocator.memoryTypeIndex(~0u, gpuDriven ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 0);
+	VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+
+	// Less the alignment padding of every region.
+	VkDeviceSize limit = std::min(vulkan11Properties.maxMemoryAllocationSize, heapSize / 4);
+	VkDeviceSize padding = 256ull * instanceRegionCount;
+	VkDeviceSize perInstance = static_cast<VkDeviceSize>(sizeof(InstanceData)) * (instanceRegionCount + (gpuDriven ? 1 : 0));
+	VkDeviceSize fitting = limit > padding ? (limit - padding) / perInstance : 0;
+	return static_cast<uint32_t>(std::min<VkDeviceSize>(MAX_SWEEP_INSTANCES, fitting));
+}
+
+void TriangleApplication::createUniformSetLayout()
+{
+	TraceZone zone(tracer, "createUniformSetLayout");
+	/*
+	* Both bindings point into the uniform ring, the frame picks its blocks with dynamic offsets. The per-draw constants
+	* are one array, a storage buffer since it outgrows maxUniformBufferRange with enough draws, and the draws index it
+	* with a push constant: the set is bound once per command buffer, not per draw.
+	*/
+	VkDescriptorSetLayoutBinding bindings[2]{};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, hostAllocator.callbacks(), &uniformSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create uniform descriptor set layout.");
+	}
+}
+
+void TriangleApplication::createUniformRing()
+{
+	TraceZone zone(tracer, "createUniformRing");
+	/*
+	* A region holds the frame's constants and an array of one block per draw. The binding benchmark records more draws
+	* than the scene has, it needs the room for them.
+	*/
+	uniformDrawCapacity = std::max(config.drawCount, config.bindingBenchmark ? MIN_BINDING_BENCHMARK_DRAWS : 1u);
+	uniformRing.createRegions(static_cast<uint32_t>(swapChainImages.size()),
+		uniformRing.alignedSize(sizeof(FrameUniforms)) + uniformRing.alignedSize(uniformDrawCapacity * sizeof(DrawUniforms)));
+
+	VkDescriptorPoolSize poolSizes[2] = {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 },
+	};
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 2;
+	poolInfo.pPoolSizes = poolSizes;
+
+	if (vkCreateDescriptorPool(logicalDevice, &poolInfo, hostAllocator.callbacks(), &uniformDescriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create uniform descriptor pool.");
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = uniformDescriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &uniformSetLayout;
+
+	if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, &uniformDescriptorSet) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate uniform descriptor set.");
+	}
+
+	// The ranges are a frame's worth, the dynamic offsets say which frame's.
+	VkDescriptorBufferInfo bufferInfos[2] = {
+		{ uniformRing.buffer(), 0, sizeof(FrameUniforms) },
+		{ uniformRing.buffer(), 0, uniformDrawCapacity * sizeof(DrawUniforms) },
+	};
+
+	VkWriteDescriptorSet writes[2]{};
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = uniformDescriptorSet;
+		writes[i].dstBinding = i;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		writes[i].pBufferInfo = &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(logicalDevice, 2, writes, 0, nullptr);
+}
+
+void TriangleApplication::writeUniforms(uint32_t imageIndex, uint32_t drawCount)
+{
+	// prepareCommandBuffer() has waited for the last frame that read this image's region.
+	CachedCommandBuffer& cached = commandBufferCache[imageIndex];
+	uniformRing.begin(imageIndex);
+
+	/*
+	* The camera keeps the scene's proportions in any window: the longer side of the window shows [-1, 1],
+	* the shorter one is cropped. Zooming in only, never out, keeps the GPU culling (which tests against
+	* [-1, 1]) conservative.
+	*/
+	UniformRing::Allocation frame = uniformRing.allocate(sizeof(FrameUniforms));
+	float longerSide = static_cast<float>(std::max(swapchainExtent.width, swapchainExtent.height));
+	*static_cast<FrameUniforms*>(frame.data) = { { longerSide / swapchainExtent.width, longerSide / swapchainExtent.height, 0.0f, 0.0f } };
+	cached.frameUniformOffset = frame.offset;
+
+	// An array of one block per draw, indexed by the draw's push constant. The draws are spread over a full turn around the center, draw 0 is unrotated.
+	UniformRing::Allocation draws = uniformRing.allocate(static_cast<VkDeviceSize>(drawCount) * sizeof(DrawUniforms));
+	for (uint32_t draw = 0; draw < drawCount; draw++)
+	{
+		DrawUniforms* uniforms = static_cast<DrawUniforms*>(draws.data) + draw;
+		uint32_t texture = config.textureCount > 0 ? textureStreamer.bindlessIndex(drawTexture(draw)) : TextureStreamer::NO_TEXTURE;
+		*uniforms = { { 0.0f, 0.0f, 1.0f, 6.2831853f * draw / drawCount }, texture, {} };
+	}
+	cached.drawUniformOffset = draws.offset;
+
+	uniformRing.flush();
+}
+
+void TriangleApplication::createCullPipeline()
+{
+	TraceZone zone(tracer, "createCullPipeline");
+	// The scene's instances, the visible ones, the indirect draw and the frame's CullFrame, all for the compute shader only.
+	VkDescriptorSetLayoutBinding bindings[4]{};
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = i == 3 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 4;
+	layoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, hostAllocator.callbacks(), &cullSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create cull descriptor set layout.");
+	}
+
+	// objectCount and boundingRadius, see cull.comp
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = 2 * sizeof(uint32_t);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &cullSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, hostAllocator.callbacks(), &cullPipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create cull pipeline layout.");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = cullShaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = cullPipelineLayout;
+
+	if (vkCreateComputePipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, hostAllocator.callbacks(), &cullPipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create cull pipeline.");
+	}
+}
+
+void TriangleApplication::createCullingBuffers()
+{
+	TraceZone zone(tracer, "createCullingBuffers");
+	// Room for the whole sweep, the next frame uploads the instances.
+	sceneInstanceBuffer = gpuAllocator.createBuffer(static_cast<VkDeviceSize>(instanceCapacity) * sizeof(InstanceData),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sceneInstanceAllocation);
+	sceneInstanceCount = 0;
+
+	/*
+	* A slot per image, so the culling pass of one frame never overwrites the draw another frame in flight is still
+	* reading. 256 is the largest offset alignment of storage and uniform buffers the spec allows.
+	*/
+	indirectBuffer = gpuAllocator.createBuffer(256 * instanceRegionCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indirectAllocation);
+	cullFrameBuffer = gpuAllocator.createBuffer(256 * instanceRegionCount, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, cullFrameAllocation);
+
+	VkDescriptorPoolSize poolSizes[2] = {
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * instanceRegionCount },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, instanceRegionCount },
+	};
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = instanceRegionCount;
+	poolInfo.poolSizeCount = 2;
+	poolInfo.pPoolSizes = poolSizes;
+
+	if (vkCreateDescriptorPool(logicalDevice, &poolInfo, hostAllocator.callbacks(), &cullDescriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create cull descriptor pool.");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(instanceRegionCount, cullSetLayout);
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = cullDescriptorPool;
+	allocInfo.descriptorSetCount = instanceRegionCount;
+	allocInfo.pSetLayouts = layouts.data();
+
+	cullDescriptorSets.resize(instanceRegionCount);
+	if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, cullDescriptorSets.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate cull descriptor sets.");
+	}
+
+	// Set i sees the whole scene and the instance region and slots of image i.
+	for (uint32_t i = 0; i < instanceRegionCount; i++)
+	{
+		VkDescriptorBufferInfo bufferInfos[4] = {
+			{ sceneInstanceBuffer, 0, VK_WHOLE_SIZE },
+			{ instanceBuffer, i * instanceRegionSize, instanceRegionSize },
+			{ indirectBuffer, i * 256ull, sizeof(VkDrawIndexedIndirectCommand) },
+			{ cullFrameBuffer, i * 256ull, sizeof(CullFrame) },
+		};
+
+		VkWriteDescriptorSet writes[2]{};
+		for (uint32_t j = 0; j < 2; j++)
+		{
+			writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[j].dstSet = cullDescriptorSets[i];
+		}
+		writes[0].dstBinding = 0;
+		writes[0].descriptorCount = 3;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[0].pBufferInfo = bufferInfos;
+		writes[1].dstBinding = 3;
+		writes[1].descriptorCount = 1;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		writes[1].pBufferInfo = &bufferInfos[3];
+		vkUpdateDescriptorSets(logicalDevice, 2, writes, 0, nullptr);
+	}
+}
+
+void TriangleApplication::recordCulling(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
-	// we store commands on command buffer and submit them on one of the device queue.
+	// The draw starts out without instances, the shader counts the visible ones into it.
+	VkDrawIndexedIndirectCommand draw{};
+	draw.indexCount = static_cast<uint32_t>(indices.size());
+	vkCmdUpdateBuffer(commandBuffer, indirectBuffer, imageIndex * 256ull, sizeof(draw), &draw);
+
+	VkBufferMemoryBarrier clearBarrier{};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	clearBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	clearBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	clearBarrier.buffer = indirectBuffer;
+	clearBarrier.offset = imageIndex * 256ull;
+	clearBarrier.size = sizeof(draw);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		0, nullptr, 1, &clearBarrier, 0, nullptr);
+
+	/*
+	* The CullFrame was written by the host before the submit, which makes it visible to the whole submission
+	* without a barrier, the scene's upload comes with its own. The triangle's vertices are at most 0.5 from its
+	* origin, padded a bit for rounding: objects are culled only when they are certainly outside.
+	*/
+	struct {
+		uint32_t objectCount;
+		float boundingRadius;
+	} cull = { instanceCount, 0.71f };
+
+	// One invocation per object in groups of 64, in rows of up to maxComputeWorkGroupCount[0] groups.
+	uint32_t groupCount = (instanceCount + 63) / 64;
+	uint32_t rowLength = std::min(groupCount, maxComputeGroups);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullDescriptorSets[imageIndex], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cull), &cull);
+	vkCmdDispatch(commandBuffer, rowLength, (groupCount + rowLength - 1) / rowLength, 1);
+
+	// The visible instances and their count are consumed by the indirect draw in the render pass.
+	VkMemoryBarrier drawBarrier{};
+	drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+		1, &drawBarrier, 0, nullptr, 0, nullptr);
+}
+
+void TriangleApplication::updateInstances(uint32_t imageIndex)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	/*
+	* Instances sit on a square grid covering the viewport, a single instance is the original triangle.
+	* The GPU-driven path spreads them over twice the viewport in each direction and pans slowly,
+	* so that about three quarters of them are culled.
+	*/
+	float time = std::chrono::duration<float>(start - animationStart).count();
+	float extent = gpuDriven ? 2.0f : 1.0f;
+	uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instanceCount))));
+	float cell = 2.0f * extent / gridSize;
+	float scale = cell * 0.5f * config.instanceOverlap;
+	instanceScale = scale;
+
+	// Each instance has its own depth, drifting slowly so that the order changes from frame to frame. cull.comp does the same.
+	auto depthOf = [](uint32_t i, float time) {
+		float phase = static_cast<float>(i * 2654435761u) * (6.2831853f / 4294967296.0f);
+		return 0.5f + 0.45f * std::sin(phase + time * 0.5f);
+	};
+
+	// Instance i of the grid at the given time, written to the given slot, i.e. drawn in that position.
+	auto writeInstance = [=](InstanceData* instances, uint32_t slot, uint32_t i, float time) {
+		uint32_t x = i % gridSize;
+		uint32_t y = i / gridSize;
+
+		InstanceData& instance = instances[slot];
+		instance.transform[0] = -extent + (x + 0.5f) * cell;
+		instance.transform[1] = -extent + (y + 0.5f) * cell;
+		instance.transform[2] = scale;
+		instance.transform[3] = time + i * 0.001f;
+		instance.depth = depthOf(i, time);
+
+		uint32_t green = 255 - x * 128 / gridSize;
+		uint32_t blue = 255 - y * 128 / gridSize;
+		instance.color = 255u | (green << 8) | (blue << 16) | (255u << 24);
+	};
+
+	// With millions of instances this loop is the frame, spread it over the job system.
+	const uint32_t instancesPerTask = 64 * 1024;
+	uint32_t taskCount = std::min(jobSystem->threadCount(), instanceCount / instancesPerTask + 1);
+
+	if (gpuDriven)
+	{
+		/*
+		* The scene only changes with the instance count, which the sweep changes with the device idle. It is uploaded
+		* as it is at time 0, the cull pass adds the rotation, the depth drift and the pan of the frame.
+		*/
+		if (sceneInstanceCount != instanceCount)
+		{
+			std::vector<InstanceData> scene(instanceCount);
+			InstanceData* sceneData = scene.data();
+			jobSystem->parallelFor(instanceCount, taskCount, [=](uint32_t task, uint32_t begin, uint32_t end) {
+				for (uint32_t i = begin; i < end; i++)
+				{
+					writeInstance(sceneData, i, i, 0.0f);
+				}
+			});
+			uploadQueue.uploadBuffer(sceneInstanceBuffer, 0, sceneData, scene.size() * sizeof(InstanceData),
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+			sceneInstanceCount = instanceCount;
+		}
+
+		// prepareCommandBuffer() has waited for the last frame that read this image's slot.
+		CullFrame* frame = reinterpret_cast<CullFrame*>(static_cast<char*>(cullFrameAllocation.mapped) + imageIndex * 256ull);
+		*frame = { time, std::sin(time * 0.25f) };
+		gpuAllocator.flush(cullFrameAllocation, imageIndex * 256ull, sizeof(CullFrame));
+
+		instanceUpdateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return;
+	}
+
+	// prepareCommandBuffer() has waited for the last frame that read this image's region.
+	InstanceData* instances = reinterpret_cast<InstanceData*>(static_cast<char*>(instanceAllocation.mapped) + imageIndex * instanceRegionSize);
+
+	if (config.depthSort and instanceCount > 1)
+	{
+		/*
+		* Front to back: the nearest instances are drawn first and fill the depth buffer, so the early depth test
+		* rejects most fragments of the ones behind them instead of shading them and then overwriting the result.
+		* Keys are made in instance order, which the (stable) sort keeps for equal depths.
+		*/
+		auto sortStart = std::chrono::steady_clock::now();
+		drawKeys.resize(instanceCount);
+		uint64_t* keys = drawKeys.data();
+		jobSystem->parallelFor(instanceCount, taskCount, [=](uint32_t task, uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++)
+			{
+				keys[i] = DrawSorter::makeKey(DrawSorter::OPAQUE_LAYER, depthOf(i, time), i);
+			}
+		});
+		drawSorter.sort(drawKeys, 32);
+		drawSortMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sortStart).count();
+		drawSorts++;
+
+		// The sort may have swapped the key buffer.
+		const uint64_t* sortedKeys = drawKeys.data();
+		jobSystem->parallelFor(instanceCount, taskCount, [=](uint32_t task, uint32_t begin, uint32_t end) {
+			for (uint32_t slot = begin; slot < end; slot++)
+			{
+				writeInstance(instances, slot, DrawSorter::drawIndex(sortedKeys[slot]), time);
+			}
+		});
+	}
+	else
+	{
+		jobSystem->parallelFor(instanceCount, taskCount, [=](uint32_t task, uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++)
+			{
+				writeInstance(instances, i, i, time);
+			}
+		});
+	}
+
+	gpuAllocator.flush(instanceAllocation, imageIndex * instanceRegionSize, static_cast<VkDeviceSize>(instanceCount) * sizeof(InstanceData));
+
+	instanceUpdateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TriangleApplication::runInstanceSweep()
+{
+	/*
+	* Every step re-records the command buffers with the new instance count, renders a few frames to settle,
+	* then times a fixed number of frames. Frame time includes the per-frame instance update on the CPU,
+	* which is reported separately so the CPU and GPU limits can be told apart.
+	*/
+	const uint32_t warmupFrames = 5;
+	const uint32_t measuredFrames = 30;
+	// The GPU-driven path makes a single indirect draw, like recordSceneCommands().
+	uint32_t drawCount = gpuDriven ? 1 : config.drawCount;
+	uint64_t trianglesPerInstance = indices.size() / 3 * drawCount;
+
+	/*
+	* It only draws the instances that survive culling, which the CPU doesn't know. With --overdraw the queries count
+	* the triangles assembled, i.e. only the visible ones, otherwise the culled ones are counted as if they were drawn.
+	*/
+	bool countDrawnTriangles = gpuDriven and overdrawQueryPool != VK_NULL_HANDLE;
+	auto collectPendingOverdraw = [this]() {
+		for (uint32_t i = 0; i < overdrawPending.size(); i++)
+		{
+			collectOverdraw(i);
+		}
+	};
+
+	if (instanceCapacity < MAX_SWEEP_INSTANCES)
+	{
+		std::cout << "instance buffer capped at " << instanceCapacity << " instances by the device's memory" << std::endl;
+	}
+	if (gpuDriven)
+	{
+		std::cout << (countDrawnTriangles ? "GPU-driven: triangles of culled instances are excluded"
+			: "GPU-driven: triangles of culled instances are included, run with --overdraw to exclude them") << std::endl;
+	}
+	std::cout << "instances  frame ms  update ms  Mtriangles/s" << std::endl;
+
+	for (uint32_t count = 1; count <= instanceCapacity and count <= MAX_SWEEP_INSTANCES; count *= 10)
+	{
+		instanceCount = count;
+		sceneVersion++;
+
+		for (uint32_t i = 0; i < warmupFrames; i++)
+		{
+			drawFrame();
+		}
+		vkDeviceWaitIdle(logicalDevice);
+		if (countDrawnTriangles)
+		{
+			collectPendingOverdraw();
+		}
+
+		instanceUpdateMs = 0.0;
+		uint64_t trianglesBefore = overdrawTriangles;
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < measuredFrames; i++)
+		{
+			if (window != nullptr)
+			{
+				glfwPollEvents();
+			}
+			drawFrame();
+		}
+		vkDeviceWaitIdle(logicalDevice);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		double frameMs = seconds * 1000.0 / measuredFrames;
+		double trianglesPerSecond = static_cast<double>(count) * trianglesPerInstance * measuredFrames / seconds;
+		if (countDrawnTriangles)
+		{
+			collectPendingOverdraw();
+			trianglesPerSecond = (overdrawTriangles - trianglesBefore) / seconds;
+		}
+		std::cout << std::setw(9) << count << "  " << std::setw(8) << frameMs << "  " << std::setw(9) << instanceUpdateMs / measuredFrames
+			<< "  " << std::setw(12) << trianglesPerSecond / 1.0e6 << std::endl;
+
+		if (window != nullptr and glfwWindowShouldClose(window))
+		{
+			break;
+		}
+	}
+}
+
+void TriangleApplication::createUploadQueue()
+{
+	TraceZone zone(tracer, "createUploadQueue");
+	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+	uint32_t graphicsFamily = indices.graphicFamliy.value();
+
+	uploadQueue.init(logicalDevice, gpuAllocator, transferQueue, indices.transferFamily.value_or(graphicsFamily), graphicQueue, graphicsFamily);
+	std::cout << "uploads run on " << (uploadQueue.hasDedicatedQueue() ? "a dedicated transfer queue" : "the graphics queue") << std::endl;
+
+	if (config.streamMegabytes > 0)
+	{
+		// A synthetic asset trickled in alongside rendering, to show uploads don't hold frames back.
+		streamData.resize(static_cast<size_t>(config.streamMegabytes) << 20);
+		for (size_t i = 0; i < streamData.size(); i++)
+		{
+			streamData[i] = static_cast<char>(i * 31);
+		}
+
+		streamBuffer = gpuAllocator.createBuffer(streamData.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, streamAllocation);
+	}
+}
+
+void TriangleApplication::streamUploads()
+{
+	if (streamBuffer == VK_NULL_HANDLE or streamedBytes == streamData.size())
+	{
+		return;
+	}
+
+	if (streamedBytes == 0)
+	{
+		streamStart = std::chrono::steady_clock::now();
+	}
+
+	// Never waits for staging space: whatever doesn't fit this frame goes out with a later one.
+	streamedBytes += uploadQueue.uploadBuffer(streamBuffer, streamedBytes, streamData.data() + streamedBytes, streamData.size() - streamedBytes,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, false);
+	streamFrames++;
+
+	if (streamedBytes == streamData.size())
+	{
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - streamStart).count();
+		std::cout << "streamed " << config.streamMegabytes << " MiB over " << streamFrames << " frames in " << ms << " ms" << std::endl;
+	}
+}
+
+void TriangleApplication::allocateCommandBuffers()
+{
+	TraceZone zone(tracer, "allocateCommandBuffers");
+	/*
+	* Per swap chain image: a pool for the primary and one pool per recording task, each with one command buffer.
+	* The pools are created without VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, re-recording resets them
+	* as a whole which is cheaper than resetting buffers one by one.
+	*/
 	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+	uint32_t taskCount = jobSystem->threadCount();
 
 	VkCommandPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.flags = 0;
 	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicFamliy.value();
 
-	if (vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+	auto createPool = [&]() {
+		VkCommandPool pool;
+		if (vkCreateCommandPool(logicalDevice, &poolInfo, hostAllocator.callbacks(), &pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create command pool.");
+		}
+		return pool;
+	};
+
+	auto allocate = [this](VkCommandPool pool, VkCommandBufferLevel level) {
+		VkCommandBufferAllocateInfo commandBufferAllocInfo{};
+		commandBufferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		commandBufferAllocInfo.commandPool = pool;
+		/*
+		* VK_COMMAND_BUFFER_LEVEL_PRIMARY : Can be submitted to a queue for excution, but cannot be called from other command buffer.
+		* VK_COMMAND_BUFFER_LEVEL_SECONDARY: Cannot be submitted directly, but can be called from primary command buffers.
+		*/
+		commandBufferAllocInfo.level = level;
+		commandBufferAllocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate command buffer.");
+		}
+		return commandBuffer;
+	};
+
+	commandBufferCache.assign(swapChainImages.size(), CachedCommandBuffer{});
+	for (auto& cached : commandBufferCache)
 	{
-		throw std::runtime_error("failed to create command pool.");
+		cached.primaryPool = createPool();
+		cached.primary = allocate(cached.primaryPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+		for (uint32_t task = 0; task < taskCount; task++)
+		{
+			cached.taskPools.push_back(createPool());
+			cached.sceneCommands.push_back(allocate(cached.taskPools.back(), VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+		}
 	}
 }
 
-void TriangleApplication::allocateCommandBuffers()
+void TriangleApplication::destroyCommandPools(const CachedCommandBuffer& cached)
+{
+	vkDestroyCommandPool(logicalDevice, cached.primaryPool, hostAllocator.callbacks());
+	for (auto pool : cached.taskPools)
+	{
+		vkDestroyCommandPool(logicalDevice, pool, hostAllocator.callbacks());
+	}
+}
+
+void TriangleApplication::createSyncObjects()
+{
+	TraceZone zone(tracer, "createSyncObjects");
+	// Sized for the deepest queue, so the number of frames in flight can change without recreating anything.
+	imageAvaliableSemaphores.resize(FrameScheduler::MAX_FRAMES_IN_FLIGHT);
+	renderFinishedSemaphores.resize(FrameScheduler::MAX_FRAMES_IN_FLIGHT);
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	for (size_t i = 0; i < FrameScheduler::MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, hostAllocator.callbacks(), &imageAvaliableSemaphores[i]) != VK_SUCCESS ||
+			vkCreateSemaphore(logicalDevice, &semaphoreInfo, hostAllocator.callbacks(), &renderFinishedSemaphores[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create synchronization objects for a frame!");
+		}
+	}
+
+	frameScheduler.init(logicalDevice, config.framesInFlight, hostAllocator.callbacks());
+	deletionQueue.init(logicalDevice, hostAllocator.callbacks(), gpuAllocator, frameScheduler);
+}
+
+void TriangleApplication::runPacingSweep()
+{
+	/*
+	* Renders the same scene with 1 to MAX_FRAMES_IN_FLIGHT frames queued on the GPU. One frame in flight
+	* has the lowest latency but the CPU waits for every frame, a deeper queue hides CPU hiccups behind
+	* queued GPU work. Where the wait stops shrinking, more depth only adds latency.
+	*/
+	const uint32_t warmupFrames = 30;
+	const uint32_t measuredFrames = 300;
+
+	std::cout << "frames in flight  frame ms  wait ms  blocked %" << std::endl;
+
+	for (uint32_t depth = 1; depth <= FrameScheduler::MAX_FRAMES_IN_FLIGHT; depth++)
+	{
+		// Slots are reassigned, nothing may be in flight.
+		vkDeviceWaitIdle(logicalDevice);
+		frameScheduler.setFramesInFlight(depth);
+
+		for (uint32_t i = 0; i < warmupFrames; i++)
+		{
+			drawFrame();
+		}
+
+		// No idle here, the measured frames start with the queue as full as it gets.
+		frameScheduler.resetStatistics();
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < measuredFrames; i++)
+		{
+			if (window != nullptr)
+			{
+				glfwPollEvents();
+			}
+			drawFrame();
+		}
+		vkDeviceWaitIdle(logicalDevice);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		uint64_t frames = std::max<uint64_t>(frameScheduler.frameCount(), 1);
+		std::cout << std::setw(16) << depth << "  " << std::setw(8) << seconds * 1000.0 / measuredFrames
+			<< "  " << std::setw(7) << frameScheduler.waitMilliseconds() / frames
+			<< "  " << std::setw(9) << 100.0 * frameScheduler.blockedFrameCount() / frames << std::endl;
+
+		if (window != nullptr and glfwWindowShouldClose(window))
+		{
+			break;
+		}
+	}
+}
+
+void TriangleApplication::createTimestampQueries()
 {
-	commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	TraceZone zone(tracer, "createTimestampQueries");
+	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	// timestampValidBits == 0 means the queue can't write timestamps at all.
+	uint32_t validBits = queueFamilies[indices.graphicFamliy.value()].timestampValidBits;
+	if (validBits == 0 or properties.limits.timestampPeriod == 0.0f)
+	{
+		std::cout << "GPU timestamps are not supported on the graphics queue, only CPU phases will be measured." << std::endl;
+		return;
+	}
+
+	timestampPeriod = properties.limits.timestampPeriod;
+	timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+	timestampFrames.assign(FrameScheduler::MAX_FRAMES_IN_FLIGHT, std::nullopt);
+
+	VkQueryPoolCreateInfo queryPoolInfo{};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = 2 * FrameScheduler::MAX_FRAMES_IN_FLIGHT;
+
+	if (vkCreateQueryPool(logicalDevice, &queryPoolInfo, hostAllocator.callbacks(), &timestampQueryPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create timestamp query pool.");
+	}
+
+	/*
+	* The begin/end timestamps never change for a frame in flight, so they're recorded once and submitted
+	* around the frame's cached command buffer: [begin timestamp] [frame] [end timestamp].
+	*/
+	timestampCommandBuffers.resize(2 * FrameScheduler::MAX_FRAMES_IN_FLIGHT);
 
 	VkCommandBufferAllocateInfo commandBufferAllocInfo{};
 	commandBufferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	commandBufferAllocInfo.commandPool = commandPool;
+	commandBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocInfo.commandBufferCount = static_cast<uint32_t>(timestampCommandBuffers.size());
+
+	if (vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocInfo, timestampCommandBuffers.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate timestamp command buffers.");
+	}
+
+	for (uint32_t i = 0; i < timestampCommandBuffers.size(); i++)
+	{
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+		if (vkBeginCommandBuffer(timestampCommandBuffers[i], &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to begin recording command buffers.");
+		}
+
+		// Queries must be reset before they can be written again, the pair belongs to one frame in flight.
+		bool isBegin = i % 2 == 0;
+		if (isBegin)
+		{
+			vkCmdResetQueryPool(timestampCommandBuffers[i], timestampQueryPool, i, 2);
+		}
+		vkCmdWriteTimestamp(timestampCommandBuffers[i], isBegin ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, i);
+
+		if (vkEndCommandBuffer(timestampCommandBuffers[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to end command buffer");
+		}
+	}
+}
+
+void TriangleApplication::collectTimestamps(uint32_t frame)
+{
+	if (timestampQueryPool == VK_NULL_HANDLE or !timestampFrames[frame].has_value())
+	{
+		return;
+	}
+
+	// Only called once the frame has completed, so the results are available without waiting.
+	uint64_t timestamps[2] = {};
+	VkResult result = vkGetQueryPoolResults(logicalDevice, timestampQueryPool, 2 * frame, 2, sizeof(timestamps), timestamps,
+		sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+	if (result == VK_SUCCESS)
+	{
+		uint64_t ticks = ((timestamps[1] & timestampMask) - (timestamps[0] & timestampMask)) & timestampMask;
+		benchmark->setGpuTime(timestampFrames[frame].value(), ticks * timestampPeriod / 1.0e6);
+	}
+
+	timestampFrames[frame].reset();
+}
+
+void TriangleApplication::reportBenchmark()
+{
+	if (!benchmark)
+	{
+		return;
+	}
+
+	// Called after vkDeviceWaitIdle, pick up the frames that were still in flight.
+	for (uint32_t i = 0; i < FrameScheduler::MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		collectTimestamps(i);
+	}
+
+	benchmark->printSummary(std::cout);
+	if (!config.benchOutput.empty())
+	{
+		benchmark->writeReport(config.benchOutput);
+		std::cout << "benchmark report written to " << config.benchOutput << std::endl;
+	}
+}
+
+void TriangleApplication::createOverdrawQueries()
+{
+	TraceZone zone(tracer, "createOverdrawQueries");
+	if (!pipelineStatisticsEnabled)
+	{
+		std::cout << "pipeline statistics queries are not supported, overdraw is not counted." << std::endl;
+		return;
+	}
+
 	/*
-	* VK_COMMAND_BUFFER_LEVEL_PRIMARY : Can be submitted to a queue for excution, but cannot be called from other command buffer.
-	* VK_COMMAND_BUFFER_LEVEL_SECONDARY: Cannot be submitted directly, but can be called from primary command buffers.
+	* Fragment shader invocations over the pixels covered: 1.0 means every pixel was shaded once.
+	* Fragments rejected by an early depth test are not invoked, so this shows directly what the depth sort saves.
 	*/
-	commandBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	commandBufferAllocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+	VkQueryPoolCreateInfo queryPoolInfo{};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	queryPoolInfo.queryCount = static_cast<uint32_t>(swapChainImages.size());
+	queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
 
-	if (vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocInfo, commandBuffers.data()) != VK_SUCCESS)
+	if (vkCreateQueryPool(logicalDevice, &queryPoolInfo, hostAllocator.callbacks(), &overdrawQueryPool) != VK_SUCCESS)
 	{
-		throw std::runtime_error("failed to allocate command buffer.");
+		throw std::runtime_error("failed to create overdraw query pool.");
 	}
+	overdrawQueryCount = queryPoolInfo.queryCount;
+	overdrawPending.assign(swapChainImages.size(), false);
 }
 
-void TriangleApplication::createSyncObjects()
+void TriangleApplication::collectOverdraw(uint32_t imageIndex)
 {
-	imageAvaliableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-	
-	VkSemaphoreCreateInfo semaphoreInfo{};
-	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	if (!overdrawPending[imageIndex])
+	{
+		return;
+	}
 
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	// Only called once the image's frame has completed, the result is there without waiting. Statistics come in the order of their bits.
+	uint64_t statistics[2] = {};
+	VkResult result = vkGetQueryPoolResults(logicalDevice, overdrawQueryPool, imageIndex, 1, sizeof(statistics), statistics,
+		sizeof(statistics), VK_QUERY_RESULT_64_BIT);
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	if (result == VK_SUCCESS)
 	{
-		if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &imageAvaliableSemaphores[i]) != VK_SUCCESS ||
-			vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-			vkCreateFence(logicalDevice, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create synchronization objects for a frame!");
-		}
+		overdrawTriangles += statistics[0];
+		overdrawFragments += statistics[1];
+		overdrawPixels += static_cast<uint64_t>(swapchainExtent.width) * swapchainExtent.height;
+		overdrawFrames++;
+	}
+	overdrawPending[imageIndex] = false;
+}
+
+void TriangleApplication::printOverdrawSummary()
+{
+	if (overdrawQueryPool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// Called after vkDeviceWaitIdle, pick up the frames that were still in flight.
+	for (uint32_t i = 0; i < overdrawPending.size(); i++)
+	{
+		collectOverdraw(i);
+	}
+	if (overdrawFrames == 0)
+	{
+		return;
 	}
 
+	std::cout << "overdraw: " << static_cast<double>(overdrawFragments) / overdrawPixels << " fragment shader invocations per pixel, "
+		<< overdrawFragments / overdrawFrames << " per frame (" << overdrawFrames << " frames, "
+		<< (config.depthSort and !gpuDriven ? "sorted front to back" : "unsorted") << ")" << std::endl;
+	if (drawSorts > 0)
+	{
+		std::cout << "draw sort: " << drawSortMs / drawSorts << " ms per frame for " << instanceCount << " instances, "
+			<< drawSorter.lastPassCount() << " radix passes" << std::endl;
+	}
 }
 
 VkResult TriangleApplication::createDebugMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger)
@@ -652,6 +2956,7 @@ VkResult TriangleApplication::createDebugMessengerEXT(VkInstance instance, const
 
 void TriangleApplication::setupDebugMessenger()
 {
+	TraceZone zone(tracer, "setupDebugMessenger");
 	if (!enableLayerValidation)
 	{
 		return;
@@ -660,7 +2965,7 @@ void TriangleApplication::setupDebugMessenger()
 	VkDebugUtilsMessengerCreateInfoEXT createInfo;
 	generateDebugMessengerCreateInfoEXT(createInfo);
 
-	VkResult result = createDebugMessengerEXT(instance, &createInfo, nullptr, &debugMessenger);
+	VkResult result = createDebugMessengerEXT(instance, &createInfo, hostAllocator.callbacks(), &debugMessenger);
 	if ( result != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to set up debug messenger.");
@@ -671,6 +2976,7 @@ void TriangleApplication::setupDebugMessenger()
 
 void TriangleApplication::pickPhysicalDevice()
 {
+	TraceZone zone(tracer, "pickPhysicalDevice");
 	uint32_t deviciesCount;
 	vkEnumeratePhysicalDevices(instance, &deviciesCount, nullptr);
 
@@ -685,6 +2991,7 @@ void TriangleApplication::pickPhysicalDevice()
 
 	for(VkPhysicalDevice device : devicies)
 	{
+		TraceZone suitabilityZone(tracer, "isDeviceSuitable");
 		if (isDeviceSuitable(device))
 		{
 			physicalDevice = device;
@@ -711,14 +3018,38 @@ bool TriangleApplication::isDeviceSuitable(VkPhysicalDevice& device)
 	QueueFamilyIndices indices = findQueueFamilies(device);
 	bool isExtensionSupport = checkDeviceExtensionsSupport(device);
 
-	bool swapChainAdequate = false;
-	if (isExtensionSupport)
+	// Without a surface there is no swap chain to be adequate for.
+	bool swapChainAdequate = config.headless;
+	if (isExtensionSupport and !config.headless)
 	{
 		SwapChainSupportDetails details = querySwapchainSupport(device);
 		swapChainAdequate = !details.formats.empty() and !details.presentMode.empty();
 	}
 
-	return indices.isComplete() and isExtensionSupport and swapChainAdequate;
+	/*
+	* Frame pacing needs timeline semaphores and the bindless set descriptor indexing, both are core
+	* (and the feature struct is valid) from Vulkan 1.2 on.
+	*/
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device, &properties);
+	bool timelineSupported = false;
+	bool descriptorIndexingSupported = false;
+	if (properties.apiVersion >= VK_API_VERSION_1_2)
+	{
+		VkPhysicalDeviceVulkan12Features vulkan12Features{};
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &vulkan12Features;
+		vkGetPhysicalDeviceFeatures2(device, &features);
+		timelineSupported = vulkan12Features.timelineSemaphore;
+		descriptorIndexingSupported = vulkan12Features.runtimeDescriptorArray and vulkan12Features.descriptorBindingPartiallyBound
+			and vulkan12Features.descriptorBindingUpdateUnusedWhilePending and vulkan12Features.descriptorBindingSampledImageUpdateAfterBind
+			and vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind;
+	}
+
+	return indices.isComplete(!config.headless) and isExtensionSupport and swapChainAdequate and timelineSupported
+		and descriptorIndexingSupported;
 }
 
 bool TriangleApplication::checkValidationLayerSupport()
@@ -768,7 +3099,8 @@ bool TriangleApplication::checkDeviceExtensionsSupport(VkPhysicalDevice device)
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionsCount, avaliableExtensions.data());
 
 	int supportExtensionsCount = 0;
-	std::vector<std::string> requiredExtensions(deviceExensions.begin(), deviceExensions.end());
+	std::vector<const char*> deviceExtensions = getRequiredDeviceExtensions();
+	std::vector<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 	for (const auto& avaliableExtension : avaliableExtensions)
 	{
 		std::string name = avaliableExtension.extensionName;
@@ -782,6 +3114,18 @@ bool TriangleApplication::checkDeviceExtensionsSupport(VkPhysicalDevice device)
 	return supportExtensionsCount == requiredExtensions.size();
 }
 
+bool TriangleApplication::hasDeviceExtension(VkPhysicalDevice device, const char* name)
+{
+	uint32_t extensionsCount;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionsCount, nullptr);
+
+	std::vector<VkExtensionProperties> avaliableExtensions(extensionsCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionsCount, avaliableExtensions.data());
+
+	return std::any_of(avaliableExtensions.begin(), avaliableExtensions.end(),
+		[name](const VkExtensionProperties& extension) { return std::strcmp(extension.extensionName, name) == 0; });
+}
+
 QueueFamilyIndices TriangleApplication::findQueueFamilies(VkPhysicalDevice& device)
 {
 	QueueFamilyIndices indices;
@@ -799,7 +3143,9 @@ QueueFamilyIndices TriangleApplication::findQueueFamilies(VkPhysicalDevice& devi
 		{
 			indices.graphicFamliy = i;
 		}
-		else 
+
+		// The graphics family usually supports presentation too (e.g. lavapipe only exposes one family).
+		if (!config.headless)
 		{
 			VkBool32 presentSupport = false;
 			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
@@ -809,13 +3155,27 @@ QueueFamilyIndices TriangleApplication::findQueueFamilies(VkPhysicalDevice& devi
 			}
 		}
 
-
-		if (indices.isComplete())
+		if (indices.isComplete(!config.headless))
 		{
 			break;
 		}
 	}
 
+	/*
+	* A family with transfer but no graphics support usually maps to the copy (DMA) engines,
+	* which run uploads alongside rendering. Prefer one without compute as well, it's the purest copy engine.
+	*/
+	for (VkQueueFlags excluded : { VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT })
+	{
+		for (uint32_t i = 0; i < queueFamilies.size() and !indices.transferFamily.has_value(); i++)
+		{
+			if ((queueFamilies[i].queueFlags & VK_QUEUE_TRANSFER_BIT) and !(queueFamilies[i].queueFlags & excluded))
+			{
+				indices.transferFamily = i;
+			}
+		}
+	}
+
 	return indices;
 }
 
@@ -833,7 +3193,11 @@ std::vector<const char*> TriangleApplication::getRequiredExtentions()
 	uint32_t glfwExtensionsCount = 0;
 	const char** glfwExtensions = nullptr;
 
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionsCount);
+	// Headless mode never initializes GLFW and needs no surface extensions.
+	if (!config.headless)
+	{
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionsCount);
+	}
 	
 	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionsCount);
 	if (enableLayerValidation)
@@ -844,6 +3208,16 @@ std::vector<const char*> TriangleApplication::getRequiredExtentions()
 	return extensions;
 }
 
+std::vector<const char*> TriangleApplication::getRequiredDeviceExtensions()
+{
+	if (config.headless)
+	{
+		return {};
+	}
+
+	return deviceExensions;
+}
+
 SwapChainSupportDetails TriangleApplication::querySwapchainSupport(VkPhysicalDevice device)
 {
 	SwapChainSupportDetails details;
@@ -887,13 +3261,7 @@ VkSurfaceFormatKHR TriangleApplication::chooseSwapSurfaceFormat(const std::vecto
 
 VkPresentModeKHR TriangleApplication::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& avaliableModes)
 {
-	for (const auto& mode : avaliableModes)
-	{
-		if (mode == VK_PRESENT_MODE_MAILBOX_KHR)
-			return mode;
-	}
-
-	return VK_PRESENT_MODE_FIFO_KHR;
+	return presentPacer.choosePresentMode(avaliableModes);
 }
 
 VkExtent2D TriangleApplication::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities)
@@ -947,7 +3315,7 @@ void TriangleApplication::recordCommandBuffer(VkCommandBuffer commandBuffer, uin
 {
 	VkCommandBufferBeginInfo beginInfo{};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = 0;
+	beginInfo.flags = 0; // no ONE_TIME_SUBMIT, the buffer is replayed every time this image comes around
 	beginInfo.pInheritanceInfo = nullptr;
 
 	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
@@ -955,24 +3323,219 @@ void TriangleApplication::recordCommandBuffer(VkCommandBuffer commandBuffer, uin
 		throw std::runtime_error("failed to begin recording command buffers.");
 	}
 
-	VkRenderPassBeginInfo renderPassBeginInfo{};
-	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassBeginInfo.renderPass = renderPass;
-	renderPassBeginInfo.framebuffer = swapchainFrameBuffers[imageIndex];
-	renderPassBeginInfo.renderArea.offset = { 0, 0 };
-	renderPassBeginInfo.renderArea.extent = swapchainExtent;
+	// Compute can't run inside a render pass, so the culling goes first.
+	if (gpuDriven)
+	{
+		recordCulling(commandBuffer, imageIndex);
+	}
+
+	const CachedCommandBuffer& cached = commandBufferCache[imageIndex];
+	VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
+
+	// Counts the fragment shader invocations of this image's rendering, the query is reset on every replay.
+	if (overdrawQueryPool != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(commandBuffer, overdrawQueryPool, imageIndex, 1);
+		vkCmdBeginQuery(commandBuffer, overdrawQueryPool, imageIndex, 0);
+	}
+
+	if (dynamicRendering)
+	{
+		recordDynamicRendering(commandBuffer, imageIndex, clearColor);
+	}
+	else
+	{
+		VkRenderPassBeginInfo renderPassBeginInfo{};
+		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.framebuffer = swapchainFrameBuffers[imageIndex];
+		renderPassBeginInfo.renderArea.offset = { 0, 0 };
+		renderPassBeginInfo.renderArea.extent = swapchainExtent;
+
+		/*
+		* These two parameters define the clear values to use for VK_ATTACHMENT_LOAD_OP_CLEAR,
+		* which we used as load operation for the color and depth attachments. Indexed by attachment,
+		* the resolve attachment's entry is ignored.
+		*/
+		VkClearValue clearValues[3] = { clearColor, clearColor };
+		uint32_t depthAttachment = msaaImages.empty() ? 1 : 2;
+		clearValues[depthAttachment].depthStencil = { 1.0f, 0 };
+		renderPassBeginInfo.clearValueCount = depthAttachment + 1;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		// The contents of the subpass come from the secondary command buffer holding the static scene.
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		vkCmdExecuteCommands(commandBuffer, cached.recordedTasks, cached.sceneCommands.data());
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	if (overdrawQueryPool != VK_NULL_HANDLE)
+	{
+		vkCmdEndQuery(commandBuffer, overdrawQueryPool, imageIndex);
+	}
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to end command buffer");
+	}
+}
 
+void TriangleApplication::recordDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, const VkClearValue& clearColor)
+{
 	/*
-	* These two parameters define the clear values to use for VK_ATTACHMENT_LOAD_OP_CLEAR, 
-	* which we used as load operation for the color attachment.
+	* What the render pass did implicitly: UNDEFINED to COLOR_ATTACHMENT_OPTIMAL before rendering (the old contents
+	* are cleared anyway), then on to the layout of the image's next user.
+	* The first barrier waits on COLOR_ATTACHMENT_OUTPUT, the stage the submit waits for the acquire semaphore at,
+	* which orders the transition after the presentation engine let go of the image.
+	* The MSAA target takes the same first transition, its old contents are never needed either.
+	* Depth goes from UNDEFINED to its attachment layout after the last depth writes to it.
 	*/
-	VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
-	renderPassBeginInfo.clearValueCount = 1;
-	renderPassBeginInfo.pClearValues = &clearColor;
+	bool multisampled = !msaaImages.empty();
+	VkImageMemoryBarrier2KHR barriers[4]{};
+	for (VkImageMemoryBarrier2KHR& barrier : barriers)
+	{
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = swapChainImages[imageIndex];
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	}
+
+	barriers[0].srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR;
+	barriers[0].srcAccessMask = VK_ACCESS_2_NONE_KHR;
+	barriers[0].dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR;
+	barriers[0].dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	barriers[1].srcStageMask = VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR;
+	barriers[1].srcAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR;
+	barriers[1].dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR;
+	barriers[1].dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[1].image = depthImages[imageIndex];
+	barriers[1].subresourceRange.aspectMask = depthAspectMask();
+
+	if (multisampled)
+	{
+		barriers[2] = barriers[0];
+		barriers[2].image = msaaImages[imageIndex];
+	}
+
+	// Presentation waits on the render finished semaphore, and nothing reads offscreen targets in this queue yet.
+	barriers[3].srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR;
+	barriers[3].srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR;
+	barriers[3].dstStageMask = VK_PIPELINE_STAGE_2_NONE_KHR;
+	barriers[3].dstAccessMask = VK_ACCESS_2_NONE_KHR;
+	barriers[3].oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	barriers[3].newLayout = config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkDependencyInfoKHR dependencyInfo{};
+	dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+	dependencyInfo.imageMemoryBarrierCount = multisampled ? 3 : 2;
+	dependencyInfo.pImageMemoryBarriers = &barriers[0];
+	cmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+	VkRenderingAttachmentInfoKHR colorAttachment{};
+	colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+	colorAttachment.imageView = swapchainImageViews[imageIndex];
+	colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.clearValue = clearColor;
+
+	// Render into the MSAA target and resolve into the image when rendering ends, the samples themselves are dropped.
+	if (multisampled)
+	{
+		colorAttachment.imageView = msaaImageViews[imageIndex];
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+		colorAttachment.resolveImageView = swapchainImageViews[imageIndex];
+		colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	}
+
+	VkRenderingAttachmentInfoKHR depthAttachment{};
+	depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+	depthAttachment.imageView = depthImageViews[imageIndex];
+	depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.clearValue.depthStencil = { 1.0f, 0 };
+
+	VkRenderingInfoKHR renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+	renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT_KHR;	// the scene comes from the secondaries
+	renderingInfo.renderArea.offset = { 0, 0 };
+	renderingInfo.renderArea.extent = swapchainExtent;
+	renderingInfo.layerCount = 1;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachments = &colorAttachment;
+	renderingInfo.pDepthAttachment = &depthAttachment;
+
+	const CachedCommandBuffer& cached = commandBufferCache[imageIndex];
+	cmdBeginRendering(commandBuffer, &renderingInfo);
+	vkCmdExecuteCommands(commandBuffer, cached.recordedTasks, cached.sceneCommands.data());
+	cmdEndRendering(commandBuffer);
+
+	dependencyInfo.imageMemoryBarrierCount = 1;
+	dependencyInfo.pImageMemoryBarriers = &barriers[3];
+	cmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+}
+
+void TriangleApplication::recordSceneCommands(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t firstDraw, uint32_t endDraw)
+{
+	// With dynamic rendering the secondaries are told the attachment formats instead of a render pass.
+	VkCommandBufferInheritanceRenderingInfoKHR renderingInheritance{};
+	renderingInheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO_KHR;
+	renderingInheritance.colorAttachmentCount = 1;
+	renderingInheritance.pColorAttachmentFormats = &swapchainFormat;
+	renderingInheritance.depthAttachmentFormat = depthFormat;
+	renderingInheritance.rasterizationSamples = msaaSamples;
+
+	VkCommandBufferInheritanceInfo inheritanceInfo{};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.subpass = 0;
+	// Executed while the primary's overdraw query is active, the secondaries have to declare the statistics it counts.
+	if (overdrawQueryPool != VK_NULL_HANDLE)
+	{
+		inheritanceInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+	}
+	if (dynamicRendering)
+	{
+		inheritanceInfo.pNext = &renderingInheritance;
+	}
+	else
+	{
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.framebuffer = swapchainFrameBuffers[imageIndex]; // optional, but lets the driver specialize for the target
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT; // executed entirely inside a render pass
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to begin recording command buffers.");
+	}
 
-	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// The binding benchmark swaps in a pipeline that takes a descriptor set per draw, see runBindingBenchmark().
+	bool perDrawSets = perDrawPipeline != VK_NULL_HANDLE;
+	VkPipelineLayout layout = perDrawSets ? perDrawPipelineLayout : pipelineLayout;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, perDrawSets ? perDrawPipeline : pipeline);
+	if (!perDrawSets)
+	{
+		// Bound once for the whole command buffer, the draws only push the index of their material.
+		VkDescriptorSet bindlessSet = bindless.set();
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &bindlessSet, 0, nullptr);
+	}
 
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	// The uniforms are bound once as well, at the frame's offsets. The draws index the DrawUniforms array with their push constant.
+	const CachedCommandBuffer& cached = commandBufferCache[imageIndex];
+	uint32_t dynamicOffsets[] = { cached.frameUniformOffset, cached.drawUniformOffset };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &uniformDescriptorSet, 2, dynamicOffsets);
 
 	VkViewport viewport{};
 	viewport.x = 0.0f;
@@ -988,8 +3551,33 @@ void TriangleApplication::recordCommandBuffer(VkCommandBuffer commandBuffer, uin
 	scissor.extent = swapchainExtent;
 	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
-	vkCmdEndRenderPass(commandBuffer);
+	VkBuffer vertexBuffers[] = { vertexBuffer, instanceBuffer };
+	VkDeviceSize offsets[] = { 0, imageIndex * instanceRegionSize };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+
+	// Secondaries inherit no state, so every task binds the pipeline, the buffers and sets the dynamic state itself.
+	for (uint32_t draw = firstDraw; draw < endDraw; draw++)
+	{
+		uint32_t material = draw % MATERIAL_COUNT;
+		// Every per-draw set holds a single material, at index 0.
+		DrawConstants constants{ perDrawSets ? 0 : materialIndices[material], draw };
+		if (perDrawSets)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, perDrawPipelineLayout, 0, 1, &perDrawDescriptorSets[material], 0, nullptr);
+		}
+		vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants), &constants);
+
+		if (!gpuDriven)
+		{
+			vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), instanceCount, 0, 0, 0);
+		}
+		else
+		{
+			// The culling pass compacted the visible instances into the image's region and counted them into the draw.
+			vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, imageIndex * 256ull, 1, sizeof(VkDrawIndexedIndirectCommand));
+		}
+	}
 
 	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
 	{
@@ -997,6 +3585,303 @@ void TriangleApplication::recordCommandBuffer(VkCommandBuffer commandBuffer, uin
 	}
 }
 
+void TriangleApplication::prepareCommandBuffer(uint32_t imageIndex)
+{
+	CachedCommandBuffer& cached = commandBufferCache[imageIndex];
+
+	/*
+	* A command buffer without SIMULTANEOUS_USE can't be submitted again (or re-recorded) while it's pending,
+	* and the image may have been acquired before the last frame rendering into it has finished.
+	*/
+	frameScheduler.wait(cached.frameValue);
+	cached.frameValue = frameScheduler.frameValue();
+
+	// The image's last frame has completed, so has its overdraw query. This frame reuses it.
+	if (overdrawQueryPool != VK_NULL_HANDLE)
+	{
+		collectOverdraw(imageIndex);
+		overdrawPending[imageIndex] = true;
+	}
+
+	// Before recording, which bakes the offsets the uniforms were allocated at into the commands.
+	writeUniforms(imageIndex, gpuDriven ? 1 : config.drawCount);
+
+	if (config.commandBufferCache and cached.sceneVersion == sceneVersion)
+	{
+		commandBufferReplays++;
+		return;
+	}
+
+	recordFrameCommands(imageIndex, jobSystem->threadCount());
+
+	cached.sceneVersion = sceneVersion;
+	commandBufferRecords++;
+}
+
+void TriangleApplication::recordFrameCommands(uint32_t imageIndex, uint32_t taskCount)
+{
+	CachedCommandBuffer& cached = commandBufferCache[imageIndex];
+	// A GPU-driven frame is a single indirect draw, there is nothing to split across tasks.
+	uint32_t drawCount = gpuDriven ? 1 : config.drawCount;
+	taskCount = std::clamp(taskCount, 1u, std::min(drawCount, static_cast<uint32_t>(cached.sceneCommands.size())));
+
+	vkResetCommandPool(logicalDevice, cached.primaryPool, 0);
+	for (uint32_t task = 0; task < taskCount; task++)
+	{
+		vkResetCommandPool(logicalDevice, cached.taskPools[task], 0);
+	}
+
+	// Task i records draws [begin, end) into secondary i, which only it touches, so no locking is needed.
+	jobSystem->parallelFor(drawCount, taskCount, [this, &cached, imageIndex](uint32_t task, uint32_t begin, uint32_t end) {
+		recordSceneCommands(cached.sceneCommands[task], imageIndex, begin, end);
+	});
+
+	cached.recordedTasks = taskCount;
+	recordCommandBuffer(cached.primary, imageIndex);
+}
+
+void TriangleApplication::runRecordingBenchmark()
+{
+	/*
+	* Re-records the commands of image 0 with an increasing number of tasks. Nothing is submitted,
+	* so this measures pure CPU recording cost: thread fan-out, vkCmd* calls and the primary stitching.
+	*/
+	const uint32_t iterations = 50;
+	uint32_t maxTasks = std::min(jobSystem->threadCount(), config.drawCount);
+
+	std::cout << "recording " << config.drawCount << " draws, " << iterations << " iterations per thread count" << std::endl;
+	std::cout << "threads  record ms  speedup" << std::endl;
+
+	vkDeviceWaitIdle(logicalDevice);
+	writeUniforms(0, config.drawCount);
+
+	double singleThreadMs = 0.0;
+	for (uint32_t tasks = 1; tasks <= maxTasks; tasks = (tasks == maxTasks ? maxTasks + 1 : std::min(tasks * 2, maxTasks)))
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			recordFrameCommands(0, tasks);
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+		if (tasks == 1)
+		{
+			singleThreadMs = ms;
+		}
+		std::cout << std::setw(7) << tasks << "  " << std::setw(9) << ms << "  " << std::setw(7) << singleThreadMs / ms << std::endl;
+	}
+
+	// Leave the cache entry in a state the main loop would re-record anyway.
+	commandBufferCache[0].sceneVersion = 0;
+}
+
+void TriangleApplication::runBindingBenchmark()
+{
+	/*
+	* Records the scene of image 0 into a single secondary, once with the bindless set (one bind, a push constant
+	* per draw) and once the classic way, binding a descriptor set per draw. The baseline uses the same shaders
+	* and draws, its sets hold just the draw's material. Both bind the uniforms once and push the draw's constants.
+	* Nothing is submitted, this measures recording cost on the CPU.
+	*/
+	const uint32_t iterations = 20;
+	uint32_t drawCount = std::max(config.drawCount, MIN_BINDING_BENCHMARK_DRAWS);
+
+	vkDeviceWaitIdle(logicalDevice);
+	writeUniforms(0, drawCount);
+	createPerDrawDescriptorSets();
+
+	CachedCommandBuffer& cached = commandBufferCache[0];
+	VkPipeline baselinePipeline = perDrawPipeline;
+	auto timeRecording = [&](bool perDraw) {
+		perDrawPipeline = perDraw ? baselinePipeline : VK_NULL_HANDLE;
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			vkResetCommandPool(logicalDevice, cached.taskPools[0], 0);
+			recordSceneCommands(cached.sceneCommands[0], 0, 0, drawCount);
+		}
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+	};
+
+	// The bindless run first, so the baseline doesn't benefit from a warm cache.
+	timeRecording(false);
+	double bindlessMs = timeRecording(false);
+	double perDrawMs = timeRecording(true);
+
+	std::cout << "recording " << drawCount << " draws, " << iterations << " iterations" << std::endl;
+	std::cout << "binding          record ms  ns per draw" << std::endl;
+	std::cout << "bindless         " << std::setw(9) << bindlessMs << "  " << std::setw(11) << bindlessMs * 1.0e6 / drawCount << std::endl;
+	std::cout << "per-draw sets    " << std::setw(9) << perDrawMs << "  " << std::setw(11) << perDrawMs * 1.0e6 / drawCount << std::endl;
+
+	perDrawPipeline = baselinePipeline;
+	destroyPerDrawDescriptorSets();
+
+	// Leave the cache entry in a state the main loop would re-record anyway.
+	cached.sceneVersion = 0;
+}
+
+void TriangleApplication::createPerDrawDescriptorSets()
+{
+	/*
+	* The classic binding model for runBindingBenchmark(): a small set per material, laid out like the bindless set
+	* with one element per array. The texture element is never written, PARTIALLY_BOUND allows that.
+	*/
+	VkDescriptorSetLayoutBinding bindings[2]{};
+	bindings[0].binding = BindlessDescriptors::TEXTURE_BINDING;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	bindings[1].binding = BindlessDescriptors::BUFFER_BINDING;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorBindingFlags bindingFlags[2] = { VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT, 0 };
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+	bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsInfo.bindingCount = 2;
+	bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = &bindingFlagsInfo;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, hostAllocator.callbacks(), &perDrawSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create per-draw descriptor set layout.");
+	}
+
+	// Set 1 stays the uniforms, only the resource set differs from the regular layout.
+	VkDescriptorSetLayout setLayouts[] = { perDrawSetLayout, uniformSetLayout };
+	VkPushConstantRange pushConstantRange = drawConstantRange();
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 2;
+	pipelineLayoutInfo.pSetLayouts = setLayouts;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, hostAllocator.callbacks(), &perDrawPipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create per-draw pipeline layout.");
+	}
+	perDrawPipeline = compilePipelineVariant(PipelineVariantKey{}, perDrawPipelineLayout, vertexShaderModule, fragmentShaderModule,
+		renderPass, swapchainFormat);
+
+	VkDescriptorPoolSize poolSizes[2] = {
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MATERIAL_COUNT },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, MATERIAL_COUNT },
+	};
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = MATERIAL_COUNT;
+	poolInfo.poolSizeCount = 2;
+	poolInfo.pPoolSizes = poolSizes;
+
+	if (vkCreateDescriptorPool(logicalDevice, &poolInfo, hostAllocator.callbacks(), &perDrawDescriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create per-draw descriptor pool.");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(MATERIAL_COUNT, perDrawSetLayout);
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = perDrawDescriptorPool;
+	allocInfo.descriptorSetCount = MATERIAL_COUNT;
+	allocInfo.pSetLayouts = layouts.data();
+
+	perDrawDescriptorSets.resize(MATERIAL_COUNT);
+	if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, perDrawDescriptorSets.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate per-draw descriptor sets.");
+	}
+
+	// Set i sees material i, laid out as in createMaterials().
+	std::vector<VkDescriptorBufferInfo> bufferInfos(MATERIAL_COUNT);
+	std::vector<VkWriteDescriptorSet> writes(MATERIAL_COUNT);
+	for (uint32_t i = 0; i < MATERIAL_COUNT; i++)
+	{
+		bufferInfos[i] = { materialBuffer, i * MATERIAL_STRIDE, 4 * sizeof(float) };
+
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = perDrawDescriptorSets[i];
+		writes[i].dstBinding = BindlessDescriptors::BUFFER_BINDING;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].pBufferInfo = &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(logicalDevice, MATERIAL_COUNT, writes.data(), 0, nullptr);
+}
+
+void TriangleApplication::destroyPerDrawDescriptorSets()
+{
+	// Destroying the pool frees its descriptor sets.
+	vkDestroyDescriptorPool(logicalDevice, perDrawDescriptorPool, hostAllocator.callbacks());
+	vkDestroyPipeline(logicalDevice, perDrawPipeline, hostAllocator.callbacks());
+	vkDestroyPipelineLayout(logicalDevice, perDrawPipelineLayout, hostAllocator.callbacks());
+	vkDestroyDescriptorSetLayout(logicalDevice, perDrawSetLayout, hostAllocator.callbacks());
+	perDrawDescriptorSets.clear();
+	perDrawDescriptorPool = VK_NULL_HANDLE;
+	perDrawPipeline = VK_NULL_HANDLE;
+	perDrawPipelineLayout = VK_NULL_HANDLE;
+	perDrawSetLayout = VK_NULL_HANDLE;
+}
+
+void TriangleApplication::createTextures()
+{
+	if (config.textureCount == 0)
+	{
+		return;
+	}
+
+	TraceZone zone(tracer, "createTextures");
+	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+	textureStreamer.init(physicalDevice, logicalDevice, indices.graphicFamliy.value(), gpuAllocator, bindless, deletionQueue,
+		*jobSystem, static_cast<VkDeviceSize>(config.textureBudgetMegabytes) << 20, memoryBudgetSupported);
+	for (uint32_t i = 0; i < config.textureCount; i++)
+	{
+		textureStreamer.addTexture(config.textureSize, i);
+	}
+	std::cout << "streaming " << config.textureCount << " textures of " << config.textureSize << "x" << config.textureSize << " within "
+		<< textureStreamer.budget() / (1 << 20) << " MB" << (memoryBudgetSupported ? " (VK_EXT_memory_budget)" : "") << std::endl;
+}
+
+uint32_t TriangleApplication::drawTexture(uint32_t draw) const
+{
+	return (draw + textureRotation) % config.textureCount;
+}
+
+VkCommandBuffer TriangleApplication::useTextures()
+{
+	if (config.textureCount == 0)
+	{
+		return VK_NULL_HANDLE;
+	}
+
+	/*
+	* An instance covers about instanceScale of the window's half of its longer side in pixels, and the texture spans it
+	* once: the mip whose size is closest above that is the finest one the sampler reads.
+	*/
+	float longerSide = static_cast<float>(std::max(swapchainExtent.width, swapchainExtent.height));
+	float pixels = std::max(1.0f, instanceScale * longerSide * 0.5f);
+	uint32_t level = static_cast<uint32_t>(std::max(0.0f, std::floor(std::log2(config.textureSize / pixels))));
+
+	// The draws move on to the next texture every second, so textures keep going out of use and coming back.
+	textureRotation = static_cast<uint32_t>(std::chrono::duration<float>(std::chrono::steady_clock::now() - animationStart).count());
+
+	uint32_t drawCount = gpuDriven ? 1 : config.drawCount;
+	for (uint32_t draw = 0; draw < drawCount; draw++)
+	{
+		textureStreamer.use(drawTexture(draw), level);
+	}
+	return textureStreamer.update(currentFrame);
+}
+
 void TriangleApplication::destroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator)
 {
 	auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
@@ -1012,42 +3897,132 @@ void TriangleApplication::destroyDebugUtilsMessengerEXT(VkInstance instance, VkD
 
 void TriangleApplication::cleanUp()
 {
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	TraceZone zone(tracer, "cleanUp");
+	for (size_t i = 0; i < FrameScheduler::MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		vkDestroySemaphore(logicalDevice, renderFinishedSemaphores[i], nullptr);
-		vkDestroySemaphore(logicalDevice, imageAvaliableSemaphores[i], nullptr);
-		vkDestroyFence(logicalDevice, inFlightFences[i], nullptr);
+		vkDestroySemaphore(logicalDevice, renderFinishedSemaphores[i], hostAllocator.callbacks());
+		vkDestroySemaphore(logicalDevice, imageAvaliableSemaphores[i], hostAllocator.callbacks());
+	}
+	frameScheduler.destroy();
+
+	if (timestampQueryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(logicalDevice, timestampQueryPool, hostAllocator.callbacks());
+	}
+	if (overdrawQueryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(logicalDevice, overdrawQueryPool, hostAllocator.callbacks());
 	}
-	
-	
-	vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
+
+	discardShaderReload();
+	pipelineVariants.waitForCompiles();
+	retireCompileInputs();
+	deletionQueue.flush();
+	// Before the job system goes, it waits for the decodes still running.
+	textureStreamer.destroy();
+
+	for (const auto& cached : commandBufferCache)
+	{
+		destroyCommandPools(cached);
+	}
+	vkDestroyCommandPool(logicalDevice, commandPool, hostAllocator.callbacks());
+	jobSystem.reset();
+
+	gpuAllocator.destroyBuffer(indexBuffer, indexBufferAllocation);
+	gpuAllocator.destroyBuffer(vertexBuffer, vertexBufferAllocation);
+	gpuAllocator.destroyBuffer(instanceBuffer, instanceAllocation);
+	if (gpuDriven)
+	{
+		gpuAllocator.destroyBuffer(sceneInstanceBuffer, sceneInstanceAllocation);
+		gpuAllocator.destroyBuffer(indirectBuffer, indirectAllocation);
+		gpuAllocator.destroyBuffer(cullFrameBuffer, cullFrameAllocation);
+		vkDestroyDescriptorPool(logicalDevice, cullDescriptorPool, hostAllocator.callbacks());
+		vkDestroyPipeline(logicalDevice, cullPipeline, hostAllocator.callbacks());
+		vkDestroyPipelineLayout(logicalDevice, cullPipelineLayout, hostAllocator.callbacks());
+		vkDestroyDescriptorSetLayout(logicalDevice, cullSetLayout, hostAllocator.callbacks());
+	}
+	if (streamBuffer != VK_NULL_HANDLE)
+	{
+		gpuAllocator.destroyBuffer(streamBuffer, streamAllocation);
+	}
+	gpuAllocator.destroyBuffer(materialBuffer, materialAllocation);
+	uniformRing.destroy();
+	vkDestroyDescriptorPool(logicalDevice, uniformDescriptorPool, hostAllocator.callbacks());
+	uploadQueue.destroy();
 
 	for (auto frameBuffer : swapchainFrameBuffers)
 	{
-		vkDestroyFramebuffer(logicalDevice, frameBuffer, nullptr);
+		vkDestroyFramebuffer(logicalDevice, frameBuffer, hostAllocator.callbacks());
+	}
+
+	pipelineVariants.destroy();
+	if (pipelineCache != VK_NULL_HANDLE)
+	{
+		savePipelineCache();
+		vkDestroyPipelineCache(logicalDevice, pipelineCache, hostAllocator.callbacks());
 	}
+	vkDestroyPipelineLayout(logicalDevice, pipelineLayout, hostAllocator.callbacks());
+	vkDestroyRenderPass(logicalDevice, renderPass, hostAllocator.callbacks());
+	bindless.destroy();
+	vkDestroyDescriptorSetLayout(logicalDevice, uniformSetLayout, hostAllocator.callbacks());
 
-	vkDestroyPipeline(logicalDevice, pipeline, nullptr);
-	vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
-	vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
+	// Loaded in initVkn() or by the last shader reload.
+	for (VkShaderModule module : { vertexShaderModule, fragmentShaderModule, cullShaderModule })
+	{
+		if (module != VK_NULL_HANDLE)
+		{
+			vkDestroyShaderModule(logicalDevice, module, hostAllocator.callbacks());
+		}
+	}
 
 	for (auto imgView : swapchainImageViews)
 	{
-		vkDestroyImageView(logicalDevice, imgView, nullptr);
+		vkDestroyImageView(logicalDevice, imgView, hostAllocator.callbacks());
 	}
 
-	vkDestroySwapchainKHR(logicalDevice, swapchain, nullptr);
-	vkDestroyDevice(logicalDevice, nullptr);
+	for (size_t i = 0; i < msaaImages.size(); i++)
+	{
+		vkDestroyImageView(logicalDevice, msaaImageViews[i], hostAllocator.callbacks());
+		vkDestroyImage(logicalDevice, msaaImages[i], hostAllocator.callbacks());
+		gpuAllocator.free(msaaImageAllocations[i]);
+	}
+	for (size_t i = 0; i < depthImages.size(); i++)
+	{
+		vkDestroyImageView(logicalDevice, depthImageViews[i], hostAllocator.callbacks());
+		vkDestroyImage(logicalDevice, depthImages[i], hostAllocator.callbacks());
+		gpuAllocator.free(depthImageAllocations[i]);
+	}
+
+	if (config.headless)
+	{
+		for (size_t i = 0; i < swapChainImages.size(); i++)
+		{
+			vkDestroyImage(logicalDevice, swapChainImages[i], hostAllocator.callbacks());
+			gpuAllocator.free(offscreenImageAllocations[i]);
+		}
+	}
+	else
+	{
+		vkDestroySwapchainKHR(logicalDevice, swapchain, hostAllocator.callbacks());
+	}
+	gpuAllocator.destroy();
+	vkDestroyDevice(logicalDevice, hostAllocator.callbacks());
 
 	if (enableLayerValidation)
 	{
-		destroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+		destroyDebugUtilsMessengerEXT(instance, debugMessenger, hostAllocator.callbacks());
 	}
 
 	// Make sure that the surface is destroyed before the instance.
-	vkDestroySurfaceKHR(instance, surface, nullptr);
-	vkDestroyInstance(instance, nullptr);
+	if (surface != VK_NULL_HANDLE)
+	{
+		vkDestroySurfaceKHR(instance, surface, hostAllocator.callbacks());
+	}
+	vkDestroyInstance(instance, hostAllocator.callbacks());
 	
-	glfwDestroyWindow(window);
-	glfwTerminate();
+	if (window != nullptr)
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
 }
\ No newline at end of file
@@ -9,22 +9,176 @@
 #include <cstring>
 #include <cstdlib>
 #include <cstdint>
+#include <cstddef>
 #include <iostream>
 #include <optional>
 #include <limits>
 #include <algorithm>
 #include <fstream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <filesystem>
+#include <cmath>
+#include <atomic>
+#include <string>
+
+#include "AppConfig.h"
+#include "HostAllocator.h"
+#include "FrameBenchmark.h"
+#include "FrameScheduler.h"
+#include "PresentPacer.h"
+#include "ShaderRegistry.h"
+#include "TraceProfiler.h"
+#include "JobSystem.h"
+#include "TaskGraph.h"
+#include "GpuAllocator.h"
+#include "UploadQueue.h"
+#include "DeletionQueue.h"
+#include "BindlessDescriptors.h"
+#include "UniformRing.h"
+#include "DrawSorter.h"
+#include "PipelineVariants.h"
+#include "ShaderWatcher.h"
+#include "TextureStreamer.h"
 
 struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicFamliy;
 	std::optional<uint32_t> presentationFamily;
+	std::optional<uint32_t> transferFamily;	// a family without graphics, only set when the device has one
+
+	// Headless rendering never presents, so it only needs a graphics family.
+	bool isComplete(bool requirePresentation = true)
+	{
+		return graphicFamliy.has_value() and (!requirePresentation or presentationFamily.has_value());
+	}
+};
+
+/*
+* A shader reload built by a background job: both shaders recompiled and the default pipeline variant created from them.
+* The job only writes to it until it sets done, then drawFrame() swaps the result in at the next frame boundary.
+*/
+struct ShaderReload {
+	std::atomic<bool> done{ false };
+	VkShaderModule vertexShaderModule = VK_NULL_HANDLE;
+	VkShaderModule fragmentShaderModule = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	std::string error;	// empty on success, the glslc output when a shader failed to compile
+	double buildMs = 0.0;
+};
+
+/*
+* Pre-recorded commands for one swap chain image. They are replayed as long as sceneVersion matches
+* the application's, and re-recorded when the scene changes. A new swap chain starts a fresh cache.
+* Every recording task owns a command pool, so tasks record in parallel without locking,
+* and re-recording resets the pools wholesale instead of resetting individual command buffers.
+*/
+struct CachedCommandBuffer {
+	VkCommandPool primaryPool = VK_NULL_HANDLE;
+	VkCommandBuffer primary = VK_NULL_HANDLE;			// render pass begin/end around sceneCommands
+	std::vector<VkCommandPool> taskPools;				// one per recording task
+	std::vector<VkCommandBuffer> sceneCommands;			// secondaries holding the draws of the subpass, one per task
+	uint32_t recordedTasks = 0;							// how many of sceneCommands the primary executes
+	uint64_t sceneVersion = 0;							// version recorded into the buffers, 0 = never recorded
+	uint64_t frameValue = 0;							// timeline value of the last frame that submitted them, 0 = none
+	uint32_t frameUniformOffset = 0;					// dynamic offsets of the image's constants in the uniform ring,
+	uint32_t drawUniformOffset = 0;						// and of the DrawUniforms array
+};
+
+// Per-frame constants, set 1 binding 0 of shader.vert (std140).
+struct FrameUniforms {
+	float view[4];	// x, y scale and offset from scene to clip space, the camera
+};
+
+// Pushed per draw, DrawConstants of shader.vert and shader.frag.
+struct DrawConstants {
+	uint32_t materialIndex;	// element of the bindless buffer array
+	uint32_t drawIndex;		// element of the frame's DrawUniforms array
+};
+
+// Per-draw constants, element DrawConstants::drawIndex of the array at set 1 binding 1 of shader.vert (std430).
+struct DrawUniforms {
+	float transform[4];	// x, y offset, scale and rotation of the whole draw, applied after the instance's
+	uint32_t texture;	// element of the bindless texture array, TextureStreamer::NO_TEXTURE for none
+	uint32_t padding[3];
+};
+
+struct Vertex {
+	float pos[2];
+	float color[3];
+
+	// One interleaved vertex buffer at binding 0, advanced per vertex.
+	static VkVertexInputBindingDescription getBindingDescription()
+	{
+		VkVertexInputBindingDescription bindingDescription{};
+		bindingDescription.binding = 0;
+		bindingDescription.stride = sizeof(Vertex);
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		return bindingDescription;
+	}
+
+	// Locations match the inputs of shader.vert.
+	static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions()
+	{
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions(2);
+		attributeDescriptions[0].binding = 0;
+		attributeDescriptions[0].location = 0;
+		attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+		attributeDescriptions[0].offset = offsetof(Vertex, pos);
+
+		attributeDescriptions[1].binding = 0;
+		attributeDescriptions[1].location = 1;
+		attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+		attributeDescriptions[1].offset = offsetof(Vertex, color);
+		return attributeDescriptions;
+	}
+};
+
+/*
+* Per-instance attributes at binding 1. The color is packed RGBA8 (R8G8B8A8_UNORM), which keeps an instance
+* at 24 bytes: the CPU rewrites the image's instances every frame, or cull.comp writes the visible ones.
+*/
+struct InstanceData {
+	float transform[4];	// x, y offset in clip space, scale, rotation in radians
+	uint32_t color;
+	float depth;		// clip space z, 0 is the near plane
+
+	static VkVertexInputBindingDescription getBindingDescription()
+	{
+		VkVertexInputBindingDescription bindingDescription{};
+		bindingDescription.binding = 1;
+		bindingDescription.stride = sizeof(InstanceData);
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+		return bindingDescription;
+	}
 
-	bool isComplete()
+	static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions()
 	{
-		return graphicFamliy.has_value() and presentationFamily.has_value();
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions(3);
+		attributeDescriptions[0].binding = 1;
+		attributeDescriptions[0].location = 2;
+		attributeDescriptions[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		attributeDescriptions[0].offset = offsetof(InstanceData, transform);
+
+		attributeDescriptions[1].binding = 1;
+		attributeDescriptions[1].location = 3;
+		attributeDescriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+		attributeDescriptions[1].offset = offsetof(InstanceData, color);
+
+		attributeDescriptions[2].binding = 1;
+		attributeDescriptions[2].location = 4;
+		attributeDescriptions[2].format = VK_FORMAT_R32_SFLOAT;
+		attributeDescriptions[2].offset = offsetof(InstanceData, depth);
+		return attributeDescriptions;
 	}
 };
 
+// The animation of a GPU-driven frame, binding 3 of cull.comp (std140).
+struct CullFrame {
+	float time;	// seconds since the animation started
+	float pan;	// x offset of the whole scene
+};
+
 struct SwapChainSupportDetails {
 	VkSurfaceCapabilitiesKHR capabilities;
 	std::vector<VkSurfaceFormatKHR> formats;
@@ -34,6 +188,9 @@ struct SwapChainSupportDetails {
 class TriangleApplication
 {
 public:
+	TriangleApplication() = default;
+	explicit TriangleApplication(const AppConfig& config);
+
 	void run();
 
 	/* Validation layer callbbcak
@@ -51,9 +208,14 @@ public:
 		);
 
 private:
+	AppConfig config;
+
 	const uint32_t HEIGHT = 600;
 	const uint32_t WIDTH  = 800;
-	const int MAX_FRAMES_IN_FLIGHT = 2;
+	const uint32_t MAX_SWEEP_INSTANCES = 10000000;
+	const uint32_t MIN_BINDING_BENCHMARK_DRAWS = 10000;
+	static constexpr uint32_t MATERIAL_COUNT = 1024;	// draw i uses material i % MATERIAL_COUNT
+	static constexpr VkDeviceSize MATERIAL_STRIDE = 256;	// the largest minStorageBufferOffsetAlignment
 
 	const std::vector<const char*> validationLayers = {
 		"VK_LAYER_KHRONOS_validation",
@@ -63,30 +225,210 @@ private:
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 	};
 
-	uint32_t currentFrame = 0;
+	// Driver host memory, declared first so it outlives everything created with its callbacks.
+	HostAllocator hostAllocator;
+	uint32_t swapchainRecreations = 0;
+	HostAllocator::Statistics recreationHostAllocations;	// allocations and malloc calls summed over every recreation
+
+	FrameScheduler frameScheduler;
+	PresentPacer presentPacer;
+	ShaderRegistry shaderRegistry;
+	TraceProfiler tracer;
+	std::chrono::steady_clock::time_point runStart;	// for time-to-first-present
+	double initMs = 0.0;
+	bool firstFrameReported = false;
+	uint32_t currentFrame = 0;	// slot of the frame being built, indexes the per-frame semaphores and queries
+	bool framebufferResized = false;
 
 	std::vector<VkImage> swapChainImages;
 	std::vector<VkImageView> swapchainImageViews;
 	std::vector<VkFramebuffer> swapchainFrameBuffers;
-	std::vector<VkCommandBuffer> commandBuffers;
+	std::vector<CachedCommandBuffer> commandBufferCache;
+	uint64_t sceneVersion = 1;	// bump whenever the recorded draws must change
+	uint64_t commandBufferReplays = 0;
+	uint64_t commandBufferRecords = 0;
+	std::unique_ptr<JobSystem> jobSystem;
 	std::vector<VkSemaphore> imageAvaliableSemaphores;
 	std::vector<VkSemaphore> renderFinishedSemaphores;
-	std::vector<VkFence> inFlightFences;
+	DeletionQueue deletionQueue;	// objects replaced at runtime, destroyed once their frames complete
+
+	// Headless render targets, used in place of the swap chain images when config.headless is set.
+	std::vector<GpuAllocation> offscreenImageAllocations;
+	uint32_t offscreenImageIndex = 0;
 
+	// Multisampled color targets, one per image, resolved into the image at the end of rendering. Empty without MSAA.
+	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+	std::vector<VkImage> msaaImages;
+	std::vector<GpuAllocation> msaaImageAllocations;
+	std::vector<VkImageView> msaaImageViews;
+
+	// Depth targets, one per image with the MSAA sample count, cleared every frame and never stored.
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+	std::vector<VkImage> depthImages;
+	std::vector<GpuAllocation> depthImageAllocations;
+	std::vector<VkImageView> depthImageViews;
+
+	// Device memory for every buffer and image we create ourselves.
+	GpuAllocator gpuAllocator;
+	UploadQueue uploadQueue;
+
+	// Scene geometry, uploaded once to device local memory.
+	const std::vector<Vertex> vertices = {
+		{ { 0.0f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+		{ { 0.5f, 0.5f }, { 0.0f, 1.0f, 0.0f } },
+		{ { -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f } },
+	};
+	const std::vector<uint16_t> indices = { 0, 1, 2 };
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	GpuAllocation vertexBufferAllocation;
+	GpuAllocation indexBufferAllocation;
+
+	/*
+	* Instance attributes, persistently mapped (device local on the GPU-driven path, where the cull pass writes them).
+	* Every swap chain image has its own region of instanceCapacity instances, so the cached command buffers of an image
+	* always bind the same offset, and the region is only rewritten after the image's previous frame has completed.
+	*/
+	VkBuffer instanceBuffer = VK_NULL_HANDLE;
+	GpuAllocation instanceAllocation;
+	uint32_t instanceCapacity = 0;
+	uint32_t instanceRegionCount = 0;
+	VkDeviceSize instanceRegionSize = 0;	// bytes per image, aligned so a region can also be bound as a storage buffer
+	uint32_t instanceCount = 1;	// instances drawn, recorded into the command buffers
+	std::chrono::steady_clock::time_point animationStart;
+	double instanceUpdateMs = 0.0;	// CPU time spent writing instances, summed over all frames
+
+	/*
+	* Per-frame and per-draw shader constants, allocated from the image's region of the uniform ring every frame.
+	* The regions follow the images like the instance regions: cached command buffers bake the dynamic offsets of
+	* their image, and a frame allocates the same blocks in the same order, so the offsets never change under them.
+	*/
+	UniformRing uniformRing;
+	uint32_t uniformDrawCapacity = 0;	// draws a region has room for
+	VkDescriptorSetLayout uniformSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool uniformDescriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet uniformDescriptorSet = VK_NULL_HANDLE;	// written once, bound once per command buffer at the frame's offsets
+
+	// Front-to-back order of the instances, rebuilt every frame when config.depthSort is set.
+	DrawSorter drawSorter;
+	std::vector<uint64_t> drawKeys;
+	double drawSortMs = 0.0;	// part of instanceUpdateMs
+	uint32_t drawSorts = 0;
+
+	/*
+	* Overdraw counter (config.overdrawQueries): one pipeline statistics query per image around its rendering,
+	* counting fragment shader invocations and the triangles assembled. Read back once the image's previous frame has completed.
+	*/
+	bool pipelineStatisticsEnabled = false;
+	VkQueryPool overdrawQueryPool = VK_NULL_HANDLE;
+	uint32_t overdrawQueryCount = 0;
+	std::vector<bool> overdrawPending;	// the image's query was submitted and not read yet
+	uint64_t overdrawFragments = 0;
+	uint64_t overdrawTriangles = 0;	// only the visible instances' with the GPU-driven path
+	uint64_t overdrawPixels = 0;
+	uint32_t overdrawFrames = 0;
+
+	/*
+	* GPU-driven path: the scene's instances stay in device local memory, uploaded when their count changes.
+	* Every frame a compute pass animates and culls them, appends the visible ones to the image's instance region
+	* and counts them into a single indirect draw. Recording is one dispatch and one draw call no matter how many
+	* objects there are, and all the CPU writes per frame is a CullFrame. The indirect draws and the CullFrames
+	* have a 256 byte slot per image.
+	*/
+	bool gpuDriven = false;
+	VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline cullPipeline = VK_NULL_HANDLE;
+	VkDescriptorPool cullDescriptorPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> cullDescriptorSets;
+	VkBuffer sceneInstanceBuffer = VK_NULL_HANDLE;
+	GpuAllocation sceneInstanceAllocation;
+	uint32_t sceneInstanceCount = 0;	// instances the scene buffer holds, 0 = not uploaded yet
+	VkBuffer indirectBuffer = VK_NULL_HANDLE;
+	GpuAllocation indirectAllocation;
+	VkBuffer cullFrameBuffer = VK_NULL_HANDLE;
+	GpuAllocation cullFrameAllocation;	// persistently mapped
+	uint32_t maxComputeGroups = 0;	// maxComputeWorkGroupCount[0], the cull pass spreads over y beyond it
+
+	/*
+	* Dynamic rendering path (VK_KHR_dynamic_rendering with VK_KHR_synchronization2): rendering begins on the image view
+	* itself, so there are no render pass and framebuffer objects to build or to rebuild with the swap chain.
+	* The layout transitions the render pass did implicitly are explicit barriers. Entry points of the extensions.
+	*/
+	bool dynamicRendering = false;
+	PFN_vkCmdBeginRenderingKHR cmdBeginRendering = nullptr;
+	PFN_vkCmdEndRenderingKHR cmdEndRendering = nullptr;
+	PFN_vkCmdPipelineBarrier2KHR cmdPipelineBarrier2 = nullptr;
+
+	/*
+	* Bindless resources: one descriptor set holds every texture and buffer and is bound once per command buffer.
+	* Each draw reads its material through the buffer array, indexed by a push constant.
+	*/
+	BindlessDescriptors bindless;
+	VkBuffer materialBuffer = VK_NULL_HANDLE;
+	GpuAllocation materialAllocation;
+	std::vector<uint32_t> materialIndices;	// element of each material in the bindless buffer array
+
+	// The per-draw descriptor sets runBindingBenchmark() compares bindless against, only exist during the benchmark.
+	VkDescriptorSetLayout perDrawSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout perDrawPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline perDrawPipeline = VK_NULL_HANDLE;	// recordSceneCommands() binds a set per draw while this is set
+	VkDescriptorPool perDrawDescriptorPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> perDrawDescriptorSets;	// one per material
+
+	/*
+	* Streamed textures (config.textureCount): the draws take turns through them, each asks for the mip that matches
+	* its size on screen. The streamer's commands for the frame are submitted ahead of the frame's.
+	*/
+	TextureStreamer textureStreamer;
+	bool memoryBudgetSupported = false;
+	float instanceScale = 1.0f;		// of the last updateInstances(), in clip space units
+	uint32_t textureRotation = 0;	// added to the draw index to pick its texture, advances every second
+
+	// Synthetic asset streamed through the upload queue, only used when config.streamMegabytes is set.
+	std::vector<char> streamData;
+	VkBuffer streamBuffer = VK_NULL_HANDLE;
+	GpuAllocation streamAllocation;
+	size_t streamedBytes = 0;
+	uint32_t streamFrames = 0;
+	std::chrono::steady_clock::time_point streamStart;
+
+	// Frame benchmark, only engaged when config.benchFrames is set.
+	std::optional<FrameBenchmark> benchmark;
+	VkQueryPool timestampQueryPool = VK_NULL_HANDLE;	// two timestamps (render pass begin/end) per frame in flight
+	std::vector<std::optional<uint64_t>> timestampFrames;	// benchmark frame whose timestamps each frame in flight holds
+	std::vector<VkCommandBuffer> timestampCommandBuffers;	// pre-recorded begin/end timestamp writes per frame in flight
+	double timestampPeriod = 0.0;	// nanoseconds per timestamp tick
+	uint64_t timestampMask = 0;		// valid bits of the graphics queue's timestamps
 
 	GLFWwindow* window   = nullptr;
 	VkInstance  instance = nullptr;
-	VkSurfaceKHR surface;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
 	VkQueue		presentationQueue; // handle to interface with the queue
 	VkQueue		graphicQueue;	// handle to interface with the queue
+	VkQueue		transferQueue = VK_NULL_HANDLE;	// dedicated transfer queue, the graphics queue when there is none
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 	VkDevice	logicalDevice;
-	VkSwapchainKHR swapchain;
+	VkSwapchainKHR swapchain = VK_NULL_HANDLE;
 	VkFormat swapchainFormat;
+	VkColorSpaceKHR swapchainColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
 	VkExtent2D swapchainExtent;
-	VkRenderPass renderPass;
+	VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+	VkRenderPass renderPass = VK_NULL_HANDLE;	// stays null with dynamic rendering
 	VkPipelineLayout pipelineLayout;
-	VkPipeline pipeline;
+	VkPipeline pipeline;	// the variant the recorded commands bind, owned by pipelineVariants
+	PipelineVariantCache pipelineVariants;
+	std::vector<std::pair<VkObjectType, uint64_t>> compileInputs;	// replaced, waiting for retireCompileInputs()
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	VkShaderModule vertexShaderModule = VK_NULL_HANDLE;
+	VkShaderModule fragmentShaderModule = VK_NULL_HANDLE;
+	VkShaderModule cullShaderModule = VK_NULL_HANDLE;
+	// Shader hot reload, only active with config.shaderSourceDirectory
+	ShaderWatcher shaderWatcher;
+	std::unique_ptr<ShaderReload> shaderReload;	// in flight, null when none is
+	bool shaderReloadQueued = false;	// sources changed and haven't been rebuilt yet
+	uint32_t shaderReloads = 0;
+	size_t pipelineCacheLoadedSize = 0;	// bytes of valid cache data found on disk, 0 means a cold start
 	VkCommandPool commandPool;
 	VkDebugUtilsMessengerEXT debugMessenger;
 
@@ -98,6 +440,8 @@ private:
 
 	// Loop Application
 	void mainLoop();
+	// Statistics of the run and the benchmark report, once the device is idle
+	void printRunSummary();
 
 	// Draw Frame !!!
 	void drawFrame();
@@ -124,13 +468,85 @@ private:
 	VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& avaliableModes); // choose a mode about how to present an img
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities); // resolution of images in swap chain
 
+	// Swapchain Recreation
+	static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
+	void recreateSwapChain();
+
+	// Headless render targets, replaces the swap chain when there is no window to present to
+	void createOffscreenTargets();
+
 	// Createa ImageView Objects
 	void createImageViews();
+	void createColorTargets();
+	void createDepthTargets();
 
 	// Create pipeline
 	void createRenderPass();
 	void createGraphicsPipeline();
-	VkShaderModule createShaderModule(const std::vector<char>& shader);
+	VkPipeline compilePipelineVariant(const PipelineVariantKey& key, VkPipelineLayout layout, VkShaderModule vertexModule, VkShaderModule fragmentModule,
+		VkRenderPass pass, VkFormat colorFormat);
+	// Background compiles queued from now on build from the current layout, shaders, render pass and format
+	void bindVariantCompiler();
+	void selectPipelineVariant();
+	// Retire what released variant compiles were built from, once none of them runs anymore
+	void retireCompileInputs();
+	VkShaderModule createShaderModule(const ShaderBinary& shader);
+	void createShaderModules();
+
+	// Shader hot reload: watch the sources, rebuild in the background, swap at a frame boundary
+	void watchShaderSources();
+	void pollShaderReload();
+	void startShaderReload();
+	void finishShaderReload();
+	void discardShaderReload();
+	// Pick the color format (and color space) ahead of the swap chain, so the render pass doesn't have to wait for it
+	void chooseSwapchainFormat();
+	void chooseSampleCount();
+	void chooseDepthFormat();
+	VkImageAspectFlags depthAspectMask() const;
+
+	// Pipeline cache persisted across runs
+	void createPipelineCache();
+	bool isPipelineCacheCompatible(const std::vector<char>& data);
+	void savePipelineCache();
+
+	// Vertex and index buffers
+	void createGeometryBuffers();
+	VkBuffer createDeviceLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage,
+		VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, GpuAllocation& allocation);
+
+	// Bindless materials, and the per-draw descriptor sets they are benchmarked against
+	void createMaterials();
+	static VkPushConstantRange drawConstantRange();
+	void runBindingBenchmark();
+	void createPerDrawDescriptorSets();
+	void destroyPerDrawDescriptorSets();
+
+	// Streamed textures
+	void createTextures();
+	uint32_t drawTexture(uint32_t draw) const;
+	VkCommandBuffer useTextures();
+
+	// Per-instance attributes
+	void createInstanceBuffer();
+	// Instances the sweep's buffer can hold, up to MAX_SWEEP_INSTANCES
+	uint32_t sweepInstanceCapacity() const;
+	void updateInstances(uint32_t imageIndex);
+	void runInstanceSweep();
+
+	// Per-frame and per-draw uniforms
+	void createUniformSetLayout();
+	void createUniformRing();
+	void writeUniforms(uint32_t imageIndex, uint32_t drawCount);
+
+	// GPU-driven culling and indirect draws
+	void createCullPipeline();
+	void createCullingBuffers();
+	void recordCulling(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+	// Asynchronous uploads on the transfer queue
+	void createUploadQueue();
+	void streamUploads();
 
 	// Create Frambuffers
 	void createFrameBuffers();
@@ -143,6 +559,17 @@ private:
 
 	// Create Sync Objects
 	void createSyncObjects();
+	void runPacingSweep();
+
+	// Benchmark GPU timestamps
+	void createTimestampQueries();
+	void collectTimestamps(uint32_t frame);
+
+	// Overdraw counter
+	void createOverdrawQueries();
+	void collectOverdraw(uint32_t imageIndex);
+	void printOverdrawSummary();
+	void reportBenchmark();
 
 	// Tool Functions
 	void setupDebugMessenger();
@@ -150,12 +577,21 @@ private:
 	bool isDeviceSuitable(VkPhysicalDevice& device);
 	bool checkValidationLayerSupport();
 	bool checkDeviceExtensionsSupport(VkPhysicalDevice device);
+	bool hasDeviceExtension(VkPhysicalDevice device, const char* name);
+	std::vector<const char*> getRequiredDeviceExtensions();
 	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice& device);
 	void generateDebugMessengerCreateInfoEXT(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
 	std::vector<const char*> getRequiredExtentions();
 	SwapChainSupportDetails querySwapchainSupport(VkPhysicalDevice device);
 	static std::vector<char> readFile(const std::string& path);
 	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	// Transition, begin rendering, execute the scene's secondaries, end rendering, transition for present
+	void recordDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, const VkClearValue& clearColor);
+	void recordSceneCommands(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t firstDraw, uint32_t endDraw);
+	void prepareCommandBuffer(uint32_t imageIndex);
+	void recordFrameCommands(uint32_t imageIndex, uint32_t taskCount);
+	void runRecordingBenchmark();
+	void destroyCommandPools(const CachedCommandBuffer& cached);
 
 	// Clean up
 	void destroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator);
@@ -0,0 +1,81 @@
+#include "UniformRing.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+void UniformRing::init(VkPhysicalDevice physicalDevice, GpuAllocator& allocator)
+{
+	this->allocator = &allocator;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	// Powers of two by the spec, at most 256. The larger one suits both kinds of dynamic descriptor.
+	alignment = std::max<VkDeviceSize>({ properties.limits.minUniformBufferOffsetAlignment,
+		properties.limits.minStorageBufferOffsetAlignment, 1 });
+}
+
+void UniformRing::createRegions(uint32_t regionCount, VkDeviceSize regionSize)
+{
+	regions = regionCount;
+	bytesPerRegion = alignedSize(regionSize);
+
+	/*
+	* Written by the CPU every frame and read once by the GPU, like the instances. Host visible blocks are mapped
+	* by the allocator when created and stay mapped, so there's nothing to map here either.
+	*/
+	ringBuffer = allocator->createBuffer(bytesPerRegion * regions, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, ringAllocation);
+	if (ringAllocation.mapped == nullptr)
+	{
+		throw std::runtime_error("failed to map the uniform ring.");
+	}
+	regionStart = cursor = 0;
+}
+
+void UniformRing::destroy()
+{
+	if (ringBuffer != VK_NULL_HANDLE)
+	{
+		allocator->destroyBuffer(ringBuffer, ringAllocation);
+		ringBuffer = VK_NULL_HANDLE;
+	}
+}
+
+void UniformRing::release(VkBuffer& buffer, GpuAllocation& allocation)
+{
+	buffer = ringBuffer;
+	allocation = ringAllocation;
+	ringBuffer = VK_NULL_HANDLE;
+	ringAllocation = GpuAllocation{};
+}
+
+void UniformRing::begin(uint32_t region)
+{
+	regionStart = cursor = region * bytesPerRegion;
+}
+
+UniformRing::Allocation UniformRing::allocate(VkDeviceSize size)
+{
+	VkDeviceSize end = cursor + alignedSize(size);
+	if (end > regionStart + bytesPerRegion)
+	{
+		throw std::runtime_error("failed to allocate " + std::to_string(size) + " bytes of uniforms, the ring's regions hold "
+			+ std::to_string(bytesPerRegion) + " bytes.");
+	}
+
+	// The offsets of a dynamic descriptor are 32 bit, the ring is far smaller than 4 GB.
+	Allocation allocation;
+	allocation.offset = static_cast<uint32_t>(cursor);
+	allocation.data = static_cast<char*>(ringAllocation.mapped) + cursor;
+	cursor = end;
+	maxUsed = std::max(maxUsed, cursor - regionStart);
+	return allocation;
+}
+
+void UniformRing::flush() const
+{
+	if (cursor > regionStart)
+	{
+		allocator->flush(ringAllocation, regionStart, cursor - regionStart);
+	}
+}
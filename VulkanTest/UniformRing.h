@@ -0,0 +1,66 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <cstdint>
+
+#include "GpuAllocator.h"
+
+/*
+* Linear allocator for per-frame shader constants, over one uniform buffer that is persistently mapped.
+* The buffer is split into regions, one per swap chain image, as the cached command buffers of an image bake its offsets:
+* begin() rewinds a region and allocate() bumps through it. Every allocation starts at a multiple of minUniformBufferOffsetAlignment and of
+* minStorageBufferOffsetAlignment, so it can be handed to a UNIFORM_BUFFER_DYNAMIC or STORAGE_BUFFER_DYNAMIC descriptor
+* as a dynamic offset (arrays too large for a uniform block go in the latter). The descriptors are written once, against the whole
+* buffer, and a frame then costs neither vkMapMemory calls nor descriptor updates, however many constants it writes.
+* Rewriting a region is only safe once the GPU is done with the last frame that read it, that's up to the caller.
+* Owned by the render thread, it is not thread safe.
+*/
+class UniformRing
+{
+public:
+	// Where an allocation lives: the dynamic offset to bind, and its host address to write the constants to.
+	struct Allocation {
+		uint32_t offset = 0;
+		void* data = nullptr;
+	};
+
+	void init(VkPhysicalDevice physicalDevice, GpuAllocator& allocator);
+
+	/* Create the buffer, the previous one must have been destroyed or released
+	* @param regionSize in bytes, use alignedSize() to add up what a frame allocates
+	*/
+	void createRegions(uint32_t regionCount, VkDeviceSize regionSize);
+	// The device must be idle
+	void destroy();
+	// Hand the buffer over to the caller instead, e.g. to destroy it once the frames using it have completed
+	void release(VkBuffer& buffer, GpuAllocation& allocation);
+
+	// Rewind a region, the following allocations come from it
+	void begin(uint32_t region);
+	// Throws std::runtime_error when the region is full
+	Allocation allocate(VkDeviceSize size);
+	// Make the region's allocations visible to the device, once the frame has written them
+	void flush() const;
+
+	// Size a constant block takes up in the ring
+	VkDeviceSize alignedSize(VkDeviceSize size) const { return (size + alignment - 1) / alignment * alignment; }
+
+	VkBuffer buffer() const { return ringBuffer; }
+	uint32_t regionCount() const { return regions; }
+	VkDeviceSize regionSize() const { return bytesPerRegion; }
+	// Most bytes a region had allocated from it
+	VkDeviceSize highWaterMark() const { return maxUsed; }
+
+private:
+	GpuAllocator* allocator = nullptr;
+	VkDeviceSize alignment = 256;
+
+	VkBuffer ringBuffer = VK_NULL_HANDLE;
+	GpuAllocation ringAllocation;
+	uint32_t regions = 0;
+	VkDeviceSize bytesPerRegion = 0;
+
+	VkDeviceSize regionStart = 0;
+	VkDeviceSize cursor = 0;	// next free byte of the current region, from the start of the buffer
+	VkDeviceSize maxUsed = 0;
+};
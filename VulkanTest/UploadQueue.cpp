@@ -0,0 +1,389 @@
+#include "UploadQueue.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+	// Smallest copy worth recording when only a part of an upload fits in the ring.
+	const VkDeviceSize MIN_CHUNK_SIZE = 64 * 1024;
+}
+
+void UploadQueue::init(VkDevice device, GpuAllocator& allocator, VkQueue transferQueue, uint32_t transferFamily,
+	VkQueue graphicsQueue, uint32_t graphicsFamily, VkDeviceSize ringSize)
+{
+	this->device = device;
+	this->allocator = &allocator;
+	this->hostAllocator = allocator.hostAllocationCallbacks();
+	this->transferQueue = transferQueue;
+	this->transferFamily = transferFamily;
+	this->graphicsQueue = graphicsQueue;
+	this->graphicsFamily = graphicsFamily;
+	this->ringSize = ringSize;
+
+	// Mapped once for the lifetime of the queue, uploads only memcpy into it.
+	ringBuffer = allocator.createBuffer(ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, ringAllocation);
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	VkCommandBufferAllocateInfo commandBufferAllocInfo{};
+	commandBufferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocInfo.commandBufferCount = 1;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	for (Batch& batch : batches)
+	{
+		poolInfo.queueFamilyIndex = transferFamily;
+		if (vkCreateCommandPool(device, &poolInfo, hostAllocator, &batch.transferPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upload command pool.");
+		}
+
+		commandBufferAllocInfo.commandPool = batch.transferPool;
+		if (vkAllocateCommandBuffers(device, &commandBufferAllocInfo, &batch.transferCommands) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate upload command buffer.");
+		}
+
+		// Ownership only has to be acquired when the copies run on another queue family.
+		if (hasDedicatedQueue())
+		{
+			poolInfo.queueFamilyIndex = graphicsFamily;
+			if (vkCreateCommandPool(device, &poolInfo, hostAllocator, &batch.graphicsPool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create upload command pool.");
+			}
+
+			commandBufferAllocInfo.commandPool = batch.graphicsPool;
+			if (vkAllocateCommandBuffers(device, &commandBufferAllocInfo, &batch.acquireCommands) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to allocate upload command buffer.");
+			}
+		}
+
+		if (vkCreateSemaphore(device, &semaphoreInfo, hostAllocator, &batch.transferDone) != VK_SUCCESS ||
+			vkCreateFence(device, &fenceInfo, hostAllocator, &batch.transferFence) != VK_SUCCESS ||
+			vkCreateFence(device, &fenceInfo, hostAllocator, &batch.acquireFence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create synchronization objects for an upload batch!");
+		}
+	}
+}
+
+void UploadQueue::destroy()
+{
+	for (Batch& batch : batches)
+	{
+		vkDestroySemaphore(device, batch.transferDone, hostAllocator);
+		vkDestroyFence(device, batch.transferFence, hostAllocator);
+		vkDestroyFence(device, batch.acquireFence, hostAllocator);
+		vkDestroyCommandPool(device, batch.transferPool, hostAllocator);
+		if (batch.graphicsPool != VK_NULL_HANDLE)
+		{
+			vkDestroyCommandPool(device, batch.graphicsPool, hostAllocator);
+		}
+		batch = Batch{};
+	}
+
+	allocator->destroyBuffer(ringBuffer, ringAllocation);
+}
+
+VkDeviceSize UploadQueue::uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, bool wait)
+{
+	VkDeviceSize queued = 0;
+	while (queued < size)
+	{
+		Batch* batch = beginBatch(wait);
+		if (batch == nullptr)
+		{
+			break;
+		}
+
+		VkDeviceSize stagingOffset = 0;
+		VkDeviceSize chunk = 0;
+		if (!reserve(size - queued, stagingOffset, chunk))
+		{
+			if (!wait)
+			{
+				break;
+			}
+
+			// The ring is full: send what we have and wait for the oldest batch to hand its staging range back.
+			stalls++;
+			submit();
+			retireBatches(true);
+			continue;
+		}
+
+		std::memcpy(static_cast<char*>(ringAllocation.mapped) + stagingOffset, static_cast<const char*>(data) + queued, static_cast<size_t>(chunk));
+		allocator->flush(ringAllocation, stagingOffset, chunk);
+
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = stagingOffset;
+		copyRegion.dstOffset = offset + queued;
+		copyRegion.size = chunk;
+		vkCmdCopyBuffer(batch->transferCommands, ringBuffer, buffer, 1, &copyRegion);
+
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.buffer = buffer;
+		barrier.offset = copyRegion.dstOffset;
+		barrier.size = chunk;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		if (hasDedicatedQueue())
+		{
+			/*
+			* Queue family ownership transfer: the release half runs on the transfer queue, the acquire half
+			* (the same barrier, same range) on the graphics queue after waiting on the batch's semaphore.
+			*/
+			barrier.dstAccessMask = 0;
+			barrier.srcQueueFamilyIndex = transferFamily;
+			barrier.dstQueueFamilyIndex = graphicsFamily;
+			vkCmdPipelineBarrier(batch->transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr, 1, &barrier, 0, nullptr);
+
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = dstAccess;
+			vkCmdPipelineBarrier(batch->acquireCommands, dstStage, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		}
+		else
+		{
+			barrier.dstAccessMask = dstAccess;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			vkCmdPipelineBarrier(batch->transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		}
+
+		batch->waitStages |= dstStage;
+		queued += chunk;
+	}
+
+	bytesUploaded += queued;
+	return queued;
+}
+
+void UploadQueue::submit()
+{
+	Batch& batch = batches[submittedBatches % MAX_BATCHES];
+	if (batch.state != BatchState::Recording or batch.waitStages == 0)
+	{
+		return;
+	}
+
+	if (vkEndCommandBuffer(batch.transferCommands) != VK_SUCCESS or
+		(batch.acquireCommands != VK_NULL_HANDLE and vkEndCommandBuffer(batch.acquireCommands) != VK_SUCCESS))
+	{
+		throw std::runtime_error("failed to end command buffer");
+	}
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.transferCommands;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &batch.transferDone;
+
+	vkResetFences(device, 1, &batch.transferFence);
+	if (vkQueueSubmit(transferQueue, 1, &submitInfo, batch.transferFence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit upload command buffer.");
+	}
+
+	batch.ringEnd = ringHead;
+	batch.state = BatchState::Submitted;
+	submittedBatches++;
+}
+
+void UploadQueue::takeHandoff(Handoff& handoff, VkSemaphore graphicsTimeline, uint64_t graphicsValue)
+{
+	handoff = Handoff{};
+
+	// Oldest first, so the waits follow submission order.
+	for (uint64_t i = submittedBatches - std::min<uint64_t>(submittedBatches, MAX_BATCHES); i < submittedBatches; i++)
+	{
+		Batch& batch = batches[i % MAX_BATCHES];
+		if (batch.state != BatchState::Submitted)
+		{
+			continue;
+		}
+
+		handoff.waitSemaphores[handoff.waitSemaphoreCount] = batch.transferDone;
+		handoff.waitStages[handoff.waitSemaphoreCount] = batch.waitStages;
+		handoff.waitSemaphoreCount++;
+		if (batch.acquireCommands != VK_NULL_HANDLE)
+		{
+			handoff.commandBuffers[handoff.commandBufferCount++] = batch.acquireCommands;
+		}
+
+		batch.graphicsTimeline = graphicsTimeline;
+		batch.graphicsValue = graphicsValue;
+		batch.state = BatchState::HandedOff;
+	}
+}
+
+UploadQueue::Batch* UploadQueue::beginBatch(bool wait)
+{
+	Batch& batch = batches[submittedBatches % MAX_BATCHES];
+	if (batch.state == BatchState::Recording)
+	{
+		return &batch;
+	}
+
+	// Nobody picked the batch up (e.g. uploads during initialization), consume its semaphore ourselves.
+	if (batch.state == BatchState::Submitted)
+	{
+		handOffToGraphicsQueue(batch);
+	}
+
+	if (batch.state == BatchState::HandedOff)
+	{
+		// The slot was last used MAX_BATCHES batches ago: its staging range and its semaphore wait must be done.
+		retireBatches(false);
+		bool transferDone = retiredBatches + MAX_BATCHES > submittedBatches;
+		bool graphicsDone = isGraphicsDone(batch, false);
+
+		if (!transferDone or !graphicsDone)
+		{
+			if (!wait)
+			{
+				return nullptr;
+			}
+
+			stalls++;
+			while (retiredBatches + MAX_BATCHES <= submittedBatches)
+			{
+				retireBatches(true);
+			}
+			isGraphicsDone(batch, true);
+		}
+	}
+
+	vkResetCommandPool(device, batch.transferPool, 0);
+	if (batch.graphicsPool != VK_NULL_HANDLE)
+	{
+		vkResetCommandPool(device, batch.graphicsPool, 0);
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (vkBeginCommandBuffer(batch.transferCommands, &beginInfo) != VK_SUCCESS or
+		(batch.acquireCommands != VK_NULL_HANDLE and vkBeginCommandBuffer(batch.acquireCommands, &beginInfo) != VK_SUCCESS))
+	{
+		throw std::runtime_error("failed to begin recording command buffers.");
+	}
+
+	batch.waitStages = 0;
+	batch.graphicsTimeline = VK_NULL_HANDLE;
+	batch.graphicsValue = 0;
+	batch.state = BatchState::Recording;
+	return &batch;
+}
+
+bool UploadQueue::reserve(VkDeviceSize size, VkDeviceSize& offset, VkDeviceSize& granted)
+{
+	retireBatches(false);
+
+	VkDeviceSize wanted = std::min(size, MIN_CHUNK_SIZE);
+	VkDeviceSize start = ringHead % ringSize;
+	VkDeviceSize contiguous = ringSize - start;
+	VkDeviceSize free = ringSize - (ringHead - ringTail);
+
+	// Copies never wrap around, skip the end of the ring when it's too small and the start has room.
+	if (contiguous < wanted and free >= contiguous + wanted)
+	{
+		ringHead += contiguous;
+		free -= contiguous;
+		start = 0;
+		contiguous = ringSize;
+	}
+
+	VkDeviceSize available = std::min(free, contiguous);
+	if (available < wanted)
+	{
+		return false;
+	}
+
+	offset = start;
+	granted = std::min(size, available);
+	ringHead += granted;
+	return true;
+}
+
+void UploadQueue::retireBatches(bool waitForOldest)
+{
+	while (retiredBatches < submittedBatches)
+	{
+		Batch& batch = batches[retiredBatches % MAX_BATCHES];
+		if (waitForOldest)
+		{
+			vkWaitForFences(device, 1, &batch.transferFence, VK_TRUE, UINT64_MAX);
+			waitForOldest = false;
+		}
+		else if (vkGetFenceStatus(device, batch.transferFence) != VK_SUCCESS)
+		{
+			break;
+		}
+
+		ringTail = batch.ringEnd;
+		retiredBatches++;
+	}
+}
+
+void UploadQueue::handOffToGraphicsQueue(Batch& batch)
+{
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &batch.transferDone;
+	submitInfo.pWaitDstStageMask = &batch.waitStages;
+	submitInfo.commandBufferCount = batch.acquireCommands != VK_NULL_HANDLE ? 1 : 0;
+	submitInfo.pCommandBuffers = &batch.acquireCommands;
+
+	vkResetFences(device, 1, &batch.acquireFence);
+	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, batch.acquireFence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit upload command buffer.");
+	}
+
+	batch.graphicsTimeline = VK_NULL_HANDLE;
+	batch.state = BatchState::HandedOff;
+}
+
+bool UploadQueue::isGraphicsDone(const Batch& batch, bool wait) const
+{
+	if (batch.graphicsTimeline == VK_NULL_HANDLE)
+	{
+		if (wait)
+		{
+			vkWaitForFences(device, 1, &batch.acquireFence, VK_TRUE, UINT64_MAX);
+			return true;
+		}
+		return vkGetFenceStatus(device, batch.acquireFence) == VK_SUCCESS;
+	}
+
+	if (wait)
+	{
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &batch.graphicsTimeline;
+		waitInfo.pValues = &batch.graphicsValue;
+		vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+		return true;
+	}
+
+	uint64_t value = 0;
+	vkGetSemaphoreCounterValue(device, batch.graphicsTimeline, &value);
+	return value >= batch.graphicsValue;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <cstdint>
+
+#include "GpuAllocator.h"
+
+/*
+* Asynchronous uploads through a persistently mapped staging ring.
+* Copies are batched into command buffers submitted on the transfer queue, which is a dedicated
+* transfer family when the device has one. Each batch signals a semaphore that the next graphics
+* submit waits on, together with the barriers acquiring ownership of the uploaded ranges.
+* Owned by the render thread, it is not thread safe.
+*/
+class UploadQueue
+{
+public:
+	static constexpr uint32_t MAX_BATCHES = 4;
+
+	// What a graphics submit has to add to pick up the submitted batches.
+	struct Handoff {
+		uint32_t waitSemaphoreCount = 0;
+		VkSemaphore waitSemaphores[MAX_BATCHES];
+		VkPipelineStageFlags waitStages[MAX_BATCHES];
+		uint32_t commandBufferCount = 0;
+		VkCommandBuffer commandBuffers[MAX_BATCHES];	// acquire barriers, must be submitted before anything using the data
+	};
+
+	void init(VkDevice device, GpuAllocator& allocator, VkQueue transferQueue, uint32_t transferFamily,
+		VkQueue graphicsQueue, uint32_t graphicsFamily, VkDeviceSize ringSize = 32ull << 20);
+	// The device must be idle
+	void destroy();
+
+	/* Queue a copy into a buffer, split into several copies (and batches) when it doesn't fit the ring at once
+	* @param destination buffer, created with TRANSFER_DST usage and exclusive sharing
+	* @param stage and access of the first graphics use of the data
+	* @param false returns as soon as the ring is full instead of waiting for the transfer queue to free space
+	* @return bytes queued, always size when waiting
+	*/
+	VkDeviceSize uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+		VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, bool wait = true);
+
+	// Submit the copies queued since the last call
+	void submit();
+
+	/* Hand every submitted batch to a graphics submit
+	* @param receives the semaphores to wait on and the acquire command buffers to execute first
+	* @param timeline semaphore the graphics submit signals
+	* @param value it signals, the batches are reused once the timeline has reached it
+	*/
+	void takeHandoff(Handoff& handoff, VkSemaphore graphicsTimeline, uint64_t graphicsValue);
+
+	bool hasDedicatedQueue() const { return transferFamily != graphicsFamily; }
+	uint64_t uploadedBytes() const { return bytesUploaded; }
+	uint64_t submittedBatchCount() const { return submittedBatches; }
+	uint64_t stallCount() const { return stalls; }
+
+private:
+	enum class BatchState { Idle, Recording, Submitted, HandedOff };
+
+	struct Batch {
+		VkCommandPool transferPool = VK_NULL_HANDLE;
+		VkCommandPool graphicsPool = VK_NULL_HANDLE;
+		VkCommandBuffer transferCommands = VK_NULL_HANDLE;	// copies and release barriers
+		VkCommandBuffer acquireCommands = VK_NULL_HANDLE;	// acquire barriers, only with a dedicated transfer family
+		VkSemaphore transferDone = VK_NULL_HANDLE;
+		VkFence transferFence = VK_NULL_HANDLE;				// staging range is free once this signals
+		VkFence acquireFence = VK_NULL_HANDLE;				// signaled when the batch was picked up by our own graphics submit
+		// The graphics submit that waited on transferDone: a timeline value, or acquireFence when graphicsTimeline is null
+		VkSemaphore graphicsTimeline = VK_NULL_HANDLE;
+		uint64_t graphicsValue = 0;
+		VkPipelineStageFlags waitStages = 0;
+		uint64_t ringEnd = 0;
+		BatchState state = BatchState::Idle;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	GpuAllocator* allocator = nullptr;
+	const VkAllocationCallbacks* hostAllocator = nullptr;	// the GpuAllocator's
+	VkQueue transferQueue = VK_NULL_HANDLE;
+	VkQueue graphicsQueue = VK_NULL_HANDLE;
+	uint32_t transferFamily = 0;
+	uint32_t graphicsFamily = 0;
+
+	// The ring positions only ever grow, their difference is the staging memory in use.
+	VkBuffer ringBuffer = VK_NULL_HANDLE;
+	GpuAllocation ringAllocation;
+	VkDeviceSize ringSize = 0;
+	uint64_t ringHead = 0;
+	uint64_t ringTail = 0;
+
+	Batch batches[MAX_BATCHES];
+	uint64_t submittedBatches = 0;	// batch submittedBatches % MAX_BATCHES is the one being recorded
+	uint64_t retiredBatches = 0;	// batches whose staging range has been reclaimed
+
+	uint64_t bytesUploaded = 0;
+	uint64_t stalls = 0;
+
+	Batch* beginBatch(bool wait);
+	// Carve up to size bytes (at least MIN_CHUNK_SIZE or size) out of the ring, false when it is too full
+	bool reserve(VkDeviceSize size, VkDeviceSize& offset, VkDeviceSize& granted);
+	void retireBatches(bool waitForOldest);
+	void handOffToGraphicsQueue(Batch& batch);
+	// Whether the graphics submit that consumed the batch has completed, blocks until it has when wait is set
+	bool isGraphicsDone(const Batch& batch, bool wait) const;
+};
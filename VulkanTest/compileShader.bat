@@ -1,3 +1,3 @@
-C:/VulkanSDK/1.2.141.2/Bin32/glslc.exe shader.vert -o vert.spv
-C:/VulkanSDK/1.2.141.2/Bin32/glslc.exe shader.frag -o frag.spv
-pause
\ No newline at end of file
+rem Same as compileShader.py, which finds glslc and spirv-val through %VULKAN_SDK% or the PATH
+python "%~dp0compileShader.py" %*
+pause
@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""
+Compiles the shaders next to this script with glslc and validates the modules with spirv-val.
+Writes <name>.spv for --shader-dir and <name>.spv.inc, the word list ShaderRegistry.cpp embeds.
+Both are build outputs: rerun this whenever a shader source changes, then rebuild.
+
+glslc and spirv-val are taken from $VULKAN_SDK, then the PATH. --glslc overrides glslc.
+--check compiles nothing and fails when an output is missing or out of date.
+"""
+import argparse
+import os
+import shutil
+import struct
+import subprocess
+import sys
+
+SHADERS = [("shader.vert", "vert.spv"), ("shader.frag", "frag.spv"), ("cull.comp", "cull.spv")]
+
+
+def find_tool(name):
+	sdk = os.environ.get("VULKAN_SDK")
+	if sdk:
+		# Bin on Windows, bin everywhere else
+		for directory in ("bin", "Bin"):
+			path = os.path.join(sdk, directory, name + ".exe" if os.name == "nt" else name)
+			if os.path.isfile(path):
+				return path
+	return shutil.which(name)
+
+
+def run(command):
+	if subprocess.run(command).returncode != 0:
+		sys.exit("failed to run " + " ".join(command))
+
+
+def read_words(path):
+	with open(path, "rb") as file:
+		data = file.read()
+	return list(struct.unpack("<%dI" % (len(data) // 4), data))
+
+
+def format_words(words):
+	# The format of glslc -mfmt=num, an array initializer
+	lines = [",".join("0x%08x" % word for word in words[i:i + 8]) for i in range(0, len(words), 8)]
+	return ",\n".join(lines) + "\n"
+
+
+def stale_outputs(directory):
+	stale = []
+	for source, output in SHADERS:
+		source = os.path.join(directory, source)
+		output = os.path.join(directory, output)
+		include = output + ".inc"
+		if not os.path.isfile(output) or not os.path.isfile(include):
+			stale.append(output + " is missing")
+		elif os.path.getmtime(output) < os.path.getmtime(source) or os.path.getmtime(include) < os.path.getmtime(source):
+			stale.append(output + " is older than " + source)
+		else:
+			with open(include) as file:
+				if file.read() != format_words(read_words(output)):
+					stale.append(include + " doesn't hold the words of " + output)
+	return stale
+
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+	parser.add_argument("--glslc", help="path of glslc")
+	parser.add_argument("--check", action="store_true", help="only check that the outputs match the sources")
+	args = parser.parse_args()
+
+	directory = os.path.dirname(os.path.abspath(__file__))
+	if args.check:
+		stale = stale_outputs(directory)
+		if stale:
+			sys.exit("\n".join(stale) + "\nrun compileShader.py")
+		return
+
+	glslc = args.glslc or find_tool("glslc")
+	validator = find_tool("spirv-val")
+	if glslc is None or validator is None:
+		sys.exit("failed to find glslc and spirv-val, set VULKAN_SDK or put them on the PATH")
+
+	for source, output in SHADERS:
+		output = os.path.join(directory, output)
+		run([glslc, os.path.join(directory, source), "-o", output])
+		# glslc targets Vulkan 1.0 by default
+		run([validator, "--target-env", "vulkan1.0", output])
+
+		# Written from the validated module, so the embedded words are always the ones spirv-val checked.
+		with open(output + ".inc", "w") as file:
+			file.write(format_words(read_words(output)))
+
+
+if __name__ == "__main__":
+	main()
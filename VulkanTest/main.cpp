@@ -1,11 +1,32 @@
 #include "TriangleApplication.h"
 #include <iostream>
 
-int main()
+int main(int argc, char** argv)
 {
-	TriangleApplication app;
-	app.run();
+	AppConfig config;
+	try
+	{
+		config = parseCommandLine(argc, argv);
+	}
+	catch (const std::invalid_argument& e)
+	{
+		std::cerr << e.what() << std::endl;
+		printUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	TriangleApplication app(config);
+
+	try
+	{
+		app.run();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
 
 	return 0;
 
-}
\ No newline at end of file
+}
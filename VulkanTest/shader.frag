@@ -1,8 +1,38 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Specialized per pipeline variant: 0 vertex colors, 1 luminance, 2 half transparent (for the blended variants).
+layout(constant_id = 0) const uint SHADING_MODE = 0;
+
+// The bindless texture array (BindlessDescriptors::TEXTURE_BINDING), the streamed textures.
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+
+// The bindless storage buffer array (BindlessDescriptors::BUFFER_BINDING), each draw reads its own material.
+layout(set = 0, binding = 1) readonly buffer Material {
+	vec4 tint;
+} materials[];
+
+// Shared with shader.vert, DrawConstants on the C++ side.
+layout(push_constant) uniform DrawConstants {
+	uint materialIndex;
+	uint drawIndex;
+} draw;
 
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) flat in uint fragTexture;
+layout(location = 2) in vec2 fragUV;
 layout(location = 0) out vec4 outColor;
 
 void main() {
-	outColor = vec4(fragColor, 1.0);
-}
\ No newline at end of file
+	vec3 color = fragColor * materials[draw.materialIndex].tint.rgb;
+	if (fragTexture != 0xFFFFFFFFu) {
+		color *= texture(textures[fragTexture], fragUV).rgb;
+	}
+	if (SHADING_MODE == 1) {
+		outColor = vec4(vec3(dot(color, vec3(0.299, 0.587, 0.114))), 1.0);
+	} else if (SHADING_MODE == 2) {
+		outColor = vec4(color, 0.5);
+	} else {
+		outColor = vec4(color, 1.0);
+	}
+}
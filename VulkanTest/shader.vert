@@ -1,21 +1,51 @@
 #version 450
 #extension GL_KHR_vulkan_glsl : enable
 
-layout(location = 0) out vec3 fragColor;
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+// Per instance: xy offset, z scale, w rotation, a tint and the depth (0 is the near plane).
+layout(location = 2) in vec4 inTransform;
+layout(location = 3) in vec4 inInstanceColor;
+layout(location = 4) in float inDepth;
 
-vec2 positions[3] = vec2[](
-	vec2(0.0, -0.5),
-	vec2(0.5, 0.5),
-	vec2(-0.5, 0.5)
-);
+// Blocks of the uniform ring, bound once per command buffer at the frame's offsets (FrameUniforms and DrawUniforms on the C++ side).
+layout(set = 1, binding = 0) uniform FrameUniforms {
+	vec4 view;			// xy scale, zw offset from scene to clip space
+} frame;
 
-vec3 colors[3] = vec3[](
-	vec3(1.0, 0.0, 0.0),
-	vec3(0.0, 1.0, 0.0),
-	vec3(0.0, 0.0, 1.0)
-);
+struct DrawUniforms {
+	vec4 transform;		// like the instance's, applied after it
+	uint texture;		// bindless texture index, 0xFFFFFFFF for none
+};
+layout(std430, set = 1, binding = 1) readonly buffer Draws {
+	DrawUniforms draws[];
+};
+
+// Shared with shader.frag, DrawConstants on the C++ side.
+layout(push_constant) uniform DrawConstants {
+	uint materialIndex;
+	uint drawIndex;		// element of draws
+} constants;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) flat out uint fragTexture;
+layout(location = 2) out vec2 fragUV;
+
+vec2 transform2D(vec2 position, vec4 transform) {
+	float s = sin(transform.w);
+	float c = cos(transform.w);
+	position *= transform.z;
+	return vec2(c * position.x - s * position.y, s * position.x + c * position.y) + transform.xy;
+}
 
 void main() {
-	gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-	fragColor = colors[gl_VertexIndex];
-}
\ No newline at end of file
+	DrawUniforms draw = draws[constants.drawIndex];
+	vec2 position = transform2D(transform2D(inPosition, inTransform), draw.transform);
+
+	gl_Position = vec4(position * frame.view.xy + frame.view.zw, inDepth, 1.0);
+	fragColor = inColor * inInstanceColor.rgb;
+	fragTexture = draw.texture;
+	// The triangle spans [-0.5, 0.5], the texture covers it once.
+	fragUV = inPosition + 0.5;
+}